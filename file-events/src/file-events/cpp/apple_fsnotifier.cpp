@@ -4,6 +4,10 @@
 
 using namespace std;
 
+static void releaseWatchPointContext(const void* info) {
+    delete (WatchPointContext*) info;
+}
+
 WatchPoint::WatchPoint(Server* server, CFRunLoopRef runLoop, const u16string& path, long latencyInMillis) {
     CFStringRef cfPath = CFStringCreateWithCharacters(NULL, (UniChar*) path.c_str(), path.length());
     if (cfPath == nullptr) {
@@ -15,12 +19,14 @@ WatchPoint::WatchPoint(Server* server, CFRunLoopRef runLoop, const u16string& pa
     }
     CFArrayAppendValue(pathArray, cfPath);
 
+    // The context is released together with the stream
+    WatchPointContext* watchPointContext = new WatchPointContext { server, path };
     FSEventStreamContext context = {
-        0,                 // version, must be 0
-        (void*) server,    // info
-        NULL,              // retain
-        NULL,              // release
-        NULL               // copyDescription
+        0,                            // version, must be 0
+        (void*) watchPointContext,    // info
+        NULL,                         // retain
+        releaseWatchPointContext,     // release
+        NULL                          // copyDescription
     };
     FSEventStreamRef watcherStream = FSEventStreamCreate(
         NULL,
@@ -33,6 +39,7 @@ WatchPoint::WatchPoint(Server* server, CFRunLoopRef runLoop, const u16string& pa
     CFRelease(pathArray);
     CFRelease(cfPath);
     if (watcherStream == NULL) {
+        delete watchPointContext;
         throw FileWatcherException("Couldn't add watch", path);
     }
     FSEventStreamScheduleWithRunLoop(watcherStream, runLoop, kCFRunLoopDefaultMode);
@@ -111,11 +118,12 @@ static void handleEventsCallback(
     void* eventPaths,
     const FSEventStreamEventFlags eventFlags[],
     const FSEventStreamEventId eventIds[]) {
-    Server* server = (Server*) clientCallBackInfo;
-    server->handleEvents(numEvents, (char**) eventPaths, eventFlags, eventIds);
+    WatchPointContext* context = (WatchPointContext*) clientCallBackInfo;
+    context->server->handleEvents(context->root, numEvents, (char**) eventPaths, eventFlags, eventIds);
 }
 
 void Server::handleEvents(
+    const u16string& root,
     size_t numEvents,
     char** eventPaths,
     const FSEventStreamEventFlags eventFlags[],
@@ -124,7 +132,7 @@ void Server::handleEvents(
 
     try {
         for (size_t i = 0; i < numEvents; i++) {
-            handleEvent(env, eventPaths[i], eventFlags[i], eventIds[i]);
+            handleEvent(env, root, eventPaths[i], eventFlags[i], eventIds[i]);
         }
     } catch (const exception& ex) {
         reportFailure(env, ex);
@@ -161,7 +169,7 @@ static const FSEventStreamEventFlags IGNORED_FLAGS = kFSEventStreamCreateFlagNon
     | kFSEventStreamEventFlagItemIsLastHardlink
     | kFSEventStreamEventFlagItemCloned;
 
-void Server::handleEvent(JNIEnv* env, char* path, FSEventStreamEventFlags flags, FSEventStreamEventId eventId) {
+void Server::handleEvent(JNIEnv* env, const u16string& root, char* path, FSEventStreamEventFlags flags, FSEventStreamEventId eventId) {
     logToJava(LogLevel::FINE, "Event flags: 0x%x (ID %d) for '%s'", flags, eventId, path);
 
     u16string pathStr = utf8ToUtf16String(path);
@@ -206,7 +214,7 @@ void Server::handleEvent(JNIEnv* env, char* path, FSEventStreamEventFlags flags,
         return;
     }
 
-    reportChangeEvent(env, type, pathStr);
+    reportChangeEvent(env, type, pathStr, root);
 }
 
 void Server::registerPaths(const vector<u16string>& paths) {
@@ -0,0 +1,217 @@
+#ifdef __linux__
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "event_journal.h"
+
+// Average size of records the index is sized for
+#define JOURNAL_AVERAGE_RECORD_SIZE 32
+#define JOURNAL_MIN_DATA_CAPACITY (64 * 1024)
+
+static_assert(sizeof(JournalHeader) == 64, "Journal header layout must match FileEventJournal");
+static_assert(sizeof(JournalRecord) == 16, "Journal record layout must match FileEventJournal");
+
+static uint64_t alignRecordSize(uint64_t size) {
+    return (size + 7) & ~((uint64_t) 7);
+}
+
+/**
+ * The lower half of the next sequence number, which changes with every record written.
+ */
+static uint32_t* nextSequenceFutex(JournalHeader* header) {
+    uint32_t* words = (uint32_t*) &header->nextSequence;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return words + 1;
+#else
+    return words;
+#endif
+}
+
+EventJournal::EventJournal(const string& path, uint64_t dataCapacity)
+    : path(path) {
+    if (dataCapacity < JOURNAL_MIN_DATA_CAPACITY) {
+        dataCapacity = JOURNAL_MIN_DATA_CAPACITY;
+    }
+    dataCapacity = alignRecordSize(dataCapacity);
+    uint64_t indexCapacity = dataCapacity / JOURNAL_AVERAGE_RECORD_SIZE;
+    mappedSize = sizeof(JournalHeader) + indexCapacity * sizeof(uint64_t) + dataCapacity;
+
+    u16string widePath = utf8ToUtf16String(path.c_str());
+    // Continue numbering records of a previous journal, so readers never see a sequence number reused
+    uint64_t nextSequence = 0;
+    int previousFd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (previousFd != -1) {
+        JournalHeader previousHeader;
+        if (pread(previousFd, &previousHeader, sizeof(JournalHeader), 0) == (ssize_t) sizeof(JournalHeader)
+            && previousHeader.magic == JOURNAL_MAGIC
+            && previousHeader.version == JOURNAL_VERSION) {
+            nextSequence = previousHeader.nextSequence.load();
+        }
+        close(previousFd);
+    }
+    // Other processes might still have the previous journal mapped, and truncating it would crash them.
+    // Set up a new file instead, and only replace the previous one once it is ready to be read.
+    // The journal is only readable by the user running the watcher, same as the subscription socket
+    string temporaryPath = path + "." + to_string(getpid()) + ".tmp";
+    struct stat stale;
+    if (lstat(temporaryPath.c_str(), &stale) == 0 && S_ISREG(stale.st_mode) && stale.st_uid == getuid()) {
+        // Left behind by a watcher that crashed while setting up the journal, with the same process ID as us
+        unlink(temporaryPath.c_str());
+    }
+    fd = open(temporaryPath.c_str(), O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        throw FileWatcherException("Couldn't create journal", widePath, errno);
+    }
+    if (ftruncate(fd, (off_t) mappedSize) == -1) {
+        int error = errno;
+        close(fd);
+        unlink(temporaryPath.c_str());
+        throw FileWatcherException("Couldn't resize journal", widePath, error);
+    }
+    void* mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        int error = errno;
+        close(fd);
+        unlink(temporaryPath.c_str());
+        throw FileWatcherException("Couldn't map journal", widePath, error);
+    }
+    header = (JournalHeader*) mapped;
+    index = (uint64_t*) ((uint8_t*) mapped + sizeof(JournalHeader));
+    data = (uint8_t*) (index + indexCapacity);
+
+    header->dataCapacity = dataCapacity;
+    header->indexCapacity = indexCapacity;
+    header->oldestSequence.store(nextSequence);
+    header->nextSequence.store(nextSequence);
+    header->version = JOURNAL_VERSION;
+    header->magic = JOURNAL_MAGIC;
+    if (rename(temporaryPath.c_str(), path.c_str()) == -1) {
+        int error = errno;
+        munmap(mapped, mappedSize);
+        close(fd);
+        unlink(temporaryPath.c_str());
+        throw FileWatcherException("Couldn't replace journal", widePath, error);
+    }
+}
+
+EventJournal::~EventJournal() {
+    // Let waiting readers notice that the watcher is gone
+    recordsAppended = true;
+    notifyReaders();
+    munmap(header, mappedSize);
+    close(fd);
+}
+
+void EventJournal::appendChange(ChangeType type, const u16string& path) {
+    append((uint32_t) type, path);
+}
+
+void EventJournal::appendOverflow(const u16string& path) {
+    append(JOURNAL_RECORD_OVERFLOW, path);
+}
+
+uint64_t EventJournal::getNextSequence() const {
+    return header->nextSequence.load();
+}
+
+void EventJournal::append(uint32_t type, const u16string& path) {
+    string pathBytes = utf16ToUtf8String(path);
+    uint64_t size = alignRecordSize(sizeof(JournalRecord) + pathBytes.size());
+    if (size > header->dataCapacity) {
+        logToJava(LogLevel::WARNING, "Path too long for journal: %s", pathBytes.c_str());
+        return;
+    }
+
+    uint64_t sequence = header->nextSequence.load(memory_order_relaxed);
+    uint64_t offset = writeOffset;
+    if (offset + size > header->dataCapacity) {
+        // Records don't wrap around, the rest of the data area stays unused this time around.
+        // Drop the records still stored there before the space at the start is reused.
+        while (header->oldestSequence.load(memory_order_relaxed) < sequence
+            && index[header->oldestSequence.load(memory_order_relaxed) % header->indexCapacity] >= offset) {
+            evictOldest();
+        }
+        offset = 0;
+    }
+    while (header->oldestSequence.load(memory_order_relaxed) < sequence) {
+        uint64_t oldest = header->oldestSequence.load(memory_order_relaxed);
+        uint64_t oldestOffset = index[oldest % header->indexCapacity];
+        bool overlaps = oldestOffset < offset + size && offset < oldestOffset + recordSize(oldestOffset);
+        bool indexFull = sequence - oldest >= header->indexCapacity;
+        if (!overlaps && !indexFull) {
+            break;
+        }
+        evictOldest();
+    }
+
+    JournalRecord* record = (JournalRecord*) (data + offset);
+    record->sequence = sequence;
+    record->pathLength = (uint32_t) pathBytes.size();
+    record->type = type;
+    memcpy(data + offset + sizeof(JournalRecord), pathBytes.data(), pathBytes.size());
+    index[sequence % header->indexCapacity] = offset;
+    writeOffset = offset + size;
+    // Readers only look at the record after they see the new sequence number
+    header->nextSequence.store(sequence + 1, memory_order_release);
+    recordsAppended = true;
+}
+
+void EventJournal::evictOldest() {
+    // Readers check the oldest sequence again after reading a record, so they notice when it has been overwritten
+    header->oldestSequence.fetch_add(1, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+void EventJournal::notifyReaders() {
+    if (!recordsAppended) {
+        return;
+    }
+    recordsAppended = false;
+    syscall(SYS_futex, nextSequenceFutex(header), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+uint64_t EventJournal::recordSize(uint64_t offset) const {
+    const JournalRecord* record = (const JournalRecord*) (data + offset);
+    return alignRecordSize(sizeof(JournalRecord) + record->pathLength);
+}
+
+JNIEXPORT jlong JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_FileEventJournalFunctions_getOldestSequence0(JNIEnv* env, jclass, jobject javaJournal) {
+    JournalHeader* header = (JournalHeader*) env->GetDirectBufferAddress(javaJournal);
+    // Reading the records must be finished before checking whether they have been overwritten in the meantime
+    atomic_thread_fence(memory_order_acquire);
+    return (jlong) header->oldestSequence.load(memory_order_acquire);
+}
+
+JNIEXPORT jlong JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_FileEventJournalFunctions_getNextSequence0(JNIEnv* env, jclass, jobject javaJournal) {
+    JournalHeader* header = (JournalHeader*) env->GetDirectBufferAddress(javaJournal);
+    // Records before the next sequence number are visible once it has been read
+    return (jlong) header->nextSequence.load(memory_order_acquire);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_FileEventJournalFunctions_awaitRecords0(JNIEnv* env, jclass, jobject javaJournal, jlong fromSequence, jlong timeoutInMillis) {
+    JournalHeader* header = (JournalHeader*) env->GetDirectBufferAddress(javaJournal);
+    uint64_t nextSequence = header->nextSequence.load(memory_order_acquire);
+    if (nextSequence <= (uint64_t) fromSequence) {
+        struct timespec timeout;
+        timeout.tv_sec = (time_t) (timeoutInMillis / 1000);
+        timeout.tv_nsec = (long) (timeoutInMillis % 1000) * 1000000;
+        // Returns right away if a record has been written since the sequence number was read,
+        // otherwise the writer wakes us up after writing the next batch of records
+        syscall(SYS_futex, nextSequenceFutex(header), FUTEX_WAIT, (uint32_t) nextSequence, &timeout, nullptr, 0);
+        nextSequence = header->nextSequence.load(memory_order_acquire);
+    }
+    return nextSequence > (uint64_t) fromSequence;
+}
+
+#endif
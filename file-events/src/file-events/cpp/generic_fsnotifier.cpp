@@ -10,38 +10,261 @@ InsufficientResourcesFileWatcherException::InsufficientResourcesFileWatcherExcep
     : FileWatcherException(message) {
 }
 
+Route::Route(const u16string& prefix, jint eventQueueCapacity)
+    : prefix(prefix)
+    , eventQueueCapacity(eventQueueCapacity) {
+}
+
 AbstractServer::AbstractServer(JNIEnv* env, jobject watcherCallback)
     : JniSupport(env)
     , watcherCallback(env, watcherCallback) {
+    // Start counting generations at an arbitrary point, so tokens from other watchers don't match
+    this->generation = (uint64_t) chrono::system_clock::now().time_since_epoch().count();
     jclass callbackClass = env->GetObjectClass(watcherCallback);
-    this->watcherReportChangeEventMethod = env->GetMethodID(callbackClass, "reportChangeEvent", "(ILjava/lang/String;)V");
-    this->watcherReportUnknownEventMethod = env->GetMethodID(callbackClass, "reportUnknownEvent", "(Ljava/lang/String;)V");
-    this->watcherReportOverflowMethod = env->GetMethodID(callbackClass, "reportOverflow", "(Ljava/lang/String;)V");
+    this->watcherReportChangeEventMethod = env->GetMethodID(callbackClass, "reportChangeEvent", "(ILjava/lang/String;I)I");
+    this->watcherReportDetailedChangeEventMethod = env->GetMethodID(callbackClass, "reportChangeEvent", "(ILjava/lang/String;IZIJJJ)I");
+    this->watcherReportUnknownEventMethod = env->GetMethodID(callbackClass, "reportUnknownEvent", "(Ljava/lang/String;I)V");
+    this->watcherReportOverflowMethod = env->GetMethodID(callbackClass, "reportOverflow", "(Ljava/lang/String;I)V");
     this->watcherReportFailureMethod = env->GetMethodID(callbackClass, "reportFailure", "(Ljava/lang/Throwable;)V");
+    this->watcherReportSettledMethod = env->GetMethodID(callbackClass, "reportSettled", "(Ljava/lang/String;I)V");
+    this->watcherReportMovedMethod = env->GetMethodID(callbackClass, "reportMoved", "(Ljava/lang/String;Ljava/lang/String;I)V");
     this->watcherReportTerminationMethod = env->GetMethodID(callbackClass, "reportTermination", "()V");
+    this->watcherGetRemainingEventQueueCapacityMethod = env->GetMethodID(callbackClass, "getRemainingEventQueueCapacity", "(I)I");
+    jmethodID getRoutePrefixesMethod = env->GetMethodID(callbackClass, "getRoutePrefixes", "()[Ljava/lang/String;");
+    jmethodID getEventQueueCapacityMethod = env->GetMethodID(callbackClass, "getEventQueueCapacity", "(I)I");
+    jobjectArray javaPrefixes = (jobjectArray) env->CallObjectMethod(watcherCallback, getRoutePrefixesMethod);
+    rethrowJavaException(env);
+    // The default route comes first, the prefixes are for the additional routes
+    vector<u16string> prefixes;
+    prefixes.emplace_back();
+    javaToUtf16StringArray(env, javaPrefixes, prefixes);
+    env->DeleteLocalRef(javaPrefixes);
+    routes.reserve(prefixes.size());
+    for (size_t index = 0; index < prefixes.size(); index++) {
+        jint eventQueueCapacity = env->CallIntMethod(watcherCallback, getEventQueueCapacityMethod, (jint) index);
+        rethrowJavaException(env);
+        routes.emplace_back(prefixes[index], eventQueueCapacity);
+    }
 }
 
 AbstractServer::~AbstractServer() {
 }
 
-void AbstractServer::reportChangeEvent(JNIEnv* env, ChangeType type, const u16string& path) {
+bool AbstractServer::awaitPendingEvents(long) {
+    throw FileWatcherException("Awaiting pending events is not supported on this platform");
+}
+
+void AbstractServer::reportChangeEvent(JNIEnv* env, ChangeType type, const u16string& path, const u16string& root, const ChangeDetails* details) {
+    recordChange(path, root);
+    jint routeIndex = routeFor(root);
+    Route& route = routes[routeIndex];
+    if (route.reportingMode != ReportingMode::PER_PATH) {
+        // The reporting mode is only updated when something is delivered, and while paths are invalidated
+        // nothing might be delivered anymore, so check whether the consumer has caught up in the meantime
+        jint remainingQueueCapacity = env->CallIntMethod(watcherCallback.get(), watcherGetRemainingEventQueueCapacityMethod, routeIndex);
+        if (getJavaExceptionAndPrintStacktrace(env) == nullptr) {
+            updateReportingMode(route, remainingQueueCapacity);
+        }
+    }
+    switch (route.reportingMode) {
+        case ReportingMode::PER_PATH:
+            deliverChangeEvent(env, route, routeIndex, type, path, details);
+            break;
+        case ReportingMode::PER_DIRECTORY: {
+            size_t separator = path.find_last_of(u"/\\");
+            if (path == root || separator == u16string::npos) {
+                reportInvalidated(env, route, routeIndex, root);
+            } else {
+                reportInvalidated(env, route, routeIndex, path.substr(0, separator));
+            }
+            break;
+        }
+        case ReportingMode::PER_ROOT: {
+            // Don't widen the invalidation beyond the paths routed to this event queue
+            u16string invalidationRoot = invalidationRootFor(root);
+            if (invalidationRoot != root && routeFor(invalidationRoot) != routeIndex) {
+                invalidationRoot = root;
+            }
+            reportInvalidated(env, route, routeIndex, invalidationRoot);
+            break;
+        }
+    }
+}
+
+u16string AbstractServer::invalidationRootFor(const u16string& root) {
+    return root;
+}
+
+static bool isInvalidated(const Route& route, const u16string& path) {
+    u16string current = path;
+    while (true) {
+        if (route.invalidatedPaths.find(current) != route.invalidatedPaths.end()) {
+            return true;
+        }
+        size_t separator = current.find_last_of(u"/\\");
+        if (separator == u16string::npos || separator == 0) {
+            return false;
+        }
+        current.resize(separator);
+    }
+}
+
+void AbstractServer::reportInvalidated(JNIEnv* env, Route& route, jint routeIndex, const u16string& path) {
+    // No need to report the same path twice while the queue is under pressure,
+    // nor a path under a directory that has already been reported as invalidated
+    if (isInvalidated(route, path)) {
+        return;
+    }
+    route.invalidatedPaths.insert(path);
+    deliverChangeEvent(env, route, routeIndex, ChangeType::INVALIDATED, path);
+}
+
+void AbstractServer::deliverChangeEvent(JNIEnv* env, Route& route, jint routeIndex, ChangeType type, const u16string& path, const ChangeDetails* details) {
     jstring javaPath = env->NewString((jchar*) path.c_str(), (jsize) path.length());
-    env->CallVoidMethod(watcherCallback.get(), watcherReportChangeEventMethod, type, javaPath);
+    jint remainingQueueCapacity;
+    if (details == nullptr) {
+        remainingQueueCapacity = env->CallIntMethod(watcherCallback.get(), watcherReportChangeEventMethod, type, javaPath, routeIndex);
+    } else {
+        // A negative file type signals that no metadata has been collected
+        jint fileType = details->hasMetadata
+            ? (jint) details->fileType
+            : -1;
+        remainingQueueCapacity = env->CallIntMethod(watcherCallback.get(), watcherReportDetailedChangeEventMethod, type, javaPath, routeIndex,
+            (jboolean) details->directory, fileType, (jlong) details->size, (jlong) details->lastModified, (jlong) details->inode);
+    }
     env->DeleteLocalRef(javaPath);
-    getJavaExceptionAndPrintStacktrace(env);
+    if (getJavaExceptionAndPrintStacktrace(env) == nullptr) {
+        updateReportingMode(route, remainingQueueCapacity);
+    }
+}
+
+void AbstractServer::updateReportingMode(Route& route, jint remainingQueueCapacity) {
+    ReportingMode mode;
+    if (remainingQueueCapacity < route.eventQueueCapacity / ROOT_INVALIDATION_THRESHOLD_DIVISOR) {
+        mode = ReportingMode::PER_ROOT;
+    } else if (remainingQueueCapacity < route.eventQueueCapacity / DIRECTORY_INVALIDATION_THRESHOLD_DIVISOR) {
+        mode = ReportingMode::PER_DIRECTORY;
+    } else {
+        mode = ReportingMode::PER_PATH;
+    }
+    if (mode == route.reportingMode) {
+        return;
+    }
+    logToJava(LogLevel::FINE, "Switching reporting mode for '%s' from %d to %d (remaining queue capacity: %d of %d)",
+        utf16ToUtf8String(route.prefix).c_str(), route.reportingMode, mode, remainingQueueCapacity, route.eventQueueCapacity);
+    if (mode == ReportingMode::PER_PATH) {
+        // The consumer has caught up, anything new needs to be reported precisely again
+        route.invalidatedPaths.clear();
+    }
+    route.reportingMode = mode;
+}
+
+static bool isUnderPrefix(const u16string& path, const u16string& prefix) {
+    if (path.compare(0, prefix.length(), prefix) != 0) {
+        return false;
+    }
+    if (path.length() == prefix.length()) {
+        return true;
+    }
+    char16_t next = path[prefix.length()];
+    char16_t last = prefix.back();
+    return next == u'/' || next == u'\\' || last == u'/' || last == u'\\';
+}
+
+static jint findRoute(const vector<Route>& routes, const u16string& path) {
+    // The longest matching prefix wins, anything else goes to the default route
+    jint bestRoute = 0;
+    size_t bestLength = 0;
+    for (size_t index = 1; index < routes.size(); index++) {
+        const u16string& prefix = routes[index].prefix;
+        if (prefix.length() > bestLength && isUnderPrefix(path, prefix)) {
+            bestRoute = (jint) index;
+            bestLength = prefix.length();
+        }
+    }
+    return bestRoute;
+}
+
+jint AbstractServer::routeFor(const u16string& root) {
+    if (routes.size() == 1) {
+        return 0;
+    }
+    auto it = routesByRoot.find(root);
+    if (it != routesByRoot.end()) {
+        return it->second;
+    }
+    jint routeIndex = findRoute(routes, root);
+    routesByRoot.emplace(root, routeIndex);
+    return routeIndex;
 }
 
 void AbstractServer::reportUnknownEvent(JNIEnv* env, const u16string& path) {
     jstring javaPath = env->NewString((jchar*) path.c_str(), (jsize) path.length());
-    env->CallVoidMethod(watcherCallback.get(), watcherReportUnknownEventMethod, javaPath);
+    env->CallVoidMethod(watcherCallback.get(), watcherReportUnknownEventMethod, javaPath, findRoute(routes, path));
     env->DeleteLocalRef(javaPath);
     getJavaExceptionAndPrintStacktrace(env);
 }
 
+/**
+ * Gives up tracking the changes when the root would be one root too many. Called with the change set lock held.
+ */
+bool AbstractServer::changeSetOverflowedBy(const u16string& root) {
+    if (changeSetOverflowed) {
+        return true;
+    }
+    if (changedPathsByRoot.find(root) != changedPathsByRoot.end() || overflowedRoots.find(root) != overflowedRoots.end()
+        || changedPathsByRoot.size() + overflowedRoots.size() < CHANGE_SET_MAX_ROOTS) {
+        return false;
+    }
+    changeSetOverflowed = true;
+    changedPathsByRoot.clear();
+    overflowedRoots.clear();
+    return true;
+}
+
+void AbstractServer::recordChange(const u16string& path, const u16string& root) {
+    unique_lock<mutex> lock(changeSetMutex);
+    if (!trackingChanges || changeSetOverflowedBy(root) || overflowedRoots.find(root) != overflowedRoots.end()) {
+        return;
+    }
+    auto& changedPaths = changedPathsByRoot[root];
+    changedPaths.insert(path);
+    if (changedPaths.size() > CHANGE_SET_MAX_PATHS_PER_ROOT) {
+        changedPathsByRoot.erase(root);
+        overflowedRoots.insert(root);
+    }
+}
+
+void AbstractServer::recordOverflow(const u16string& root) {
+    unique_lock<mutex> lock(changeSetMutex);
+    if (trackingChanges && !changeSetOverflowedBy(root)) {
+        changedPathsByRoot.erase(root);
+        overflowedRoots.insert(root);
+    }
+}
+
+bool AbstractServer::changesSince(uint64_t token, uint64_t& newToken, vector<u16string>& changedPaths, vector<u16string>& rescanRoots) {
+    unique_lock<mutex> lock(changeSetMutex);
+    bool known = trackingChanges && token == generation && !changeSetOverflowed;
+    if (known) {
+        for (auto& it : changedPathsByRoot) {
+            changedPaths.insert(changedPaths.end(), it.second.begin(), it.second.end());
+        }
+        rescanRoots.insert(rescanRoots.end(), overflowedRoots.begin(), overflowedRoots.end());
+    }
+    trackingChanges = true;
+    changedPathsByRoot.clear();
+    overflowedRoots.clear();
+    changeSetOverflowed = false;
+    newToken = ++generation;
+    return known;
+}
+
 void AbstractServer::reportOverflow(JNIEnv* env, const u16string& path) {
+    recordOverflow(path);
     logToJava(LogLevel::INFO, "Detected overflow for %s", utf16ToUtf8String(path).c_str());
     jstring javaPath = env->NewString((jchar*) path.c_str(), (jsize) path.length());
-    env->CallVoidMethod(watcherCallback.get(), watcherReportOverflowMethod, javaPath);
+    env->CallVoidMethod(watcherCallback.get(), watcherReportOverflowMethod, javaPath, findRoute(routes, path));
     env->DeleteLocalRef(javaPath);
     getJavaExceptionAndPrintStacktrace(env);
 }
@@ -57,6 +280,24 @@ void AbstractServer::reportFailure(JNIEnv* env, const exception& exception) {
     getJavaExceptionAndPrintStacktrace(env);
 }
 
+void AbstractServer::reportSettled(JNIEnv* env, const u16string& path) {
+    jstring javaPath = env->NewString((jchar*) path.c_str(), (jsize) path.length());
+    env->CallVoidMethod(watcherCallback.get(), watcherReportSettledMethod, javaPath, routeFor(path));
+    env->DeleteLocalRef(javaPath);
+    getJavaExceptionAndPrintStacktrace(env);
+}
+
+void AbstractServer::reportMoved(JNIEnv* env, const u16string& fromPath, const u16string& fromRoot, const u16string& toPath, const u16string& toRoot) {
+    recordChange(fromPath, fromRoot);
+    recordChange(toPath, toRoot);
+    jstring javaFromPath = env->NewString((jchar*) fromPath.c_str(), (jsize) fromPath.length());
+    jstring javaToPath = env->NewString((jchar*) toPath.c_str(), (jsize) toPath.length());
+    env->CallVoidMethod(watcherCallback.get(), watcherReportMovedMethod, javaFromPath, javaToPath, findRoute(routes, toPath));
+    env->DeleteLocalRef(javaFromPath);
+    env->DeleteLocalRef(javaToPath);
+    getJavaExceptionAndPrintStacktrace(env);
+}
+
 void AbstractServer::reportTermination(JNIEnv* env) {
     env->CallVoidMethod(watcherCallback.get(), watcherReportTerminationMethod);
     getJavaExceptionAndPrintStacktrace(env);
@@ -87,45 +328,86 @@ jobject wrapServer(JNIEnv* env, AbstractServer* server) {
     return env->NewDirectByteBuffer(server, sizeof(server));
 }
 
-void AbstractServer::executeRunLoop(JNIEnv* env) {
-    try {
-        runLoop();
-    } catch (const exception& ex) {
-        rethrowAsJavaException(env, ex);
+bool AbstractServer::start(long timeoutInMillis) {
+    serverThread = thread(&AbstractServer::executeRunLoop, this);
+    unique_lock<mutex> initializationLock(initializationMutex);
+    bool started = initializationVariable.wait_for(initializationLock, chrono::milliseconds(timeoutInMillis), [this] {
+        return initialized;
+    });
+    if (started && initializationFailure) {
+        initializationLock.unlock();
+        serverThread.join();
+        rethrow_exception(initializationFailure);
     }
+    return started;
+}
+
+void AbstractServer::executeRunLoop() {
+    // The thread is only attached to the JVM once it needs to talk to Java, e.g. to deliver events
+    JniThreadAttacher attacher(jvm, "File watcher server");
+
+    bool initializedSuccessfully;
+    {
+        unique_lock<mutex> initializationLock(initializationMutex);
+        try {
+            initializeRunLoop();
+        } catch (const exception&) {
+            initializationFailure = current_exception();
+        }
+        initializedSuccessfully = !initializationFailure;
+        initialized = true;
+        initializationVariable.notify_all();
+    }
+
+    if (initializedSuccessfully) {
+        try {
+            runLoop();
+            if (!shutdownRequested) {
+                throw FileWatcherException("File watcher server did exit without being shutdown");
+            }
+        } catch (const exception& ex) {
+            reportFailure(getThreadEnv(), ex);
+        }
+    }
+
     unique_lock<mutex> terminationLock(terminationMutex);
     terminated = true;
-    reportTermination(env);
+    if (initializedSuccessfully) {
+        reportTermination(getThreadEnv());
+    }
     terminationVariable.notify_all();
 }
 
-bool AbstractServer::awaitTermination(long timeoutInMillis) {
-    unique_lock<mutex> terminationLock(terminationMutex);
-    if (terminated) {
-        return true;
-    }
-    auto status = terminationVariable.wait_for(terminationLock, chrono::milliseconds(timeoutInMillis));
-    bool success = status != cv_status::timeout;
-    return success;
+void AbstractServer::shutdown() {
+    shutdownRequested = true;
+    shutdownRunLoop();
 }
 
-JNIEXPORT void JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_00024NativeFileWatcher_initializeRunLoop0(JNIEnv* env, jobject, jobject javaServer) {
-    try {
-        AbstractServer* server = getServer(env, javaServer);
-        server->initializeRunLoop();
-    } catch (const exception& e) {
-        rethrowAsJavaException(env, e);
+bool AbstractServer::awaitTermination(long timeoutInMillis) {
+    {
+        unique_lock<mutex> terminationLock(terminationMutex);
+        bool success = terminationVariable.wait_for(terminationLock, chrono::milliseconds(timeoutInMillis), [this] {
+            return terminated;
+        });
+        if (!success) {
+            return false;
+        }
+    }
+    // The thread is finishing up, only detaching from the JVM is left to do
+    if (serverThread.joinable()) {
+        serverThread.join();
     }
+    return true;
 }
 
-JNIEXPORT void JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_00024NativeFileWatcher_executeRunLoop0(JNIEnv* env, jobject, jobject javaServer) {
+JNIEXPORT jboolean JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_00024NativeFileWatcher_start0(JNIEnv* env, jobject, jobject javaServer, jlong timeoutInMillis) {
     try {
         AbstractServer* server = getServer(env, javaServer);
-        server->executeRunLoop(env);
+        return server->start((long) timeoutInMillis);
     } catch (const exception& e) {
         rethrowAsJavaException(env, e);
+        return false;
     }
 }
 
@@ -156,11 +438,54 @@ Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_00024Na
     }
 }
 
+JNIEXPORT jboolean JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_00024NativeFileWatcher_awaitPendingEvents0(JNIEnv* env, jobject, jobject javaServer, jlong timeoutInMillis) {
+    try {
+        AbstractServer* server = getServer(env, javaServer);
+        return server->awaitPendingEvents((long) timeoutInMillis);
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return false;
+    }
+}
+
+JNIEXPORT jstring JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_00024NativeFileWatcher_changesSince0(JNIEnv* env, jobject, jobject javaServer, jlong token, jlongArray javaNewToken) {
+    try {
+        AbstractServer* server = getServer(env, javaServer);
+        uint64_t newToken;
+        vector<u16string> changedPaths;
+        vector<u16string> rescanRoots;
+        bool known = server->changesSince((uint64_t) token, newToken, changedPaths, rescanRoots);
+        jlong javaToken = (jlong) newToken;
+        env->SetLongArrayRegion(javaNewToken, 0, 1, &javaToken);
+        if (!known) {
+            return NULL;
+        }
+        // Pack everything into a single string to avoid creating a Java object per path
+        u16string packed;
+        for (auto& path : changedPaths) {
+            packed.push_back(u'C');
+            packed.append(path);
+            packed.push_back(u'\0');
+        }
+        for (auto& root : rescanRoots) {
+            packed.push_back(u'R');
+            packed.append(root);
+            packed.push_back(u'\0');
+        }
+        return env->NewString((jchar*) packed.c_str(), (jsize) packed.length());
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return NULL;
+    }
+}
+
 JNIEXPORT void JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_AbstractFileEventFunctions_00024NativeFileWatcher_shutdown0(JNIEnv* env, jobject, jobject javaServer) {
     try {
         AbstractServer* server = getServer(env, javaServer);
-        server->shutdownRunLoop();
+        server->shutdown();
     } catch (const exception& e) {
         rethrowAsJavaException(env, e);
     }
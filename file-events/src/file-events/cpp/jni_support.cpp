@@ -16,6 +16,9 @@ JavaVM* getJavaVm(JNIEnv* env) {
     return jvm;
 }
 
+// Name to attach the current thread with when it first requires a JNI environment, if any
+static thread_local const char* attachOnDemandThreadName = nullptr;
+
 JniSupport::JniSupport(JavaVM* jvm)
     : jvm(jvm) {
 }
@@ -27,12 +30,33 @@ JniSupport::JniSupport(JNIEnv* env)
 JNIEnv* JniSupport::getThreadEnv() {
     JNIEnv* env;
     jint ret = jvm->GetEnv((void**) &env, JNI_VERSION_1_6);
+    if (ret == JNI_EDETACHED && attachOnDemandThreadName != nullptr) {
+        JavaVMAttachArgs args = {
+            JNI_VERSION_1_6,                                // version
+            const_cast<char*>(attachOnDemandThreadName),    // name
+            nullptr                                         // group
+        };
+        ret = jvm->AttachCurrentThreadAsDaemon((void**) &env, (void*) &args);
+    }
     if (ret != JNI_OK) {
         throw runtime_error(string("Failed to get JNI env for current thread: ") + to_string(ret));
     }
     return env;
 }
 
+JniThreadAttacher::JniThreadAttacher(JavaVM* jvm, const char* name)
+    : JniSupport(jvm) {
+    attachOnDemandThreadName = name;
+}
+
+JniThreadAttacher::~JniThreadAttacher() {
+    attachOnDemandThreadName = nullptr;
+    JNIEnv* env;
+    if (jvm->GetEnv((void**) &env, JNI_VERSION_1_6) == JNI_OK) {
+        jvm->DetachCurrentThread();
+    }
+}
+
 jthrowable JniSupport::getJavaExceptionAndPrintStacktrace(JNIEnv* env) {
     jthrowable exception = env->ExceptionOccurred();
     if (exception != nullptr) {
@@ -1,17 +1,32 @@
 #ifdef __linux__
 
+#include <algorithm>
 #include <codecvt>
+#include <cstring>
 #include <dlfcn.h>
+#include <fcntl.h>
 #include <locale>
+#include <stdlib.h>
 #include <string>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "linux_fsnotifier.h"
 
 #define EVENT_BUFFER_SIZE (16 * 1024)
 
-#define EVENT_MASK (IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_EXCL_UNLINK | IN_MODIFY | IN_MOVE_SELF | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+// Subscribers sending longer commands are disconnected
+#define MAX_SUBSCRIBER_COMMAND_LENGTH (64 * 1024)
+
+#define SENTINEL_EVENT_MASK (IN_CREATE | IN_ONLYDIR)
+
+// Events about the watched directory itself are needed regardless of the requested event kinds
+#define BASE_EVENT_MASK (IN_DELETE_SELF | IN_EXCL_UNLINK | IN_MOVE_SELF | IN_ONLYDIR)
+#define STRUCTURE_EVENT_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+#define CONTENT_EVENT_MASK (IN_MODIFY)
+// Changes to the modification time without a change to the contents, only interesting for the metadata we keep
+#define METADATA_EVENT_MASK (IN_ATTRIB)
 
 InotifyInstanceLimitTooLowException::InotifyInstanceLimitTooLowException()
     : InsufficientResourcesFileWatcherException("Inotify instance limit too low") {
@@ -21,11 +36,12 @@ InotifyWatchesLimitTooLowException::InotifyWatchesLimitTooLowException()
     : InsufficientResourcesFileWatcherException("Inotify watches limit too low") {
 }
 
-WatchPoint::WatchPoint(const u16string& path, shared_ptr<Inotify> inotify, int watchDescriptor)
+WatchPoint::WatchPoint(const u16string& path, shared_ptr<Inotify> inotify, int watchDescriptor, uint32_t eventMask)
     : status(WatchPointStatus::LISTENING)
     , watchDescriptor(watchDescriptor)
     , inotify(inotify)
-    , path(path) {
+    , path(path)
+    , eventMask(eventMask) {
 }
 
 CancelResult WatchPoint::cancel() {
@@ -60,6 +76,24 @@ Inotify::~Inotify() {
     close(fd);
 }
 
+DirectoryHandle::DirectoryHandle(int fd)
+    : fd(fd) {
+}
+
+DirectoryHandle::~DirectoryHandle() {
+    close(fd);
+}
+
+static shared_ptr<DirectoryHandle> openDirectoryHandle(const u16string& path) {
+    int fd = open(utf16ToUtf8String(path).c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        // Most likely out of file descriptors, entries are then looked up via their full path
+        logToJava(LogLevel::FINE, "Couldn't open %s to look up entries relative to it, errno = %d", utf16ToUtf8String(path).c_str(), errno);
+        return nullptr;
+    }
+    return make_shared<DirectoryHandle>(fd);
+}
+
 ShutdownEvent::ShutdownEvent()
     : fd(eventfd(0, 0)) {
     if (fd == -1) {
@@ -83,10 +117,148 @@ void ShutdownEvent::consume() const {
     }
 }
 
-Server::Server(JNIEnv* env, jobject watcherCallback)
+SettledTimer::SettledTimer()
+    : fd(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) {
+    if (fd == -1) {
+        throw FileWatcherException("Couldn't create timer", errno);
+    }
+}
+
+SettledTimer::~SettledTimer() {
+    close(fd);
+}
+
+void SettledTimer::schedule(chrono::steady_clock::time_point deadline) const {
+    // The steady clock is based on CLOCK_MONOTONIC on Linux
+    long long deadlineInNanos = chrono::duration_cast<chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    struct itimerspec timerSpec = {};
+    timerSpec.it_value.tv_sec = deadlineInNanos / 1000000000;
+    timerSpec.it_value.tv_nsec = deadlineInNanos % 1000000000;
+    if (timerfd_settime(fd, TFD_TIMER_ABSTIME, &timerSpec, nullptr) == -1) {
+        throw FileWatcherException("Couldn't schedule timer", errno);
+    }
+}
+
+void SettledTimer::consume() const {
+    uint64_t expirations;
+    ssize_t bytesRead = read(fd, &expirations, sizeof(expirations));
+    if (bytesRead == -1 && errno != EAGAIN) {
+        throw FileWatcherException("Couldn't read from timer", errno);
+    }
+}
+
+static void splitPath(const u16string& path, u16string& parent, u16string& name) {
+    size_t separator = path.find_last_of(u'/');
+    parent = separator == 0
+        ? u"/"
+        : path.substr(0, separator);
+    name = path.substr(separator + 1);
+}
+
+static sockaddr_un socketAddress(const string& path) {
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.length() >= sizeof(address.sun_path)) {
+        throw FileWatcherException("Socket path too long", utf8ToUtf16String(path.c_str()));
+    }
+    memcpy(address.sun_path, path.c_str(), path.length());
+    return address;
+}
+
+static bool isListening(const sockaddr_un& address) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return false;
+    }
+    bool listening = connect(fd, (const struct sockaddr*) &address, sizeof(address)) == 0;
+    close(fd);
+    return listening;
+}
+
+static bool sendLine(int fd, const string& line) {
+    string data = line + "\n";
+    // Replies are short, if they don't fit into the socket buffer the subscriber isn't reading them anyway
+    return send(fd, data.c_str(), data.length(), MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t) data.length();
+}
+
+SubscriptionSocket::SubscriptionSocket(const string& path)
+    : path(path)
+    , fd(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) {
+    if (fd == -1) {
+        throw FileWatcherException("Couldn't create subscription socket", errno);
+    }
+    try {
+        struct sockaddr_un address = socketAddress(path);
+        // Replace the socket left behind by a watcher that didn't shut down properly, but nothing else
+        struct stat existing;
+        if (lstat(path.c_str(), &existing) == 0) {
+            if (!S_ISSOCK(existing.st_mode) || existing.st_uid != getuid()) {
+                throw FileWatcherException("Couldn't replace file at subscription socket path", utf8ToUtf16String(path.c_str()));
+            }
+            if (isListening(address)) {
+                throw FileWatcherException("Another watcher is listening on subscription socket", utf8ToUtf16String(path.c_str()));
+            }
+            unlink(path.c_str());
+        }
+        // Subscribers are checked when they connect, too, as other users can connect before the mode is changed
+        if (::bind(fd, (struct sockaddr*) &address, sizeof(address)) == -1
+            || chmod(path.c_str(), S_IRUSR | S_IWUSR) == -1
+            || listen(fd, SOMAXCONN) == -1) {
+            throw FileWatcherException("Couldn't listen on subscription socket", utf8ToUtf16String(path.c_str()), errno);
+        }
+    } catch (const exception&) {
+        close(fd);
+        throw;
+    }
+}
+
+SubscriptionSocket::~SubscriptionSocket() {
+    close(fd);
+    unlink(path.c_str());
+}
+
+Subscriber::Subscriber(int fd)
+    : fd(fd) {
+}
+
+Subscriber::~Subscriber() {
+    close(fd);
+}
+
+Server::Server(JNIEnv* env, jobject watcherCallback, bool trackTreeHashes, bool mirrorWatchedTrees, bool collectChangeMetadata, bool reportCanonicalPathsOnly, bool reportMoves, long settledQuietPeriodInMillis, const string& journalPath, long journalCapacity, const string& subscriptionSocketPath)
     : AbstractServer(env, watcherCallback)
-    , inotify(new Inotify()) {
+    , inotify(new Inotify())
+    , collectChangeMetadata(collectChangeMetadata)
+    , reportCanonicalPathsOnly(reportCanonicalPathsOnly)
+    , reportMoves(reportMoves)
+    , settledQuietPeriod(settledQuietPeriodInMillis) {
     buffer.reserve(EVENT_BUFFER_SIZE);
+    if (trackTreeHashes) {
+        merkleTree.reset(new MerkleTree());
+    }
+    if (mirrorWatchedTrees) {
+        mirror.reset(new TreeMirror());
+    }
+    if (settledQuietPeriodInMillis > 0) {
+        settledTimer.reset(new SettledTimer());
+    }
+    if (!subscriptionSocketPath.empty()) {
+        if (journalPath.empty()) {
+            throw FileWatcherException("Subscriptions require a journal");
+        }
+        // Before the journal, so the journal of another watcher already listening on the socket is left alone
+        subscriptionSocket.reset(new SubscriptionSocket(subscriptionSocketPath));
+    }
+    if (!journalPath.empty()) {
+        journal.reset(new EventJournal(journalPath, (uint64_t) journalCapacity));
+    }
+}
+
+Server::~Server() {
+    if (!sentinelDirectory.empty()) {
+        // The watch is removed together with the directory
+        rmdir(sentinelDirectory.c_str());
+    }
 }
 
 void Server::initializeRunLoop() {
@@ -103,18 +275,28 @@ void Server::runLoop() {
         processQueues(forever);
     }
 
+    // Nobody is going to deliver the events anymore
+    releaseSentinelWaiters();
+
     // No need to clean up watch points, they will be cancelled
     // and closed when the Inotify destructs
 }
 
 void Server::processQueues(int timeout) {
-    struct pollfd fds[2];
-    fds[0].fd = shutdownEvent.fd;
-    fds[1].fd = inotify->fd;
-    fds[0].events = POLLIN;
-    fds[1].events = POLLIN;
+    vector<struct pollfd> fds;
+    fds.push_back({ shutdownEvent.fd, POLLIN, 0 });
+    fds.push_back({ inotify->fd, POLLIN, 0 });
+    if (settledTimer) {
+        fds.push_back({ settledTimer->fd, POLLIN, 0 });
+    }
+    if (subscriptionSocket) {
+        fds.push_back({ subscriptionSocket->fd, POLLIN, 0 });
+        for (auto& it : subscribers) {
+            fds.push_back({ it.first, POLLIN, 0 });
+        }
+    }
 
-    int ret = poll(fds, 2, timeout);
+    int ret = poll(&fds[0], fds.size(), timeout);
     if (ret == -1) {
         throw FileWatcherException("Couldn't poll for events", errno);
     }
@@ -132,7 +314,304 @@ void Server::processQueues(int timeout) {
         } catch (const exception& ex) {
             reportFailure(getThreadEnv(), ex);
         }
+        if (journal) {
+            // Wake up waiting readers once per batch of events instead of for every record
+            unique_lock<recursive_mutex> lock(mutationMutex);
+            journal->notifyReaders();
+        }
+    }
+
+    size_t index = 2;
+    if (settledTimer) {
+        if (IS_SET(fds[index].revents, POLLIN)) {
+            try {
+                handleSettledTimer();
+            } catch (const exception& ex) {
+                reportFailure(getThreadEnv(), ex);
+            }
+        }
+        index++;
+    }
+
+    if (subscriptionSocket) {
+        try {
+            if (IS_SET(fds[index].revents, POLLIN)) {
+                acceptSubscriber();
+            }
+            for (index++; index < fds.size(); index++) {
+                if (fds[index].revents == 0) {
+                    continue;
+                }
+                auto it = subscribers.find(fds[index].fd);
+                if (it != subscribers.end() && !handleSubscriberInput(*it->second)) {
+                    disconnectSubscriber(fds[index].fd);
+                }
+            }
+        } catch (const exception& ex) {
+            reportFailure(getThreadEnv(), ex);
+        }
+    }
+}
+
+void Server::acceptSubscriber() {
+    int fd = accept4(subscriptionSocket->fd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd == -1) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED) {
+            return;
+        }
+        throw FileWatcherException("Couldn't accept subscriber", errno);
+    }
+    struct ucred credentials;
+    socklen_t credentialsLength = sizeof(credentials);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &credentialsLength) == -1 || credentials.uid != getuid()) {
+        logToJava(LogLevel::WARNING, "Rejected subscriber owned by another user (fd = %d)", fd);
+        close(fd);
+        return;
+    }
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    subscribers.emplace(fd, unique_ptr<Subscriber>(new Subscriber(fd)));
+    logToJava(LogLevel::FINE, "Accepted subscriber (fd = %d)", fd);
+    if (!sendLine(fd, "JOURNAL " + journal->path)) {
+        disconnectSubscriber(fd);
+    }
+}
+
+bool Server::handleSubscriberInput(Subscriber& subscriber) {
+    char chunk[4096];
+    while (true) {
+        ssize_t bytesRead = recv(subscriber.fd, chunk, sizeof(chunk), 0);
+        if (bytesRead == 0) {
+            return false;
+        }
+        if (bytesRead == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            logToJava(LogLevel::FINE, "Couldn't read from subscriber (fd = %d, errno = %d)", subscriber.fd, errno);
+            return false;
+        }
+        subscriber.pendingInput.append(chunk, bytesRead);
+    }
+    size_t lineEnd;
+    while ((lineEnd = subscriber.pendingInput.find('\n')) != string::npos) {
+        string command = subscriber.pendingInput.substr(0, lineEnd);
+        subscriber.pendingInput.erase(0, lineEnd + 1);
+        if (!handleSubscriberCommand(subscriber, command)) {
+            return false;
+        }
+    }
+    return subscriber.pendingInput.length() <= MAX_SUBSCRIBER_COMMAND_LENGTH;
+}
+
+bool Server::handleSubscriberCommand(Subscriber& subscriber, const string& command) {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    string reply = "OK";
+    try {
+        if (command == "SYNC") {
+            // Answered once the sentinel arrives
+            subscriber.pendingSyncs.push_back(createSentinel());
+            return true;
+        } else if (command.compare(0, 6, "WATCH ") == 0) {
+            subscribe(subscriber, utf8ToUtf16String(command.c_str() + 6));
+        } else if (command.compare(0, 8, "UNWATCH ") == 0) {
+            unsubscribe(subscriber, utf8ToUtf16String(command.c_str() + 8));
+        } else {
+            throw FileWatcherException("Unknown command: " + command);
+        }
+    } catch (const JavaExceptionThrownException&) {
+        // Running out of inotify watches is reported as a Java exception, but nobody on this thread would catch it
+        getThreadEnv()->ExceptionClear();
+        reply = "ERROR Inotify watches limit too low";
+    } catch (const exception& ex) {
+        reply = string("ERROR ") + ex.what();
+    }
+    return sendLine(subscriber.fd, reply);
+}
+
+bool Server::isWatchedRoot(const u16string& path) const {
+    if (aliasedWatchPoints.find(path) != aliasedWatchPoints.end()) {
+        return true;
+    }
+    auto it = watchPoints.find(path);
+    if (it != watchPoints.end() && it->second.directoryEventKinds != 0) {
+        return true;
     }
+    u16string parent;
+    u16string name;
+    splitPath(path, parent, name);
+    it = watchPoints.find(parent);
+    return it != watchPoints.end() && it->second.watchedFiles.find(name) != it->second.watchedFiles.end();
+}
+
+void Server::subscribe(Subscriber& subscriber, const u16string& path) {
+    if (subscriber.roots.find(path) != subscriber.roots.end()) {
+        return;
+    }
+    auto it = subscribedRoots.find(path);
+    if (it == subscribedRoots.end()) {
+        if (isWatchedRoot(path)) {
+            requestAllEventKinds(path);
+        } else {
+            registerPath(path, EVENT_KIND_ALL);
+            subscriberOnlyRoots.insert(path);
+        }
+        it = subscribedRoots.emplace(path, 0).first;
+    }
+    it->second++;
+    subscriber.roots.emplace(path, path);
+}
+
+void Server::requestAllEventKinds(const u16string& path) {
+    // Same as when the path had been watched for subscribers first, every kind of change is reported from now on
+    auto iAlias = aliasedWatchPoints.find(path);
+    if (iAlias != aliasedWatchPoints.end()) {
+        auto& watchPoint = watchPoints.at(iAlias->second);
+        watchPoint.aliases[path] = EVENT_KIND_ALL;
+        updateEventMask(watchPoint);
+        return;
+    }
+    auto it = watchPoints.find(path);
+    if (it != watchPoints.end() && it->second.directoryEventKinds != 0) {
+        it->second.directoryEventKinds = EVENT_KIND_ALL;
+        updateEventMask(it->second);
+        return;
+    }
+    u16string parent;
+    u16string name;
+    splitPath(path, parent, name);
+    auto& watchPoint = watchPoints.at(parent);
+    watchPoint.watchedFiles[name] = EVENT_KIND_ALL;
+    updateEventMask(watchPoint);
+}
+
+void Server::unsubscribe(Subscriber& subscriber, const u16string& path) {
+    auto iRoot = subscriber.roots.find(path);
+    if (iRoot == subscriber.roots.end()) {
+        throw FileWatcherException("Path is not watched", path);
+    }
+    // The root might have been moved since the subscriber registered it
+    u16string root = iRoot->second;
+    subscriber.roots.erase(iRoot);
+    auto it = subscribedRoots.find(root);
+    if (--it->second > 0) {
+        return;
+    }
+    subscribedRoots.erase(it);
+    if (subscriberOnlyRoots.erase(root) > 0) {
+        unregisterPath(root);
+    }
+}
+
+void Server::disconnectSubscriber(int fd) {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    auto it = subscribers.find(fd);
+    if (it == subscribers.end()) {
+        return;
+    }
+    auto& subscriber = *it->second;
+    // Copy the roots, unsubscribing removes them
+    vector<u16string> roots;
+    for (auto& root : subscriber.roots) {
+        roots.push_back(root.first);
+    }
+    for (auto& root : roots) {
+        try {
+            unsubscribe(subscriber, root);
+        } catch (const exception& ex) {
+            logToJava(LogLevel::FINE, "Couldn't unsubscribe from %s: %s", utf16ToUtf8String(root).c_str(), ex.what());
+        }
+    }
+    logToJava(LogLevel::FINE, "Disconnected subscriber (fd = %d)", fd);
+    subscribers.erase(it);
+}
+
+void Server::answerSubscriberSyncs() {
+    if (!subscriptionSocket) {
+        return;
+    }
+    uint64_t deliveredSentinel;
+    {
+        unique_lock<mutex> lock(sentinelMutex);
+        deliveredSentinel = lastDeliveredSentinel;
+    }
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    // Every change before the sentinels has been written to the journal by now
+    string reply = "OK " + to_string(journal->getNextSequence());
+    vector<int> disconnected;
+    for (auto& it : subscribers) {
+        auto& pendingSyncs = it.second->pendingSyncs;
+        auto firstUnanswered = find_if(pendingSyncs.begin(), pendingSyncs.end(), [deliveredSentinel](uint64_t sentinel) {
+            return sentinel > deliveredSentinel;
+        });
+        long answered = firstUnanswered - pendingSyncs.begin();
+        pendingSyncs.erase(pendingSyncs.begin(), firstUnanswered);
+        for (long i = 0; i < answered; i++) {
+            if (!sendLine(it.first, reply)) {
+                disconnected.push_back(it.first);
+                break;
+            }
+        }
+    }
+    for (int fd : disconnected) {
+        disconnectSubscriber(fd);
+    }
+}
+
+u16string Server::invalidationRootFor(const u16string& root) {
+    // Nested directories are watched as roots of their own, so invalidate the outermost watched directory containing the root
+    u16string invalidationRoot = root;
+    u16string current = root;
+    while (current.length() > 1 && current.find(u'/') != u16string::npos) {
+        u16string parent;
+        u16string name;
+        splitPath(current, parent, name);
+        auto it = watchPoints.find(parent);
+        if (it != watchPoints.end() && it->second.directoryEventKinds != 0 && isReportedToJava(parent)) {
+            invalidationRoot = parent;
+        }
+        current = parent;
+    }
+    return invalidationRoot;
+}
+
+bool Server::isReportedToJava(const u16string& root) const {
+    return subscriberOnlyRoots.find(root) == subscriberOnlyRoots.end();
+}
+
+void Server::handleSettledTimer() {
+    settledTimer->consume();
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    JNIEnv* env = getThreadEnv();
+    auto now = chrono::steady_clock::now();
+    auto nextDeadline = chrono::steady_clock::time_point::max();
+    for (auto it = lastActivity.begin(); it != lastActivity.end();) {
+        auto deadline = it->second + settledQuietPeriod;
+        if (deadline <= now) {
+            reportSettled(env, it->first);
+            it = lastActivity.erase(it);
+        } else {
+            nextDeadline = min(nextDeadline, deadline);
+            ++it;
+        }
+    }
+    if (!lastActivity.empty()) {
+        settledTimer->schedule(nextDeadline);
+    }
+}
+
+void Server::recordActivity(const u16string& root) {
+    if (!settledTimer) {
+        return;
+    }
+    auto now = chrono::steady_clock::now();
+    // The timer is always scheduled while there are unsettled roots, only the first one needs to schedule it
+    if (lastActivity.empty()) {
+        settledTimer->schedule(now + settledQuietPeriod);
+    }
+    lastActivity[root] = now;
 }
 
 void Server::handleEvents() {
@@ -173,24 +652,69 @@ void Server::handleEvents() {
         }
         available -= bytesRead;
     }
+    if (!deferredMoveEvent.empty()) {
+        // Nothing else has been queued, so the directory has been moved out of the watched directories
+        unique_lock<recursive_mutex> lock(mutationMutex);
+        handleDeferredMoveEvent(getThreadEnv(), true);
+    }
 }
 
-void Server::handleEvent(JNIEnv* env, const inotify_event* event) {
+void Server::handleEvent(JNIEnv* env, const inotify_event* event, bool deferMoves, bool reportToJava) {
     uint32_t mask = event->mask;
     const char* eventName = (event->len == 0)
         ? ""
         : event->name;
     logToJava(LogLevel::FINE, "Event mask: 0x%x for %s (wd = %d, cookie = 0x%x, len = %d)", mask, eventName, event->wd, event->cookie, event->len);
+    // A move is only pending until the next event
+    uint32_t previousMoveCookie = pendingMoveCookie;
+    pendingMoveCookie = 0;
+    if (!deferredMoveEvent.empty() && !(IS_SET(mask, IN_MOVED_TO) && event->cookie == previousMoveCookie)) {
+        // Not the other half of the move, so the directory has been moved out of the watched directories
+        handleDeferredMoveEvent(env, true);
+        pendingMoveCookie = 0;
+    }
     if (IS_SET(mask, IN_UNMOUNT)) {
         return;
     }
 
     // Overflow received, handle gracefully
     if (IS_SET(mask, IN_Q_OVERFLOW)) {
-        for (auto it : watchPoints) {
-            auto path = it.first;
-            reportOverflow(env, path);
+        vector<u16string> roots;
+        for (auto& it : watchPoints) {
+            auto& watchPoint = it.second;
+            if (watchPoint.directoryEventKinds != 0) {
+                roots.push_back(watchPoint.path);
+            }
+            for (auto& file : watchPoint.watchedFiles) {
+                roots.push_back(watchPoint.path + u"/" + file.first);
+            }
+            // Paths the directory has been registered under via symlinks or bind mounts need rescanning, too
+            for (auto& alias : watchPoint.aliases) {
+                roots.push_back(alias.first);
+            }
         }
+        for (auto& root : roots) {
+            if (journal) {
+                journal->appendOverflow(root);
+            }
+            if (isReportedToJava(root)) {
+                reportOverflow(env, root);
+            }
+        }
+        if (merkleTree) {
+            // We don't know what changed, so start over
+            merkleTree->rescan();
+        }
+        if (mirror) {
+            mirror->invalidate();
+        }
+        // Sentinels might have been dropped, but everything is invalidated anyway
+        releaseSentinelWaiters();
+        return;
+    }
+
+    if (event->wd == sentinelWatchDescriptor) {
+        handleSentinelEvent(event);
         return;
     }
 
@@ -214,15 +738,26 @@ void Server::handleEvent(JNIEnv* env, const inotify_event* event) {
         return;
     }
 
-    auto path = iWatchRoot->second;
-    auto& watchPoint = watchPoints.at(path);
+    auto root = iWatchRoot->second;
+    auto path = root;
+    auto& watchPoint = watchPoints.at(root);
 
     if (IS_SET(mask, IN_IGNORED)) {
         // Finished with watch point
         logToJava(LogLevel::FINE, "Finished watching still registered '%s' (wd = %d)",
             utf16ToUtf8String(path).c_str(), event->wd);
         watchRoots.erase(event->wd);
-        watchPoints.erase(path);
+        for (auto& alias : watchPoint.aliases) {
+            aliasedWatchPoints.erase(alias.first);
+        }
+        watchPoints.erase(root);
+        watchPointPaths.erase(root);
+        if (merkleTree) {
+            merkleTree->removeDirectory(root);
+        }
+        if (mirror) {
+            mirror->removeDirectory(root);
+        }
         return;
     }
 
@@ -238,32 +773,399 @@ void Server::handleEvent(JNIEnv* env, const inotify_event* event) {
         return;
     }
 
+    if (IS_SET(mask, IN_MOVE_SELF) && watchPoint.moved) {
+        // We already know where the directory has been moved to
+        watchPoint.moved = false;
+        return;
+    }
+
+    if (IS_SET(mask, IN_ATTRIB)) {
+        // Only requested to keep the metadata of the entries up-to-date, not reported
+        if (event->len != 0) {
+            updateEntry(watchPoint, eventName);
+        }
+        return;
+    }
+
     ChangeType type;
     const u16string name = utf8ToUtf16String(eventName);
+    int aliasEventKinds = 0;
+    for (auto& alias : watchPoint.aliases) {
+        aliasEventKinds |= alias.second;
+    }
+    int directoryEventKinds = reportCanonicalPathsOnly
+        ? watchPoint.directoryEventKinds | aliasEventKinds
+        : watchPoint.directoryEventKinds;
+    int requestedEventKinds = directoryEventKinds;
 
     if (!name.empty()) {
+        auto iFile = watchPoint.watchedFiles.find(name);
+        if (iFile != watchPoint.watchedFiles.end()) {
+            requestedEventKinds |= iFile->second;
+        }
         path.append(u"/");
         path.append(name);
+        if (reportMoves && IS_SET(mask, IN_ISDIR)) {
+            switch (handleMove(env, event, path, root, previousMoveCookie, deferMoves)) {
+                case MoveResult::DEFERRED:
+                    return;
+                case MoveResult::MOVED:
+                    // Only keep the watcher's own state up-to-date, the move has been reported instead
+                    reportToJava = false;
+                    break;
+                case MoveResult::NOT_MOVED:
+                    break;
+            }
+        }
     }
 
+    if ((requestedEventKinds | aliasEventKinds) == 0) {
+        // Not one of the files we are watching in this directory
+        return;
+    }
+
+    // Changes to the watched directory itself are always reported
+    int eventKind = name.empty()
+        ? EVENT_KIND_ALL
+        : EVENT_KIND_STRUCTURE;
     if (IS_SET(mask, IN_CREATE | IN_MOVED_TO)) {
         type = ChangeType::CREATED;
     } else if (IS_SET(mask, IN_DELETE | IN_DELETE_SELF | IN_MOVED_FROM)) {
         type = ChangeType::REMOVED;
     } else if (IS_SET(mask, IN_MODIFY)) {
         type = ChangeType::MODIFIED;
+        eventKind = EVENT_KIND_CONTENT;
     } else {
         logToJava(LogLevel::WARNING, "Unknown event 0x%x for %s", mask, utf16ToUtf8String(path).c_str());
         reportUnknownEvent(env, path);
         return;
     }
 
-    reportChangeEvent(env, type, path);
+    if (!name.empty()) {
+        updateEntry(watchPoint, eventName);
+    }
+
+    if (!IS_SET(requestedEventKinds | aliasEventKinds, eventKind)) {
+        // Only received because of the tree hashes, or for another file sharing the watch
+        return;
+    }
+
+    ChangeDetails details;
+    collectChangeDetails(mask, type, watchPoint, eventName, details);
+    if (IS_SET(requestedEventKinds, eventKind)) {
+        if (!IS_SET(directoryEventKinds, eventKind)) {
+            // Only requested for the file, so only the file itself is invalidated when the event queue is filling up
+            root = path;
+        }
+        deliverChange(env, watchPoint, type, path, root, name, details, reportToJava);
+    }
+    if (reportCanonicalPathsOnly) {
+        return;
+    }
+    // Report the change once for every path the directory has been registered under
+    u16string relativePath = path.substr(watchPoint.path.length());
+    for (auto& alias : watchPoint.aliases) {
+        if (IS_SET(alias.second, eventKind)) {
+            deliverChange(env, watchPoint, type, alias.first + relativePath, alias.first, name, details, reportToJava);
+        }
+    }
+}
+
+void Server::deliverChange(JNIEnv* env, const WatchPoint& watchPoint, ChangeType type, const u16string& path, u16string root, const u16string& name, const ChangeDetails& details, bool reportToJava) {
+    if (journal) {
+        journal->appendChange(type, path);
+    }
+    if (!isReportedToJava(root)) {
+        // Only watched for subscribers, unless the file itself has been registered from Java, too
+        if (root == path || !isReportedToJava(path) || watchPoint.watchedFiles.find(name) == watchPoint.watchedFiles.end()) {
+            return;
+        }
+        root = path;
+    }
+    recordActivity(root);
+    if (reportToJava) {
+        reportChangeEvent(env, type, path, root, &details);
+    }
+}
+
+void Server::collectChangeDetails(uint32_t mask, ChangeType type, const WatchPoint& watchPoint, const char* name, ChangeDetails& details) const {
+    bool isWatchPoint = name[0] == '\0';
+    // Events for the watched directory itself don't carry IN_ISDIR
+    details.directory = isWatchPoint || IS_SET(mask, IN_ISDIR);
+    if (!collectChangeMetadata || type == ChangeType::REMOVED) {
+        return;
+    }
+    struct stat fileInfo;
+    int result;
+    if (watchPoint.directory) {
+        // Don't resolve the whole path again, it might not even lead to the directory anymore
+        result = fstatat(watchPoint.directory->fd, name, &fileInfo, AT_SYMLINK_NOFOLLOW | (isWatchPoint ? AT_EMPTY_PATH : 0));
+    } else {
+        string path = utf16ToUtf8String(watchPoint.path);
+        if (!isWatchPoint) {
+            path.append("/").append(name);
+        }
+        result = fstatat(AT_FDCWD, path.c_str(), &fileInfo, AT_SYMLINK_NOFOLLOW);
+    }
+    if (result != 0) {
+        // Gone again already, the consumer will see the removal next
+        return;
+    }
+    if (S_ISREG(fileInfo.st_mode)) {
+        details.fileType = ChangedFileType::FILE;
+    } else if (S_ISDIR(fileInfo.st_mode)) {
+        details.fileType = ChangedFileType::DIRECTORY;
+    } else if (S_ISLNK(fileInfo.st_mode)) {
+        details.fileType = ChangedFileType::SYMLINK;
+    } else {
+        details.fileType = ChangedFileType::OTHER;
+    }
+    details.hasMetadata = true;
+    details.size = S_ISREG(fileInfo.st_mode) ? fileInfo.st_size : 0;
+    details.lastModified = fileInfo.st_mtim.tv_sec * 1000LL + fileInfo.st_mtim.tv_nsec / 1000000;
+    details.inode = (int64_t) fileInfo.st_ino;
+}
+
+MoveResult Server::handleMove(JNIEnv* env, const inotify_event* event, const u16string& path, const u16string& root, uint32_t previousMoveCookie, bool deferMoves) {
+    if (IS_SET(event->mask, IN_MOVED_FROM)) {
+        pendingMoveCookie = event->cookie;
+        pendingMovePath = path;
+        pendingMoveRoot = root;
+        if (deferMoves && hasWatchPointsUnder(path)) {
+            const uint8_t* eventBytes = (const uint8_t*) event;
+            deferredMoveEvent.assign(eventBytes, eventBytes + sizeof(struct inotify_event) + event->len);
+            return MoveResult::DEFERRED;
+        }
+    } else if (IS_SET(event->mask, IN_MOVED_TO) && previousMoveCookie != 0 && event->cookie == previousMoveCookie) {
+        u16string fromPath = pendingMovePath;
+        u16string fromRoot = pendingMoveRoot;
+        bool canMove = canMoveWatchPoints(fromPath, path);
+        // Directories only watched for subscribers are moved, too, but Java only sees the removal and creation
+        bool reportMove = canMove && isReportedToJava(fromPath);
+        // Handle the removal first, so the state is updated in the order the changes happened
+        handleDeferredMoveEvent(env, !reportMove);
+        pendingMoveCookie = 0;
+        if (canMove) {
+            moveWatchPoints(fromPath, path);
+        }
+        if (reportMove) {
+            reportMoved(env, fromPath, fromRoot, path, root);
+            return MoveResult::MOVED;
+        }
+    }
+    return MoveResult::NOT_MOVED;
+}
+
+void Server::handleDeferredMoveEvent(JNIEnv* env, bool reportToJava) {
+    if (deferredMoveEvent.empty()) {
+        return;
+    }
+    vector<uint8_t> event;
+    event.swap(deferredMoveEvent);
+    handleEvent(env, (const struct inotify_event*) &event[0], false, reportToJava);
+}
+
+static bool isSameOrDescendant(const u16string& path, const u16string& ancestor) {
+    return path.compare(0, ancestor.length(), ancestor) == 0
+        && (path.length() == ancestor.length() || path[ancestor.length()] == u'/');
+}
+
+template <typename T>
+static void movePaths(unordered_map<u16string, T>& values, const u16string& fromPath, const u16string& toPath) {
+    vector<pair<u16string, T>> movedValues;
+    for (auto it = values.begin(); it != values.end();) {
+        if (isSameOrDescendant(it->first, fromPath)) {
+            movedValues.emplace_back(toPath + it->first.substr(fromPath.length()), it->second);
+            it = values.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    values.insert(movedValues.begin(), movedValues.end());
+}
+
+static void movePaths(unordered_set<u16string>& paths, const u16string& fromPath, const u16string& toPath) {
+    vector<u16string> movedPaths;
+    for (auto it = paths.begin(); it != paths.end();) {
+        if (isSameOrDescendant(*it, fromPath)) {
+            movedPaths.push_back(toPath + it->substr(fromPath.length()));
+            it = paths.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    paths.insert(movedPaths.begin(), movedPaths.end());
+}
+
+bool Server::hasWatchPointsUnder(const u16string& path) const {
+    auto it = watchPointPaths.lower_bound(path);
+    return it != watchPointPaths.end() && isSameOrDescendant(*it, path);
+}
+
+vector<u16string> Server::watchPointsUnder(const u16string& path) const {
+    vector<u16string> paths;
+    // Paths starting with the given one are next to each other, but not all of them are under it
+    for (auto it = watchPointPaths.lower_bound(path); it != watchPointPaths.end() && it->compare(0, path.length(), path) == 0; ++it) {
+        if (isSameOrDescendant(*it, path)) {
+            paths.push_back(*it);
+        }
+    }
+    return paths;
+}
+
+bool Server::canMoveWatchPoints(const u16string& fromPath, const u16string& toPath) const {
+    vector<u16string> paths = watchPointsUnder(fromPath);
+    for (auto& path : paths) {
+        u16string movedPath = toPath + path.substr(fromPath.length());
+        if (watchPoints.find(movedPath) != watchPoints.end()) {
+            // Let the watch points be cleaned up as the replaced directories are removed
+            logToJava(LogLevel::FINE, "Not moving watch points from %s to already watched %s",
+                utf16ToUtf8String(fromPath).c_str(), utf16ToUtf8String(movedPath).c_str());
+            return false;
+        }
+    }
+    return !paths.empty();
+}
+
+void Server::moveWatchPoints(const u16string& fromPath, const u16string& toPath) {
+    vector<u16string> movedPaths = watchPointsUnder(fromPath);
+    // The watch descriptors follow the directories, only the paths we know them by change
+    for (auto& oldPath : movedPaths) {
+        u16string newPath = toPath + oldPath.substr(fromPath.length());
+        auto it = watchPoints.find(oldPath);
+        WatchPoint movedWatchPoint = it->second;
+        watchPoints.erase(it);
+        watchPointPaths.erase(oldPath);
+        WatchPoint& watchPoint = watchPoints.emplace(newPath, movedWatchPoint).first->second;
+        watchPointPaths.insert(newPath);
+        watchPoint.path = newPath;
+        watchPoint.moved = oldPath == fromPath;
+        watchRoots[watchPoint.watchDescriptor] = newPath;
+        for (auto& alias : watchPoint.aliases) {
+            aliasedWatchPoints[alias.first] = newPath;
+        }
+        if (merkleTree) {
+            merkleTree->moveDirectory(oldPath, newPath);
+        }
+        if (mirror) {
+            mirror->moveDirectory(oldPath, newPath);
+        }
+        logToJava(LogLevel::FINE, "Moved watch point from %s to %s (wd = %d)",
+            utf16ToUtf8String(oldPath).c_str(), utf16ToUtf8String(newPath).c_str(), watchPoint.watchDescriptor);
+    }
+    movePaths(lastActivity, fromPath, toPath);
+    movePaths(subscribedRoots, fromPath, toPath);
+    movePaths(subscriberOnlyRoots, fromPath, toPath);
+    for (auto& it : subscribers) {
+        for (auto& root : it.second->roots) {
+            if (isSameOrDescendant(root.second, fromPath)) {
+                root.second = toPath + root.second.substr(fromPath.length());
+            }
+        }
+    }
+}
+
+void Server::handleSentinelEvent(const inotify_event* event) {
+    if (!IS_SET(event->mask, IN_CREATE) || event->len == 0) {
+        return;
+    }
+    uint64_t sentinel = strtoull(event->name, nullptr, 10);
+    logToJava(LogLevel::FINE, "Received sentinel %s", event->name);
+    {
+        unique_lock<mutex> lock(sentinelMutex);
+        // Sentinels can arrive out of order, but any sentinel means that events from before its creation have been reported
+        if (sentinel > lastDeliveredSentinel) {
+            lastDeliveredSentinel = sentinel;
+        }
+        sentinelVariable.notify_all();
+    }
+    answerSubscriberSyncs();
+}
+
+void Server::releaseSentinelWaiters() {
+    {
+        unique_lock<mutex> lock(sentinelMutex);
+        lastDeliveredSentinel = lastRequestedSentinel;
+        sentinelVariable.notify_all();
+    }
+    answerSubscriberSyncs();
+}
+
+void Server::createSentinelDirectory() {
+    const char* tmpDir = getenv("TMPDIR");
+    string directoryTemplate = string(tmpDir == nullptr ? "/tmp" : tmpDir) + "/file-events-sentinel-XXXXXX";
+    vector<char> directory(directoryTemplate.begin(), directoryTemplate.end());
+    directory.push_back('\0');
+    if (mkdtemp(&directory[0]) == nullptr) {
+        throw FileWatcherException("Couldn't create sentinel directory", utf8ToUtf16String(directoryTemplate.c_str()), errno);
+    }
+    sentinelDirectory = string(&directory[0]);
+    sentinelWatchDescriptor = inotify_add_watch(inotify->fd, sentinelDirectory.c_str(), SENTINEL_EVENT_MASK);
+    if (sentinelWatchDescriptor == -1) {
+        int error = errno;
+        rmdir(sentinelDirectory.c_str());
+        sentinelDirectory.clear();
+        throw FileWatcherException("Couldn't watch sentinel directory", utf8ToUtf16String(&directory[0]), error);
+    }
+    logToJava(LogLevel::FINE, "Created sentinel directory %s (wd = %d)", sentinelDirectory.c_str(), sentinelWatchDescriptor);
+}
+
+uint64_t Server::createSentinel() {
+    uint64_t sentinel;
+    {
+        unique_lock<recursive_mutex> lock(mutationMutex);
+        if (sentinelDirectory.empty()) {
+            createSentinelDirectory();
+        }
+    }
+    {
+        unique_lock<mutex> lock(sentinelMutex);
+        sentinel = ++lastRequestedSentinel;
+    }
+
+    // Inotify reports events in the order they happened, so once the sentinel
+    // arrives, every change before it must have been reported as well
+    string sentinelPath = sentinelDirectory + "/" + to_string(sentinel);
+    int fd = open(sentinelPath.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        throw FileWatcherException("Couldn't create sentinel", utf8ToUtf16String(sentinelPath.c_str()), errno);
+    }
+    close(fd);
+    unlink(sentinelPath.c_str());
+    return sentinel;
+}
+
+bool Server::awaitPendingEvents(long timeoutInMillis) {
+    uint64_t sentinel = createSentinel();
+    unique_lock<mutex> lock(sentinelMutex);
+    return sentinelVariable.wait_for(lock, chrono::milliseconds(timeoutInMillis), [this, sentinel] {
+        return lastDeliveredSentinel >= sentinel;
+    });
 }
 
-static int addInotifyWatch(const u16string& path, shared_ptr<Inotify> inotify, JNIEnv* env) {
+void Server::updateEntry(const WatchPoint& watchPoint, const char* name) {
+    if (merkleTree) {
+        merkleTree->updateEntry(watchPoint.path, name);
+    }
+    if (mirror) {
+        mirror->updateEntry(watchPoint.path, name);
+    }
+}
+
+static uint32_t eventMask(int eventKinds) {
+    uint32_t mask = BASE_EVENT_MASK;
+    if (IS_SET(eventKinds, EVENT_KIND_STRUCTURE)) {
+        mask |= STRUCTURE_EVENT_MASK;
+    }
+    if (IS_SET(eventKinds, EVENT_KIND_CONTENT)) {
+        mask |= CONTENT_EVENT_MASK;
+    }
+    return mask;
+}
+
+static int addInotifyWatch(const u16string& path, uint32_t mask, shared_ptr<Inotify> inotify, JNIEnv* env) {
     string pathNarrow = utf16ToUtf8String(path);
-    int fdWatch = inotify_add_watch(inotify->fd, pathNarrow.c_str(), EVENT_MASK);
+    int fdWatch = inotify_add_watch(inotify->fd, pathNarrow.c_str(), mask);
     if (fdWatch == -1) {
         if (errno == ENOSPC) {
             rethrowAsJavaException(env, InotifyWatchesLimitTooLowException(), linuxJniConstants->inotifyWatchesLimitTooLowExceptionClass.get());
@@ -275,9 +1177,13 @@ static int addInotifyWatch(const u16string& path, shared_ptr<Inotify> inotify, J
 }
 
 void Server::registerPaths(const vector<u16string>& paths) {
+    registerPaths(paths, EVENT_KIND_ALL);
+}
+
+void Server::registerPaths(const vector<u16string>& paths, int eventKinds) {
     unique_lock<recursive_mutex> lock(mutationMutex);
     for (auto& path : paths) {
-        registerPath(path);
+        registerPath(path, eventKinds);
     }
 }
 
@@ -290,28 +1196,283 @@ bool Server::unregisterPaths(const vector<u16string>& paths) {
     return success;
 }
 
-void Server::registerPath(const u16string& path) {
+static bool isDirectory(const u16string& path) {
+    struct stat fileInfo;
+    if (stat(utf16ToUtf8String(path).c_str(), &fileInfo) != 0) {
+        // Let adding the watch report the problem
+        return true;
+    }
+    return S_ISDIR(fileInfo.st_mode);
+}
+
+void Server::registerPath(const u16string& path, int eventKinds) {
+    if (subscriberOnlyRoots.erase(path) > 0) {
+        // Already watched for subscribers, which need every kind of change
+        return;
+    }
+    if (!isDirectory(path)) {
+        registerFile(path, eventKinds);
+        return;
+    }
     auto it = watchPoints.find(path);
-    if (it != watchPoints.end()) {
+    if ((it != watchPoints.end() && it->second.directoryEventKinds != 0) || aliasedWatchPoints.find(path) != aliasedWatchPoints.end()) {
         throw FileWatcherException("Already watching path", path);
     }
-    int watchDescriptor = addInotifyWatch(path, inotify, getThreadEnv());
-    if (watchRoots.find(watchDescriptor) != watchRoots.end()) {
+    WatchPoint& watchPoint = it == watchPoints.end()
+        ? addWatchPoint(path, eventKinds)
+        : it->second;
+    if (watchPoint.path != path) {
+        registerAlias(watchPoint, path, eventKinds);
+        return;
+    }
+    watchPoint.directoryEventKinds = eventKinds;
+    updateEventMask(watchPoint);
+    if (merkleTree) {
+        merkleTree->addDirectory(path);
+    }
+    if (mirror) {
+        mirror->addDirectory(path);
+    }
+}
+
+void Server::registerFile(const u16string& path, int eventKinds) {
+    // Inotify can only watch directories, so we watch the parent directory and only report the requested files
+    u16string parent;
+    u16string name;
+    splitPath(path, parent, name);
+    auto it = watchPoints.find(parent);
+    WatchPoint& watchPoint = it == watchPoints.end()
+        ? addWatchPoint(parent, eventKinds)
+        : it->second;
+    if (watchPoint.path != parent) {
+        // Only whole directories can be watched via several paths
+        updateEventMask(watchPoint);
+        throw FileWatcherException("Already watching parent directory via another path", path);
+    }
+    if (!watchPoint.watchedFiles.emplace(name, eventKinds).second) {
         throw FileWatcherException("Already watching path", path);
     }
-    watchPoints.emplace(piecewise_construct,
+    updateEventMask(watchPoint);
+}
+
+WatchPoint& Server::addWatchPoint(const u16string& path, int eventKinds) {
+    uint32_t mask = kernelEventMask(eventKinds);
+    // Inotify returns the existing watch when the directory is already watched via another path,
+    // don't replace the mask the other path needs
+    int watchDescriptor = addInotifyWatch(path, mask | IN_MASK_ADD, inotify, getThreadEnv());
+    auto iWatchRoot = watchRoots.find(watchDescriptor);
+    if (iWatchRoot != watchRoots.end()) {
+        WatchPoint& existingWatchPoint = watchPoints.at(iWatchRoot->second);
+        existingWatchPoint.eventMask |= mask;
+        return existingWatchPoint;
+    }
+    auto result = watchPoints.emplace(piecewise_construct,
         forward_as_tuple(path),
-        forward_as_tuple(path, inotify, watchDescriptor));
+        forward_as_tuple(path, inotify, watchDescriptor, mask));
+    if (collectChangeMetadata) {
+        result.first->second.directory = openDirectoryHandle(path);
+    }
+    watchPointPaths.insert(path);
     watchRoots[watchDescriptor] = path;
+    return result.first->second;
+}
+
+uint32_t Server::kernelEventMask(int eventKinds) const {
+    if (merkleTree || mirror) {
+        // Tree hashes and the mirror need to see every change
+        return eventMask(EVENT_KIND_ALL) | METADATA_EVENT_MASK;
+    }
+    return eventMask(eventKinds);
+}
+
+void Server::updateEventMask(WatchPoint& watchPoint) {
+    int eventKinds = watchPoint.directoryEventKinds;
+    for (auto& file : watchPoint.watchedFiles) {
+        eventKinds |= file.second;
+    }
+    for (auto& alias : watchPoint.aliases) {
+        eventKinds |= alias.second;
+    }
+    uint32_t mask = kernelEventMask(eventKinds);
+    if (mask == watchPoint.eventMask) {
+        return;
+    }
+    bool narrowing = (mask & ~watchPoint.eventMask) == 0;
+    // Adding a watch for an already watched directory replaces the mask of the existing watch
+    int watchDescriptor = narrowing
+        ? inotify_add_watch(inotify->fd, utf16ToUtf8String(watchPoint.path).c_str(), mask)
+        : addInotifyWatch(watchPoint.path, mask, inotify, getThreadEnv());
+    if (watchDescriptor == watchPoint.watchDescriptor) {
+        watchPoint.eventMask = mask;
+        return;
+    }
+    if (watchDescriptor != -1) {
+        // The directory has been replaced since we started watching it
+        inotify_rm_watch(inotify->fd, watchDescriptor);
+    }
+    // Narrowing the mask is only an optimization, as unrequested events are filtered anyway
+    if (!narrowing) {
+        throw FileWatcherException("Couldn't update watch, directory has been replaced", watchPoint.path);
+    }
 }
 
 bool Server::unregisterPath(const u16string& path) {
+    if (subscribedRoots.find(path) != subscribedRoots.end()) {
+        if (!subscriberOnlyRoots.insert(path).second) {
+            logToJava(LogLevel::INFO, "Path is not watched: %s", utf16ToUtf8String(path).c_str());
+            return false;
+        }
+        // Keep watching for subscribers
+        lastActivity.erase(path);
+        return true;
+    }
+    if (aliasedWatchPoints.find(path) != aliasedWatchPoints.end()) {
+        return unregisterAlias(path);
+    }
     auto it = watchPoints.find(path);
-    if (it == watchPoints.end()) {
+    if (it == watchPoints.end() || it->second.directoryEventKinds == 0) {
+        return unregisterFile(path);
+    }
+    auto& watchPoint = it->second;
+    watchPoint.directoryEventKinds = 0;
+    lastActivity.erase(path);
+    if (merkleTree) {
+        merkleTree->removeDirectory(path);
+    }
+    if (mirror) {
+        mirror->removeDirectory(path);
+    }
+    if (!watchPoint.watchedFiles.empty()) {
+        // Keep watching the individually registered files, and the aliases
+        updateEventMask(watchPoint);
+        return true;
+    }
+    if (!watchPoint.aliases.empty()) {
+        promoteAlias(path);
+        return true;
+    }
+    return cancelWatchPoint(watchPoint);
+}
+
+void Server::registerAlias(WatchPoint& watchPoint, const u16string& path, int eventKinds) {
+    logToJava(LogLevel::FINE, "Watching %s via already watched %s (wd = %d)",
+        utf16ToUtf8String(path).c_str(), utf16ToUtf8String(watchPoint.path).c_str(), watchPoint.watchDescriptor);
+    watchPoint.aliases.emplace(path, eventKinds);
+    aliasedWatchPoints.emplace(path, watchPoint.path);
+    updateEventMask(watchPoint);
+}
+
+int Server::unregisterPathsUnder(const u16string& root) {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    vector<u16string> paths;
+    for (auto& watchPointPath : watchPointsUnder(root)) {
+        auto& watchPoint = watchPoints.at(watchPointPath);
+        if (watchPoint.directoryEventKinds != 0) {
+            paths.push_back(watchPointPath);
+        }
+        for (auto& file : watchPoint.watchedFiles) {
+            paths.push_back(watchPointPath + u"/" + file.first);
+        }
+    }
+    // Aliases are rare, they are not worth an index of their own
+    for (auto& alias : aliasedWatchPoints) {
+        if (isSameOrDescendant(alias.first, root)) {
+            paths.push_back(alias.first);
+        }
+    }
+    // The root itself might be an individually registered file
+    u16string parent;
+    u16string name;
+    splitPath(root, parent, name);
+    auto iParent = watchPoints.find(parent);
+    if (iParent != watchPoints.end() && iParent->second.watchedFiles.find(name) != iParent->second.watchedFiles.end()) {
+        paths.push_back(root);
+    }
+
+    int unregistered = 0;
+    for (auto& path : paths) {
+        // Paths only watched for subscribers have not been registered from Java
+        if (isReportedToJava(path) && unregisterPath(path)) {
+            unregistered++;
+        }
+    }
+    logToJava(LogLevel::FINE, "Unregistered %d paths under %s", unregistered, utf16ToUtf8String(root).c_str());
+    return unregistered;
+}
+
+bool Server::unregisterAlias(const u16string& path) {
+    auto it = aliasedWatchPoints.find(path);
+    WatchPoint& watchPoint = watchPoints.at(it->second);
+    aliasedWatchPoints.erase(it);
+    watchPoint.aliases.erase(path);
+    lastActivity.erase(path);
+    if (watchPoint.directoryEventKinds != 0 || !watchPoint.watchedFiles.empty()) {
+        updateEventMask(watchPoint);
+        return true;
+    }
+    if (watchPoint.aliases.empty()) {
+        return cancelWatchPoint(watchPoint);
+    }
+    // Copy the path, the watch point is erased when promoting the alias
+    u16string watchPointPath = watchPoint.path;
+    promoteAlias(watchPointPath);
+    return true;
+}
+
+void Server::promoteAlias(const u16string& path) {
+    // Copy the watch point, it is stored under the path of one of its aliases from now on
+    auto it = watchPoints.find(path);
+    WatchPoint watchPoint = it->second;
+    watchPoints.erase(it);
+    watchPointPaths.erase(path);
+    auto iAlias = watchPoint.aliases.begin();
+    u16string newPath = iAlias->first;
+    watchPoint.path = newPath;
+    watchPoint.directoryEventKinds = iAlias->second;
+    watchPoint.aliases.erase(iAlias);
+    aliasedWatchPoints.erase(newPath);
+    for (auto& alias : watchPoint.aliases) {
+        aliasedWatchPoints[alias.first] = newPath;
+    }
+    watchRoots[watchPoint.watchDescriptor] = newPath;
+    WatchPoint& promotedWatchPoint = watchPoints.emplace(newPath, watchPoint).first->second;
+    watchPointPaths.insert(newPath);
+    if (merkleTree) {
+        merkleTree->addDirectory(newPath);
+    }
+    if (mirror) {
+        mirror->addDirectory(newPath);
+    }
+    updateEventMask(promotedWatchPoint);
+    logToJava(LogLevel::FINE, "Watching %s via %s from now on (wd = %d)",
+        utf16ToUtf8String(path).c_str(), utf16ToUtf8String(newPath).c_str(), promotedWatchPoint.watchDescriptor);
+}
+
+bool Server::unregisterFile(const u16string& path) {
+    u16string parent;
+    u16string name;
+    splitPath(path, parent, name);
+    auto it = watchPoints.find(parent);
+    if (it == watchPoints.end() || it->second.watchedFiles.erase(name) == 0) {
         logToJava(LogLevel::INFO, "Path is not watched: %s", utf16ToUtf8String(path).c_str());
         return false;
     }
+    lastActivity.erase(path);
     auto& watchPoint = it->second;
+    if (watchPoint.directoryEventKinds != 0 || !watchPoint.watchedFiles.empty()) {
+        updateEventMask(watchPoint);
+        return true;
+    }
+    if (!watchPoint.aliases.empty()) {
+        promoteAlias(parent);
+        return true;
+    }
+    return cancelWatchPoint(watchPoint);
+}
+
+bool Server::cancelWatchPoint(WatchPoint& watchPoint) {
+    // Copy the path, the watch point is erased below
+    u16string path = watchPoint.path;
     int wd = watchPoint.watchDescriptor;
     CancelResult ret = watchPoint.cancel();
     if (ret == CancelResult::ALREADY_CANCELLED) {
@@ -323,19 +1484,229 @@ bool Server::unregisterPath(const u16string& path) {
     // when inside a Docker container a host-mapped directory is watched. There is no good theory as
     // of this writing why the problem occurs, but not using the iterator here fixes it.
     watchPoints.erase(path);
+    watchPointPaths.erase(path);
     return ret == CancelResult::CANCELLED;
 }
 
+bool Server::getTreeHash(const u16string& path, uint64_t& hash) {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    return merkleTree && merkleTree->getHash(path, hash);
+}
+
+MirrorLookup Server::statMirrored(const u16string& path, MirrorEntry& entry) {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    return mirror
+        ? mirror->stat(path, entry)
+        : MirrorLookup::NOT_MIRRORED;
+}
+
+MirrorLookup Server::listMirrored(const u16string& path, vector<pair<string, MirrorEntry>>& entries) {
+    unique_lock<recursive_mutex> lock(mutationMutex);
+    return mirror
+        ? mirror->list(path, entries)
+        : MirrorLookup::NOT_MIRRORED;
+}
+
 JNIEXPORT jobject JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_startWatcher0(JNIEnv* env, jclass, jobject javaCallback) {
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_startWatcher0(JNIEnv* env, jclass, jobject javaCallback, jboolean trackTreeHashes, jboolean mirrorWatchedTrees, jboolean collectChangeMetadata, jboolean reportCanonicalPathsOnly, jboolean reportMoves, jlong settledQuietPeriodInMillis, jstring javaJournalPath, jlong journalCapacity, jstring javaSubscriptionSocketPath) {
     try {
-        return wrapServer(env, new Server(env, javaCallback));
+        string journalPath = javaJournalPath == nullptr
+            ? string()
+            : utf16ToUtf8String(javaToUtf16String(env, javaJournalPath));
+        string subscriptionSocketPath = javaSubscriptionSocketPath == nullptr
+            ? string()
+            : utf16ToUtf8String(javaToUtf16String(env, javaSubscriptionSocketPath));
+        return wrapServer(env, new Server(env, javaCallback, trackTreeHashes, mirrorWatchedTrees, collectChangeMetadata, reportCanonicalPathsOnly, reportMoves, (long) settledQuietPeriodInMillis, journalPath, (long) journalCapacity, subscriptionSocketPath));
     } catch (const InotifyInstanceLimitTooLowException& e) {
         rethrowAsJavaException(env, e, linuxJniConstants->inotifyInstanceLimitTooLowExceptionClass.get());
         return NULL;
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return NULL;
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_startWatchingWithEventKinds0(JNIEnv* env, jclass, jobject javaServer, jobjectArray javaPaths, jint eventKinds) {
+    try {
+        Server* server = (Server*) getServer(env, javaServer);
+        vector<u16string> paths;
+        javaToUtf16StringArray(env, javaPaths, paths);
+        server->registerPaths(paths, eventKinds);
+    } catch (const JavaExceptionThrownException&) {
+        // Ignore, the Java exception has already been thrown.
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+    }
+}
+
+JNIEXPORT jint JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_stopWatchingUnder0(JNIEnv* env, jclass, jobject javaServer, jstring javaRoot) {
+    try {
+        Server* server = (Server*) getServer(env, javaServer);
+        return server->unregisterPathsUnder(javaToUtf16String(env, javaRoot));
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return 0;
     }
 }
 
+JNIEXPORT jboolean JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_getTreeHash0(JNIEnv* env, jclass, jobject javaServer, jstring javaPath, jlongArray javaHash) {
+    try {
+        Server* server = (Server*) getServer(env, javaServer);
+        uint64_t hash;
+        if (!server->getTreeHash(javaToUtf16String(env, javaPath), hash)) {
+            return false;
+        }
+        jlong result = (jlong) hash;
+        env->SetLongArrayRegion(javaHash, 0, 1, &result);
+        return true;
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return false;
+    }
+}
+
+JNIEXPORT jboolean JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_stat0(JNIEnv* env, jclass, jobject javaServer, jstring javaPath, jlongArray javaMetadata) {
+    try {
+        Server* server = (Server*) getServer(env, javaServer);
+        MirrorEntry entry;
+        if (server->statMirrored(javaToUtf16String(env, javaPath), entry) == MirrorLookup::NOT_MIRRORED) {
+            return false;
+        }
+        jlong metadata[] = { (jlong) entry.type, (jlong) entry.size, (jlong) entry.lastModified };
+        env->SetLongArrayRegion(javaMetadata, 0, 3, metadata);
+        return true;
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return false;
+    }
+}
+
+JNIEXPORT jboolean JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_listDir0(JNIEnv* env, jclass, jobject javaServer, jstring javaPath, jobject javaCollector) {
+    try {
+        Server* server = (Server*) getServer(env, javaServer);
+        vector<pair<string, MirrorEntry>> entries;
+        if (server->listMirrored(javaToUtf16String(env, javaPath), entries) == MirrorLookup::NOT_MIRRORED) {
+            return false;
+        }
+        // Call back to Java outside of the lock, so the watcher thread isn't blocked
+        jclass collectorClass = env->GetObjectClass(javaCollector);
+        jmethodID addMethod = env->GetMethodID(collectorClass, "add", "(Ljava/lang/String;IJJ)V");
+        env->DeleteLocalRef(collectorClass);
+        for (auto& it : entries) {
+            u16string name = utf8ToUtf16String(it.first.c_str());
+            jstring javaName = env->NewString((jchar*) name.c_str(), (jsize) name.length());
+            env->CallVoidMethod(javaCollector, addMethod, javaName, (jint) it.second.type, (jlong) it.second.size, (jlong) it.second.lastModified);
+            env->DeleteLocalRef(javaName);
+            if (env->ExceptionCheck()) {
+                return false;
+            }
+        }
+        return true;
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return false;
+    }
+}
+
+JNIEXPORT jint JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_connectToSharedWatcher0(JNIEnv* env, jclass, jstring javaSocketPath) {
+    try {
+        u16string socketPath = javaToUtf16String(env, javaSocketPath);
+        struct sockaddr_un address = socketAddress(utf16ToUtf8String(socketPath));
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1) {
+            throw FileWatcherException("Couldn't create socket", errno);
+        }
+        if (connect(fd, (struct sockaddr*) &address, sizeof(address)) == -1) {
+            int error = errno;
+            close(fd);
+            if (error == ENOENT || error == ECONNREFUSED) {
+                // Nobody is sharing a watcher
+                return -1;
+            }
+            throw FileWatcherException("Couldn't connect to shared watcher", socketPath, error);
+        }
+        return fd;
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return -1;
+    }
+}
+
+JNIEXPORT jstring JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_readSharedWatcherLine0(JNIEnv* env, jclass, jint fd) {
+    try {
+        // Lines are short, and only read when an answer is expected
+        string line;
+        char c;
+        while (true) {
+            ssize_t bytesRead = recv(fd, &c, 1, 0);
+            if (bytesRead == 0) {
+                return nullptr;
+            }
+            if (bytesRead == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw FileWatcherException("Couldn't read from shared watcher", errno);
+            }
+            if (c == '\n') {
+                break;
+            }
+            line.push_back(c);
+        }
+        u16string wideLine = utf8ToUtf16String(line.c_str());
+        return env->NewString((jchar*) wideLine.c_str(), (jsize) wideLine.length());
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+        return nullptr;
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_writeSharedWatcherLine0(JNIEnv* env, jclass, jint fd, jstring javaLine) {
+    try {
+        string data = utf16ToUtf8String(javaToUtf16String(env, javaLine)) + "\n";
+        size_t written = 0;
+        while (written < data.length()) {
+            ssize_t bytesWritten = send(fd, data.c_str() + written, data.length() - written, MSG_NOSIGNAL);
+            if (bytesWritten == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw FileWatcherException("Couldn't write to shared watcher", errno);
+            }
+            written += bytesWritten;
+        }
+    } catch (const exception& e) {
+        rethrowAsJavaException(env, e);
+    }
+}
+
+JNIEXPORT jboolean JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_isSharedWatcherDisconnected0(JNIEnv*, jclass, jint fd) {
+    struct pollfd pollFd = { fd, POLLIN, 0 };
+    if (poll(&pollFd, 1, 0) <= 0) {
+        return false;
+    }
+    if (IS_SET(pollFd.revents, POLLHUP | POLLERR | POLLNVAL)) {
+        return true;
+    }
+    // Don't consume answers, only look for the end of the stream
+    char c;
+    return recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_closeSharedWatcherConnection0(JNIEnv*, jclass, jint fd) {
+    close(fd);
+}
+
 JNIEXPORT jboolean JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions_isGlibc0(JNIEnv*, jclass) {
     void* libcLibrary = dlopen("libc.so.6", RTLD_LAZY);
@@ -0,0 +1,222 @@
+#ifdef __linux__
+
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <vector>
+
+#include "jni_support.h"
+#include "logging.h"
+#include "merkle_tree.h"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+#define DIRECTORY_HASH_SEED 0x9e3779b97f4a7c15ULL
+
+// Finalizer of SplitMix64, spreads every input bit over the whole hash
+static uint64_t mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+static uint64_t hashName(const string& name) {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (unsigned char c : name) {
+        hash = (hash ^ c) * FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t hashEntry(const string& name, const MerkleEntry& entry) {
+    uint64_t hash = mix(hashName(name) ^ entry.type);
+    hash = mix(hash + (uint64_t) entry.size);
+    hash = mix(hash + (uint64_t) entry.lastModified);
+    return mix(hash + entry.childHash);
+}
+
+static u16string childPath(const u16string& path, const string& name) {
+    u16string child = path;
+    if (child.empty() || child.back() != u'/') {
+        child.append(u"/");
+    }
+    child.append(utf8ToUtf16String(name.c_str()));
+    return child;
+}
+
+static bool statEntry(int dirFd, const char* path, MerkleEntry& entry) {
+    struct stat fileInfo;
+    if (fstatat(dirFd, path, &fileInfo, AT_SYMLINK_NOFOLLOW) != 0) {
+        return false;
+    }
+    entry.type = fileInfo.st_mode & S_IFMT;
+    entry.childHash = 0;
+    if (S_ISDIR(fileInfo.st_mode)) {
+        // The modification time of a directory only reflects changes to its entries,
+        // which are covered by the child hash if the directory is tracked
+        entry.size = 0;
+        entry.lastModified = 0;
+    } else {
+        entry.size = fileInfo.st_size;
+        entry.lastModified = fileInfo.st_mtim.tv_sec * 1000000000LL + fileInfo.st_mtim.tv_nsec;
+    }
+    return true;
+}
+
+void MerkleTree::addDirectory(const u16string& path) {
+    MerkleDirectory& directory = directories[path];
+    scan(path, directory);
+    updateDirectoryHash(path, directory);
+}
+
+void MerkleTree::removeDirectory(const u16string& path) {
+    if (directories.erase(path) > 0) {
+        propagateToParent(path, 0);
+    }
+}
+
+void MerkleTree::moveDirectory(const u16string& fromPath, const u16string& toPath) {
+    auto it = directories.find(fromPath);
+    if (it == directories.end()) {
+        return;
+    }
+    MerkleDirectory directory = move(it->second);
+    directories.erase(it);
+    directories[toPath] = move(directory);
+}
+
+void MerkleTree::updateEntry(const u16string& directoryPath, const string& name) {
+    auto it = directories.find(directoryPath);
+    if (it == directories.end()) {
+        return;
+    }
+    MerkleDirectory& directory = it->second;
+    u16string path = childPath(directoryPath, name);
+    MerkleEntry entry;
+    if (statEntry(AT_FDCWD, utf16ToUtf8String(path).c_str(), entry)) {
+        if (S_ISDIR(entry.type)) {
+            auto child = directories.find(path);
+            if (child != directories.end()) {
+                entry.childHash = child->second.hash;
+            }
+        }
+        setEntry(directory, name, &entry);
+    } else {
+        setEntry(directory, name, nullptr);
+    }
+    updateDirectoryHash(directoryPath, directory);
+}
+
+void MerkleTree::rescan() {
+    for (auto& it : directories) {
+        scan(it.first, it.second);
+    }
+    // Child hashes picked up during the scan might have been stale, so recompute them
+    // from the leaves, i.e. the longest paths, upwards
+    vector<const u16string*> paths;
+    for (auto& it : directories) {
+        paths.push_back(&it.first);
+    }
+    sort(paths.begin(), paths.end(), [](const u16string* a, const u16string* b) {
+        return a->size() > b->size();
+    });
+    for (auto path : paths) {
+        updateDirectoryHash(*path, directories.at(*path));
+    }
+}
+
+bool MerkleTree::getHash(const u16string& path, uint64_t& hash) const {
+    auto it = directories.find(path);
+    if (it == directories.end()) {
+        return false;
+    }
+    hash = it->second.hash;
+    return true;
+}
+
+void MerkleTree::scan(const u16string& path, MerkleDirectory& directory) {
+    directory.entries.clear();
+    directory.entryHashSum = 0;
+    DIR* dir = opendir(utf16ToUtf8String(path).c_str());
+    if (dir == nullptr) {
+        // The directory is gone, it is tracked as being empty until it is removed
+        logToJava(LogLevel::FINE, "Couldn't scan %s for hashing (errno = %d)", utf16ToUtf8String(path).c_str(), errno);
+        return;
+    }
+    int dirFd = dirfd(dir);
+    struct dirent* dirEntry;
+    while ((dirEntry = readdir(dir)) != nullptr) {
+        const char* name = dirEntry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        MerkleEntry entry;
+        if (!statEntry(dirFd, name, entry)) {
+            // Removed while scanning, the event for the removal is still going to arrive
+            continue;
+        }
+        if (S_ISDIR(entry.type)) {
+            auto child = directories.find(childPath(path, name));
+            if (child != directories.end()) {
+                entry.childHash = child->second.hash;
+            }
+        }
+        setEntry(directory, name, &entry);
+    }
+    closedir(dir);
+}
+
+void MerkleTree::setEntry(MerkleDirectory& directory, const string& name, const MerkleEntry* entry) {
+    auto it = directory.entries.find(name);
+    if (it != directory.entries.end()) {
+        directory.entryHashSum -= it->second.hash;
+        if (entry == nullptr) {
+            directory.entries.erase(it);
+            return;
+        }
+        it->second = *entry;
+    } else {
+        if (entry == nullptr) {
+            return;
+        }
+        it = directory.entries.emplace(name, *entry).first;
+    }
+    it->second.hash = hashEntry(name, it->second);
+    directory.entryHashSum += it->second.hash;
+}
+
+void MerkleTree::updateDirectoryHash(const u16string& path, MerkleDirectory& directory) {
+    uint64_t hash = mix(directory.entryHashSum + DIRECTORY_HASH_SEED);
+    if (hash != directory.hash) {
+        directory.hash = hash;
+        propagateToParent(path, hash);
+    }
+}
+
+void MerkleTree::propagateToParent(const u16string& path, uint64_t childHash) {
+    size_t separator = path.find_last_of(u'/');
+    if (separator == u16string::npos || separator + 1 == path.size()) {
+        return;
+    }
+    u16string parentPath = separator == 0
+        ? u"/"
+        : path.substr(0, separator);
+    auto parent = directories.find(parentPath);
+    if (parent == directories.end()) {
+        return;
+    }
+    MerkleDirectory& directory = parent->second;
+    string name = utf16ToUtf8String(path.substr(separator + 1));
+    auto it = directory.entries.find(name);
+    if (it == directory.entries.end() || !S_ISDIR(it->second.type)) {
+        return;
+    }
+    MerkleEntry entry = it->second;
+    entry.childHash = childHash;
+    setEntry(directory, name, &entry);
+    updateDirectoryHash(parentPath, directory);
+}
+
+#endif
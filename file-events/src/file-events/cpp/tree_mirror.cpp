@@ -0,0 +1,153 @@
+#ifdef __linux__
+
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "jni_support.h"
+#include "logging.h"
+#include "tree_mirror.h"
+
+static const MirrorEntry MISSING_ENTRY = { MirroredType::MISSING, 0, 0 };
+
+static bool statEntry(int dirFd, const char* path, MirrorEntry& entry) {
+    struct stat fileInfo;
+    if (fstatat(dirFd, path, &fileInfo, AT_SYMLINK_NOFOLLOW) != 0) {
+        return false;
+    }
+    if (S_ISREG(fileInfo.st_mode)) {
+        entry.type = MirroredType::FILE;
+    } else if (S_ISDIR(fileInfo.st_mode)) {
+        entry.type = MirroredType::DIRECTORY;
+    } else if (S_ISLNK(fileInfo.st_mode)) {
+        entry.type = MirroredType::SYMLINK;
+    } else {
+        entry.type = MirroredType::OTHER;
+    }
+    entry.size = S_ISREG(fileInfo.st_mode) ? fileInfo.st_size : 0;
+    entry.lastModified = fileInfo.st_mtim.tv_sec * 1000LL + fileInfo.st_mtim.tv_nsec / 1000000;
+    return true;
+}
+
+static u16string parentPath(const u16string& path, size_t separator) {
+    return separator == 0
+        ? u"/"
+        : path.substr(0, separator);
+}
+
+void TreeMirror::addDirectory(const u16string& path) {
+    directories[path];
+}
+
+void TreeMirror::removeDirectory(const u16string& path) {
+    directories.erase(path);
+}
+
+void TreeMirror::moveDirectory(const u16string& fromPath, const u16string& toPath) {
+    auto it = directories.find(fromPath);
+    if (it == directories.end()) {
+        return;
+    }
+    MirrorDirectory directory = move(it->second);
+    directories.erase(it);
+    directories[toPath] = move(directory);
+}
+
+void TreeMirror::updateEntry(const u16string& directoryPath, const string& name) {
+    auto it = directories.find(directoryPath);
+    if (it == directories.end() || !it->second.listed) {
+        return;
+    }
+    u16string path = directoryPath + u"/" + utf8ToUtf16String(name.c_str());
+    MirrorEntry entry;
+    if (statEntry(AT_FDCWD, utf16ToUtf8String(path).c_str(), entry)) {
+        it->second.entries[name] = entry;
+    } else {
+        it->second.entries.erase(name);
+    }
+}
+
+void TreeMirror::invalidate() {
+    for (auto& it : directories) {
+        it.second.listed = false;
+        it.second.entries.clear();
+    }
+}
+
+MirrorLookup TreeMirror::stat(const u16string& path, MirrorEntry& entry) {
+    // Look for the closest watched ancestor
+    u16string current = path;
+    while (current.size() > 1) {
+        size_t separator = current.find_last_of(u'/');
+        if (separator == u16string::npos) {
+            break;
+        }
+        u16string parent = parentPath(current, separator);
+        MirrorDirectory* directory = findListedDirectory(parent);
+        if (directory != nullptr) {
+            auto it = directory->entries.find(utf16ToUtf8String(current.substr(separator + 1)));
+            if (it == directory->entries.end()) {
+                // Negative entry, nothing exists below a missing ancestor
+                entry = MISSING_ENTRY;
+                return MirrorLookup::FOUND;
+            }
+            if (current == path) {
+                entry = it->second;
+                return MirrorLookup::FOUND;
+            }
+            if (it->second.type == MirroredType::DIRECTORY || it->second.type == MirroredType::SYMLINK) {
+                // The ancestor might contain the path, but it is not watched itself
+                return MirrorLookup::NOT_MIRRORED;
+            }
+            // Files don't have descendants
+            entry = MISSING_ENTRY;
+            return MirrorLookup::FOUND;
+        }
+        current = parent;
+    }
+    return MirrorLookup::NOT_MIRRORED;
+}
+
+MirrorLookup TreeMirror::list(const u16string& directoryPath, vector<pair<string, MirrorEntry>>& entries) {
+    MirrorDirectory* directory = findListedDirectory(directoryPath);
+    if (directory == nullptr) {
+        return MirrorLookup::NOT_MIRRORED;
+    }
+    entries.insert(entries.end(), directory->entries.begin(), directory->entries.end());
+    return MirrorLookup::FOUND;
+}
+
+MirrorDirectory* TreeMirror::findListedDirectory(const u16string& path) {
+    auto it = directories.find(path);
+    if (it == directories.end()) {
+        return nullptr;
+    }
+    MirrorDirectory& directory = it->second;
+    if (directory.listed) {
+        return &directory;
+    }
+    DIR* dir = opendir(utf16ToUtf8String(path).c_str());
+    if (dir == nullptr) {
+        // Let the caller query the file system and report the problem
+        logToJava(LogLevel::FINE, "Couldn't list %s for mirroring (errno = %d)", utf16ToUtf8String(path).c_str(), errno);
+        return nullptr;
+    }
+    int dirFd = dirfd(dir);
+    struct dirent* dirEntry;
+    while ((dirEntry = readdir(dir)) != nullptr) {
+        const char* name = dirEntry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        MirrorEntry entry;
+        if (statEntry(dirFd, name, entry)) {
+            directory.entries.emplace(name, entry);
+        }
+    }
+    closedir(dir);
+    directory.listed = true;
+    return &directory;
+}
+
+#endif
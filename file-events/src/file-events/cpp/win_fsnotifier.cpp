@@ -148,7 +148,7 @@ void Server::handleEvents(WatchPoint* watchPoint, DWORD errorCode, const vector<
     try {
         if (errorCode != ERROR_SUCCESS) {
             if (errorCode == ERROR_ACCESS_DENIED && !watchPoint->isValidDirectory()) {
-                reportChangeEvent(env, ChangeType::REMOVED, path);
+                reportChangeEvent(env, ChangeType::REMOVED, path, path);
                 watchPoint->close();
                 return;
             } else {
@@ -191,7 +191,7 @@ void Server::handleEvents(WatchPoint* watchPoint, DWORD errorCode, const vector<
                 break;
             case ListenResult::DELETED:
                 logToJava(LogLevel::FINE, "Watched directory removed for %s", utf16ToUtf8String(path).c_str());
-                reportChangeEvent(env, ChangeType::REMOVED, path);
+                reportChangeEvent(env, ChangeType::REMOVED, path, path);
                 break;
         }
     } catch (const exception& ex) {
@@ -250,6 +250,16 @@ void convertToLongPathIfNeeded(u16string& path) {
     }
 }
 
+void removeLongPathPrefixIfNeeded(u16string& path) {
+    if (isLongPath(path)) {
+        if (isUncLongPath(path)) {
+            path.erase(0, 8).insert(0, u"\\\\");
+        } else {
+            path.erase(0, 4);
+        }
+    }
+}
+
 void Server::handleEvent(JNIEnv* env, const u16string& path, FILE_NOTIFY_EXTENDED_INFORMATION* info) {
     wstring changedPathW = wstring(info->FileName, 0, info->FileNameLength / sizeof(wchar_t));
     u16string changedPath(changedPathW.begin(), changedPathW.end());
@@ -258,13 +268,9 @@ void Server::handleEvent(JNIEnv* env, const u16string& path, FILE_NOTIFY_EXTENDE
     }
     changedPath.insert(0, path);
     // TODO Remove long prefix for path once?
-    if (isLongPath(changedPath)) {
-        if (isUncLongPath(changedPath)) {
-            changedPath.erase(0, 8).insert(0, u"\\\\");
-        } else {
-            changedPath.erase(0, 4);
-        }
-    }
+    removeLongPathPrefixIfNeeded(changedPath);
+    u16string root = path;
+    removeLongPathPrefixIfNeeded(root);
 
     logToJava(LogLevel::FINE, "Change detected: 0x%x '%s'", info->Action, utf16ToUtf8String(changedPath).c_str());
 
@@ -286,7 +292,7 @@ void Server::handleEvent(JNIEnv* env, const u16string& path, FILE_NOTIFY_EXTENDE
         return;
     }
 
-    reportChangeEvent(env, type, changedPath);
+    reportChangeEvent(env, type, changedPath, root);
 }
 
 //
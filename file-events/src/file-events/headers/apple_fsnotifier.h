@@ -20,6 +20,14 @@ static void handleEventsCallback(
     const FSEventStreamEventFlags eventFlags[],
     const FSEventStreamEventId*);
 
+/**
+ * Information passed to the event stream callback, owned by the event stream.
+ */
+struct WatchPointContext {
+    Server* server;
+    const u16string root;
+};
+
 class WatchPoint {
 public:
     WatchPoint(Server* server, CFRunLoopRef runLoop, const u16string& path, long latencyInMillis);
@@ -43,8 +51,9 @@ protected:
     void shutdownRunLoop() override;
 
 private:
-    void handleEvent(JNIEnv* env, char* path, FSEventStreamEventFlags flags, FSEventStreamEventId eventId);
+    void handleEvent(JNIEnv* env, const u16string& root, char* path, FSEventStreamEventFlags flags, FSEventStreamEventId eventId);
     void handleEvents(
+        const u16string& root,
         size_t numEvents,
         char** eventPaths,
         const FSEventStreamEventFlags eventFlags[],
@@ -0,0 +1,101 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <atomic>
+#include <string>
+
+#include "generic_fsnotifier.h"
+#include "net_rubygrapefruit_platform_internal_jni_FileEventJournalFunctions.h"
+
+using namespace std;
+
+#define JOURNAL_MAGIC 0x4a454546
+#define JOURNAL_VERSION 1
+
+// Record type for overflows, following the values of ChangeType
+#define JOURNAL_RECORD_OVERFLOW 4
+
+/**
+ * Header at the start of the journal file, followed by the index and the data area.
+ *
+ * The layout is read by FileEventJournal on the Java side, all values are in native byte order.
+ */
+struct JournalHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t dataCapacity;
+    uint64_t indexCapacity;
+
+    /**
+     * Sequence number of the oldest record that can still be read.
+     * Advanced before the space of a record is reused.
+     */
+    atomic<uint64_t> oldestSequence;
+
+    /**
+     * Sequence number of the next record to be written.
+     * Advanced after the record has been written.
+     * Readers wait for it to change with a futex on its lower half.
+     */
+    atomic<uint64_t> nextSequence;
+
+    uint8_t reserved[24];
+};
+
+/**
+ * Header of a single record in the data area, followed by the path encoded as UTF-8.
+ * Records are aligned to 8 bytes.
+ */
+struct JournalRecord {
+    uint64_t sequence;
+    uint32_t pathLength;
+    uint32_t type;
+};
+
+/**
+ * A bounded journal of change records in a memory-mapped file.
+ *
+ * Records are stored in a ring buffer, the oldest records are dropped to make room for new ones.
+ * The index maps the sequence number of each readable record to its offset in the data area,
+ * so readers in any process can start reading at any sequence number.
+ */
+class EventJournal {
+public:
+    EventJournal(const string& path, uint64_t dataCapacity);
+    ~EventJournal();
+
+    void appendChange(ChangeType type, const u16string& path);
+    void appendOverflow(const u16string& path);
+
+    /**
+     * Returns the sequence number the next record will be written with.
+     */
+    uint64_t getNextSequence() const;
+
+    /**
+     * Wakes up the readers waiting for new records, if any records have been appended since the last call.
+     */
+    void notifyReaders();
+
+    const string path;
+
+private:
+    void append(uint32_t type, const u16string& path);
+    void evictOldest();
+    uint64_t recordSize(uint64_t offset) const;
+
+    int fd;
+    size_t mappedSize;
+    JournalHeader* header;
+    uint64_t* index;
+    uint8_t* data;
+
+    /**
+     * Offset in the data area where the next record will be written.
+     */
+    uint64_t writeOffset = 0;
+    bool recordsAppended = false;
+};
+
+#endif
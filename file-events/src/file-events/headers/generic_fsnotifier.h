@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <exception>
@@ -9,6 +10,8 @@
 #include <queue>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "exception.h"
@@ -27,8 +30,85 @@ enum class ChangeType {
     INVALIDATED
 };
 
+// Corresponds to values of ChangedFileMetadata.Type
+enum class ChangedFileType {
+    FILE,
+    DIRECTORY,
+    SYMLINK,
+    OTHER
+};
+
+/**
+ * What is known about a changed file when the change is detected, so it doesn't need to be queried again.
+ */
+struct ChangeDetails {
+    /**
+     * Whether the change is about a directory, as reported by the operating system.
+     */
+    bool directory = false;
+
+    /**
+     * Whether the metadata below has been collected. It isn't when the file is gone by the time it is queried.
+     */
+    bool hasMetadata = false;
+    ChangedFileType fileType = ChangedFileType::OTHER;
+    int64_t size = 0;
+
+    /**
+     * The modification time of the file in milliseconds.
+     */
+    int64_t lastModified = 0;
+    int64_t inode = 0;
+};
+
 #define IS_SET(flags, mask) (((flags) & (mask)) != 0)
 
+// Report changes as invalidated parent directories when less than 1/4 of the event queue is free
+#define DIRECTORY_INVALIDATION_THRESHOLD_DIVISOR 4
+// Report changes as invalidated watch roots when less than 1/16 of the event queue is free
+#define ROOT_INVALIDATION_THRESHOLD_DIVISOR 16
+
+// Track a root as needing a rescan instead of tracking more changed paths under it
+#define CHANGE_SET_MAX_PATHS_PER_ROOT 16384
+// Stop tracking changes until the next query, which then needs to rescan everything, when more roots than this changed
+#define CHANGE_SET_MAX_ROOTS 4096
+
+/**
+ * How precisely change events are reported, depending on how full the Java event queue is.
+ */
+enum class ReportingMode {
+    /**
+     * Each change is reported for its own path.
+     */
+    PER_PATH,
+
+    /**
+     * Changes are reported as the parent directory being invalidated.
+     */
+    PER_DIRECTORY,
+
+    /**
+     * Changes are reported as the outermost watched directory containing them being invalidated.
+     */
+    PER_ROOT
+};
+
+/**
+ * One of the event queues on the Java side, with the watch roots under its prefix routed to it.
+ * Each route has its own reporting mode, so a busy route doesn't make the others less precise.
+ */
+struct Route {
+    Route(const u16string& prefix, jint eventQueueCapacity);
+
+    /**
+     * Watch roots under this prefix are routed here, empty for the default route.
+     */
+    const u16string prefix;
+    const jint eventQueueCapacity;
+    ReportingMode reportingMode = ReportingMode::PER_PATH;
+    unordered_set<u16string> invalidatedPaths;
+};
+
 // Throwing a Java exception from native code does not change the program flow.
 // So it may be necessary to throw a native exception as well which then can be catched in the outmost level just before returning to Java.
 // The idea here is that the catch clause for this exception is always empty.
@@ -49,8 +129,10 @@ public:
     AbstractServer(JNIEnv* env, jobject watcherCallback);
     virtual ~AbstractServer();
 
-    virtual void initializeRunLoop() = 0;
-    void executeRunLoop(JNIEnv* env);
+    /**
+     * Starts the native server thread and waits for the given timeout for its run loop to initialize.
+     */
+    bool start(long timeoutInMillis);
 
     /**
      * Registers new watch point with the server for the given paths.
@@ -62,10 +144,22 @@ public:
      */
     virtual bool unregisterPaths(const vector<u16string>& paths) = 0;
 
+    /**
+     * Waits for the given timeout until all events for changes that happened before the call have been reported.
+     */
+    virtual bool awaitPendingEvents(long timeoutInMillis);
+
+    /**
+     * Collects the paths changed since the generation identified by the given token, and starts a new generation.
+     * Roots with too many changes are collected as needing a rescan instead.
+     * Returns false if the changes since the given generation are not known.
+     */
+    bool changesSince(uint64_t token, uint64_t& newToken, vector<u16string>& changedPaths, vector<u16string>& rescanRoots);
+
     /**
      * Shuts the server down.
      */
-    virtual void shutdownRunLoop() = 0;
+    void shutdown();
 
     /**
      * Waits for the given timeout for the server to finsih terminating.
@@ -73,25 +167,92 @@ public:
     bool awaitTermination(long timeoutInMillis);
 
 protected:
+    virtual void initializeRunLoop() = 0;
     virtual void runLoop() = 0;
+    virtual void shutdownRunLoop() = 0;
 
-    void reportChangeEvent(JNIEnv* env, ChangeType type, const u16string& path);
+    /**
+     * Reports a change to the given path under the given watch root.
+     *
+     * When the event queue is filling up, the change might be reported
+     * as the parent directory or the root being invalidated instead.
+     * The details of the change are only reported with precise events.
+     */
+    void reportChangeEvent(JNIEnv* env, ChangeType type, const u16string& path, const u16string& root, const ChangeDetails* details = nullptr);
     void reportUnknownEvent(JNIEnv* env, const u16string& path);
     void reportOverflow(JNIEnv* env, const u16string& path);
     void reportFailure(JNIEnv* env, const exception& ex);
+    void reportSettled(JNIEnv* env, const u16string& path);
+
+    /**
+     * Reports that a watched directory has been moved, and is watched at its new path from now on.
+     */
+    void reportMoved(JNIEnv* env, const u16string& fromPath, const u16string& fromRoot, const u16string& toPath, const u16string& toRoot);
     void reportTermination(JNIEnv* env);
 
+    /**
+     * The path to report as invalidated for changes under the given watch root when the event queue is almost full.
+     * Platforms where nested directories are watched as roots of their own can widen this to the outermost watched ancestor.
+     */
+    virtual u16string invalidationRootFor(const u16string& root);
+
 private:
+    void executeRunLoop();
+
+    void reportInvalidated(JNIEnv* env, Route& route, jint routeIndex, const u16string& path);
+    void deliverChangeEvent(JNIEnv* env, Route& route, jint routeIndex, ChangeType type, const u16string& path, const ChangeDetails* details = nullptr);
+    void updateReportingMode(Route& route, jint remainingQueueCapacity);
+    jint routeFor(const u16string& root);
+    void recordChange(const u16string& path, const u16string& root);
+    void recordOverflow(const u16string& root);
+    bool changeSetOverflowedBy(const u16string& root);
+
+    thread serverThread;
+
+    mutex initializationMutex;
+    condition_variable initializationVariable;
+    bool initialized = false;
+    exception_ptr initializationFailure;
+
+    atomic<bool> shutdownRequested { false };
+
     mutex terminationMutex;
     condition_variable terminationVariable;
     bool terminated = false;
 
+    /**
+     * The routes to event queues, the first one is the default route.
+     */
+    vector<Route> routes;
+
+    /**
+     * The routes of the roots events have been reported for, so each root is only matched against the prefixes once.
+     */
+    unordered_map<u16string, jint> routesByRoot;
+
+    /**
+     * Changes are only tracked once changesSince() has been called.
+     */
+    mutex changeSetMutex;
+    bool trackingChanges = false;
+    uint64_t generation;
+    unordered_map<u16string, unordered_set<u16string>> changedPathsByRoot;
+    unordered_set<u16string> overflowedRoots;
+    /**
+     * Set when too many roots changed to track them, the changes since the last query are unknown then.
+     */
+    bool changeSetOverflowed = false;
+
     JniGlobalRef<jobject> watcherCallback;
     jmethodID watcherReportChangeEventMethod;
+    jmethodID watcherReportDetailedChangeEventMethod;
     jmethodID watcherReportUnknownEventMethod;
     jmethodID watcherReportOverflowMethod;
     jmethodID watcherReportFailureMethod;
+    jmethodID watcherReportSettledMethod;
+    jmethodID watcherReportMovedMethod;
     jmethodID watcherReportTerminationMethod;
+    jmethodID watcherGetRemainingEventQueueCapacityMethod;
 };
 
 class NativePlatformJniConstants : public JniSupport {
@@ -105,5 +266,7 @@ extern NativePlatformJniConstants* nativePlatformJniConstants;
 
 jobject wrapServer(JNIEnv* env, AbstractServer* server);
 
+AbstractServer* getServer(JNIEnv* env, jobject javaServer);
+
 jobject rethrowAsJavaException(JNIEnv* env, const exception& e);
 jobject rethrowAsJavaException(JNIEnv* env, const exception& e, jclass exceptionClass);
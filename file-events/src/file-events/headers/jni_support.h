@@ -36,6 +36,18 @@ protected:
     JavaVM* jvm;
 };
 
+/**
+ * Marks the current native thread as owned by us.
+ *
+ * The thread is only attached to the JVM as a daemon when it first needs a JNI environment,
+ * and it is detached again when the marker goes out of scope.
+ */
+class JniThreadAttacher : public JniSupport {
+public:
+    JniThreadAttacher(JavaVM* jvm, const char* name);
+    ~JniThreadAttacher();
+};
+
 template <typename T>
 class JniGlobalRef : public JniSupport {
 public:
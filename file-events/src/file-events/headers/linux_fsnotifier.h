@@ -3,11 +3,19 @@
 #ifdef __linux__
 
 #include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/eventfd.h>
 #include <sys/inotify.h>
+#include <sys/timerfd.h>
+#include <set>
 #include <unordered_map>
+#include <unordered_set>
 
+#include "event_journal.h"
 #include "generic_fsnotifier.h"
+#include "merkle_tree.h"
+#include "tree_mirror.h"
 #include "net_rubygrapefruit_platform_internal_jni_LinuxFileEventFunctions.h"
 
 using namespace std;
@@ -22,6 +30,11 @@ public:
     InotifyWatchesLimitTooLowException();
 };
 
+// Corresponds to the bits of LinuxFileWatcher.EventKind ordinals
+#define EVENT_KIND_STRUCTURE 0x1
+#define EVENT_KIND_CONTENT 0x2
+#define EVENT_KIND_ALL (EVENT_KIND_STRUCTURE | EVENT_KIND_CONTENT)
+
 class Server;
 
 struct Inotify {
@@ -31,6 +44,17 @@ struct Inotify {
     const int fd;
 };
 
+/**
+ * An O_PATH descriptor of a watched directory, entries are looked up relative to it.
+ * Unlike the path, it keeps referring to the directory when the directory is moved.
+ */
+struct DirectoryHandle {
+    DirectoryHandle(int fd);
+    ~DirectoryHandle();
+
+    const int fd;
+};
+
 struct ShutdownEvent {
     ShutdownEvent();
     ~ShutdownEvent();
@@ -41,6 +65,53 @@ struct ShutdownEvent {
     const int fd;
 };
 
+struct SettledTimer {
+    SettledTimer();
+    ~SettledTimer();
+
+    void schedule(chrono::steady_clock::time_point deadline) const;
+    void consume() const;
+
+    const int fd;
+};
+
+/**
+ * Unix domain socket other processes subscribe to watched roots with.
+ */
+struct SubscriptionSocket {
+    SubscriptionSocket(const string& path);
+    ~SubscriptionSocket();
+
+    const string path;
+    const int fd;
+};
+
+/**
+ * A process connected to the subscription socket.
+ *
+ * The protocol consists of lines of UTF-8 text. The server greets with "JOURNAL <path>", then
+ * the subscriber sends "WATCH <path>", "UNWATCH <path>" or "SYNC" commands. The server answers
+ * each of them with "OK" or "ERROR <message>", "SYNC" is answered with "OK <sequence>" once every
+ * change before it has been written to the journal.
+ */
+struct Subscriber {
+    Subscriber(int fd);
+    ~Subscriber();
+
+    const int fd;
+    string pendingInput;
+    /**
+     * The roots by the path the subscriber has registered them under, with the path they are watched at,
+     * which differs once a watched directory has been moved.
+     */
+    unordered_map<u16string, u16string> roots;
+
+    /**
+     * Sentinels of the SYNC commands waiting to be answered.
+     */
+    vector<uint64_t> pendingSyncs;
+};
+
 enum class WatchPointStatus {
     /**
      * The watch point is listening, expect events to arrive.
@@ -53,6 +124,23 @@ enum class WatchPointStatus {
     CANCELLED
 };
 
+enum class MoveResult {
+    /**
+     * The event is not the part of a move of watched directories.
+     */
+    NOT_MOVED,
+
+    /**
+     * A watched directory has been moved away, handling the event waits until it is known where to.
+     */
+    DEFERRED,
+
+    /**
+     * Watched directories have been moved, and the move has been reported instead of the event.
+     */
+    MOVED
+};
+
 enum class CancelResult {
     /**
      * The watch point was successfully cancelled.
@@ -72,7 +160,7 @@ enum class CancelResult {
 
 class WatchPoint {
 public:
-    WatchPoint(const u16string& path, const shared_ptr<Inotify> inotify, int watchDescriptor);
+    WatchPoint(const u16string& path, const shared_ptr<Inotify> inotify, int watchDescriptor, uint32_t eventMask);
 
     CancelResult cancel();
 
@@ -80,39 +168,226 @@ private:
     WatchPointStatus status;
     const int watchDescriptor;
     const shared_ptr<Inotify> inotify;
-    const u16string path;
+
+    /**
+     * The path of the directory, updated when the directory is moved.
+     */
+    u16string path;
+
+    /**
+     * Set when the watch point has been moved to its new path, and the IN_MOVE_SELF event for it is still expected.
+     */
+    bool moved = false;
+
+    /**
+     * The inotify mask the watch was last added with.
+     */
+    uint32_t eventMask;
+
+    /**
+     * The kinds of changes reported for all entries of the directory, 0 if the directory itself is not registered.
+     * Otherwise only changes to the files in watchedFiles are reported.
+     */
+    int directoryEventKinds = 0;
+
+    /**
+     * Names of the individually registered files in the directory, with the kinds of changes reported for them.
+     */
+    unordered_map<u16string, int> watchedFiles;
+
+    /**
+     * Other registered paths of the same directory, e.g. via symlinks or bind mounts, with the kinds of changes
+     * reported for their entries. They share the watch, as inotify only keeps one watch per directory.
+     */
+    unordered_map<u16string, int> aliases;
+
+    /**
+     * Only opened when change metadata is collected, and null when no descriptor was available for it.
+     */
+    shared_ptr<DirectoryHandle> directory;
 
     friend class Server;
 };
 
 class Server : public AbstractServer {
 public:
-    Server(JNIEnv* env, jobject watcherCallback);
+    Server(JNIEnv* env, jobject watcherCallback, bool trackTreeHashes, bool mirrorWatchedTrees, bool collectChangeMetadata, bool reportCanonicalPathsOnly, bool reportMoves, long settledQuietPeriodInMillis, const string& journalPath, long journalCapacity, const string& subscriptionSocketPath);
+    ~Server();
 
     virtual void registerPaths(const vector<u16string>& paths) override;
+    void registerPaths(const vector<u16string>& paths, int eventKinds);
     virtual bool unregisterPaths(const vector<u16string>& paths) override;
 
+    /**
+     * Unregisters the given path and all registered paths under it.
+     * Returns the number of paths unregistered.
+     */
+    int unregisterPathsUnder(const u16string& root);
+    virtual bool awaitPendingEvents(long timeoutInMillis) override;
+
+    /**
+     * Looks up the current hash of a watched directory, if tree hashes are tracked.
+     */
+    bool getTreeHash(const u16string& path, uint64_t& hash);
+
+    /**
+     * Looks up a path in the mirror of the watched directories, if the mirror is enabled.
+     */
+    MirrorLookup statMirrored(const u16string& path, MirrorEntry& entry);
+    MirrorLookup listMirrored(const u16string& path, vector<pair<string, MirrorEntry>>& entries);
+
 protected:
     void initializeRunLoop() override;
     void runLoop() override;
     void shutdownRunLoop() override;
+    u16string invalidationRootFor(const u16string& root) override;
 
 private:
     void processQueues(int timeout);
     void handleEvents();
-    void handleEvent(JNIEnv* env, const inotify_event* event);
+    void handleEvent(JNIEnv* env, const inotify_event* event, bool deferMoves = true, bool reportToJava = true);
+    void handleDeferredMoveEvent(JNIEnv* env, bool reportToJava);
+    void handleSettledTimer();
+    void updateEntry(const WatchPoint& watchPoint, const char* name);
+    void deliverChange(JNIEnv* env, const WatchPoint& watchPoint, ChangeType type, const u16string& path, u16string root, const u16string& name, const ChangeDetails& details, bool reportToJava);
+    void collectChangeDetails(uint32_t mask, ChangeType type, const WatchPoint& watchPoint, const char* name, ChangeDetails& details) const;
+    MoveResult handleMove(JNIEnv* env, const inotify_event* event, const u16string& path, const u16string& root, uint32_t previousMoveCookie, bool deferMoves);
+    bool hasWatchPointsUnder(const u16string& path) const;
+    vector<u16string> watchPointsUnder(const u16string& path) const;
+    bool canMoveWatchPoints(const u16string& fromPath, const u16string& toPath) const;
+    void moveWatchPoints(const u16string& fromPath, const u16string& toPath);
+    void recordActivity(const u16string& root);
 
-    void registerPath(const u16string& path);
+    void registerPath(const u16string& path, int eventKinds);
+    void registerFile(const u16string& path, int eventKinds);
+    WatchPoint& addWatchPoint(const u16string& path, int eventKinds);
+    void updateEventMask(WatchPoint& watchPoint);
+    uint32_t kernelEventMask(int eventKinds) const;
+    void registerAlias(WatchPoint& watchPoint, const u16string& path, int eventKinds);
     bool unregisterPath(const u16string& path);
+    bool unregisterAlias(const u16string& path);
+    void promoteAlias(const u16string& path);
+    bool unregisterFile(const u16string& path);
+    bool cancelWatchPoint(WatchPoint& watchPoint);
+
+    void createSentinelDirectory();
+    uint64_t createSentinel();
+    void handleSentinelEvent(const inotify_event* event);
+    void releaseSentinelWaiters();
+
+    void acceptSubscriber();
+    bool handleSubscriberInput(Subscriber& subscriber);
+    bool handleSubscriberCommand(Subscriber& subscriber, const string& command);
+    void subscribe(Subscriber& subscriber, const u16string& path);
+    void requestAllEventKinds(const u16string& path);
+    void unsubscribe(Subscriber& subscriber, const u16string& path);
+    void disconnectSubscriber(int fd);
+    void answerSubscriberSyncs();
+    bool isReportedToJava(const u16string& root) const;
+    bool isWatchedRoot(const u16string& path) const;
 
     recursive_mutex mutationMutex;
     unordered_map<u16string, WatchPoint> watchPoints;
+
+    /**
+     * The keys of watchPoints in order, so the watch points under a directory can be found without looking at all of them.
+     */
+    set<u16string> watchPointPaths;
     unordered_map<int, u16string> watchRoots;
     unordered_map<int, u16string> recentlyUnregisteredWatchRoots;
+
+    /**
+     * The paths of the watch points registered paths are aliases of.
+     */
+    unordered_map<u16string, u16string> aliasedWatchPoints;
     const shared_ptr<Inotify> inotify;
     const ShutdownEvent shutdownEvent;
     bool shouldTerminate = false;
     vector<uint8_t> buffer;
+
+    /**
+     * The directory reported by the last IN_MOVED_FROM event, and the watch root it was reported under, waiting
+     * for the IN_MOVED_TO event that immediately follows it if the directory has been moved into a watched directory.
+     */
+    uint32_t pendingMoveCookie = 0;
+    u16string pendingMovePath;
+    u16string pendingMoveRoot;
+
+    /**
+     * A copy of the IN_MOVED_FROM event for a directory containing watch points, held back until the next event,
+     * so the removal isn't reported when the directory has only been moved to another watched directory.
+     */
+    vector<uint8_t> deferredMoveEvent;
+
+    /**
+     * Hashes of the watched directories, only present when requested.
+     */
+    unique_ptr<MerkleTree> merkleTree;
+
+    /**
+     * Entries of the watched directories, only present when requested.
+     */
+    unique_ptr<TreeMirror> mirror;
+
+    /**
+     * Whether to query the metadata of changed files, so it can be reported together with the change.
+     */
+    const bool collectChangeMetadata;
+
+    /**
+     * Whether to report changes to directories with aliases only for the path of their watch point.
+     */
+    const bool reportCanonicalPathsOnly;
+
+    /**
+     * Whether to report moves of watched directories as a single event and keep their watch points.
+     * Otherwise the move is reported as a removal and creation, and the watch points stay at the old paths.
+     */
+    const bool reportMoves;
+
+    /**
+     * Journal of the reported changes, only present when requested.
+     */
+    unique_ptr<EventJournal> journal;
+
+    /**
+     * Reporting settled events is only enabled when there is a quiet period.
+     */
+    const chrono::milliseconds settledQuietPeriod;
+    unique_ptr<SettledTimer> settledTimer;
+
+    /**
+     * Time of the last reported change for each root that hasn't settled since.
+     */
+    unordered_map<u16string, chrono::steady_clock::time_point> lastActivity;
+
+    /**
+     * Other processes subscribing to watched roots, only present when requested.
+     * Changes are delivered to them via the journal.
+     */
+    unique_ptr<SubscriptionSocket> subscriptionSocket;
+    unordered_map<int, unique_ptr<Subscriber>> subscribers;
+
+    /**
+     * The number of subscribers for each root.
+     */
+    unordered_map<u16string, int> subscribedRoots;
+
+    /**
+     * Roots only registered for subscribers, changes to them are not reported to Java.
+     */
+    unordered_set<u16string> subscriberOnlyRoots;
+
+    /**
+     * Private directory we create sentinel files in to find out when the event queue has caught up.
+     * Each sentinel is named after its sequence number.
+     */
+    string sentinelDirectory;
+    int sentinelWatchDescriptor = -1;
+    mutex sentinelMutex;
+    condition_variable sentinelVariable;
+    uint64_t lastRequestedSentinel = 0;
+    uint64_t lastDeliveredSentinel = 0;
 };
 
 class LinuxJniConstants : public JniSupport {
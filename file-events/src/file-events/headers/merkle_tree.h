@@ -0,0 +1,105 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+/**
+ * Metadata of a single entry of a tracked directory.
+ */
+struct MerkleEntry {
+    /**
+     * The file type bits of st_mode.
+     */
+    uint32_t type;
+
+    /**
+     * The size of the entry, always 0 for directories.
+     */
+    int64_t size;
+
+    /**
+     * The modification time of the entry in nanoseconds, always 0 for directories.
+     */
+    int64_t lastModified;
+
+    /**
+     * The hash of the child directory if it is tracked itself, 0 otherwise.
+     */
+    uint64_t childHash;
+
+    /**
+     * The hash of the entry's name and all of the above.
+     */
+    uint64_t hash;
+};
+
+struct MerkleDirectory {
+    unordered_map<string, MerkleEntry> entries;
+
+    /**
+     * Order-independent combination of the entry hashes, so a single entry can be updated
+     * without rehashing its siblings.
+     */
+    uint64_t entryHashSum = 0;
+
+    uint64_t hash = 0;
+};
+
+/**
+ * Hashes of the contents of watched directories, combined with the hashes of
+ * their watched subdirectories.
+ *
+ * A change to an entry only updates the hash of its directory and the hashes of
+ * the directory's tracked ancestors, so the cost is proportional to the depth of
+ * the change, not to the size of the tree. Looking up the hash of a directory is
+ * a single map lookup.
+ *
+ * Not thread-safe, callers need to synchronize access.
+ */
+class MerkleTree {
+public:
+    /**
+     * Starts tracking the given directory by scanning its entries.
+     */
+    void addDirectory(const u16string& path);
+
+    /**
+     * Stops tracking the given directory.
+     */
+    void removeDirectory(const u16string& path);
+
+    /**
+     * Continues tracking a directory that has been moved under its new path.
+     * The entries in the parent directories are updated by the events for the move.
+     */
+    void moveDirectory(const u16string& fromPath, const u16string& toPath);
+
+    /**
+     * Updates the hash of the given entry in a tracked directory after it has changed.
+     */
+    void updateEntry(const u16string& directoryPath, const string& name);
+
+    /**
+     * Rescans all tracked directories, e.g. after changes have been lost.
+     */
+    void rescan();
+
+    /**
+     * Looks up the current hash of a tracked directory.
+     */
+    bool getHash(const u16string& path, uint64_t& hash) const;
+
+private:
+    void scan(const u16string& path, MerkleDirectory& directory);
+    void setEntry(MerkleDirectory& directory, const string& name, const MerkleEntry* entry);
+    void updateDirectoryHash(const u16string& path, MerkleDirectory& directory);
+    void propagateToParent(const u16string& path, uint64_t childHash);
+
+    unordered_map<u16string, MerkleDirectory> directories;
+};
+
+#endif
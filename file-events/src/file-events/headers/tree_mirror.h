@@ -0,0 +1,84 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Corresponds to values of MirroredFile.Type
+enum class MirroredType {
+    FILE,
+    DIRECTORY,
+    SYMLINK,
+    OTHER,
+    MISSING
+};
+
+struct MirrorEntry {
+    MirroredType type;
+    int64_t size;
+
+    /**
+     * The modification time of the entry in milliseconds.
+     */
+    int64_t lastModified;
+};
+
+struct MirrorDirectory {
+    /**
+     * Entries are only listed when the directory is first queried.
+     */
+    bool listed = false;
+    unordered_map<string, MirrorEntry> entries;
+};
+
+enum class MirrorLookup {
+    /**
+     * The path is not inside a watched directory, the file system needs to be queried.
+     */
+    NOT_MIRRORED,
+
+    /**
+     * The path has been found in the mirror.
+     */
+    FOUND
+};
+
+/**
+ * Metadata of the entries of watched directories, kept in memory so it can be queried
+ * without accessing the file system.
+ *
+ * A directory is listed the first time it is queried, and then kept up-to-date
+ * by the changes reported for it. Names missing from a listed directory are known not to exist.
+ *
+ * Not thread-safe, callers need to synchronize access.
+ */
+class TreeMirror {
+public:
+    void addDirectory(const u16string& path);
+    void removeDirectory(const u16string& path);
+    void moveDirectory(const u16string& fromPath, const u16string& toPath);
+
+    /**
+     * Updates the given entry of a watched directory, if it has been listed already.
+     */
+    void updateEntry(const u16string& directoryPath, const string& name);
+
+    /**
+     * Forgets all listings, e.g. after changes have been lost.
+     */
+    void invalidate();
+
+    MirrorLookup stat(const u16string& path, MirrorEntry& entry);
+    MirrorLookup list(const u16string& directoryPath, vector<pair<string, MirrorEntry>>& entries);
+
+private:
+    MirrorDirectory* findListedDirectory(const u16string& path);
+
+    unordered_map<u16string, MirrorDirectory> directories;
+};
+
+#endif
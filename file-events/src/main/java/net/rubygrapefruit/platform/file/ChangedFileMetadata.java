@@ -0,0 +1,57 @@
+package net.rubygrapefruit.platform.file;
+
+/**
+ * Metadata of a changed file, queried by the watcher right after detecting the change.
+ *
+ * @see FileWatchEvent.MetadataHandler
+ */
+public final class ChangedFileMetadata {
+    public enum Type {
+        FILE,
+        DIRECTORY,
+        SYMLINK,
+        OTHER
+    }
+
+    private final Type type;
+    private final long size;
+    private final long lastModified;
+    private final long inode;
+
+    public ChangedFileMetadata(Type type, long size, long lastModified, long inode) {
+        this.type = type;
+        this.size = size;
+        this.lastModified = lastModified;
+        this.inode = inode;
+    }
+
+    /**
+     * Returns the type of the file. Symlinks are not followed.
+     */
+    public Type getType() {
+        return type;
+    }
+
+    /**
+     * Returns the size of the file in bytes, 0 for anything but regular files.
+     */
+    public long getSize() {
+        return size;
+    }
+
+    /**
+     * Returns the last modification time of the file in milliseconds since the epoch.
+     */
+    public long getLastModified() {
+        return lastModified;
+    }
+
+    public long getInode() {
+        return inode;
+    }
+
+    @Override
+    public String toString() {
+        return type + " (size: " + size + ", inode: " + inode + ")";
+    }
+}
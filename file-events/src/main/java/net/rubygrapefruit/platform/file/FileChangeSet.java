@@ -0,0 +1,61 @@
+package net.rubygrapefruit.platform.file;
+
+import java.util.Collections;
+import java.util.Set;
+
+/**
+ * The paths that changed between two calls to {@link FileWatcher#changesSince(long)}.
+ */
+public final class FileChangeSet {
+    /**
+     * Token to use for the first query, for which all changes are unknown.
+     */
+    public static final long NO_TOKEN = 0;
+
+    private final long token;
+    private final boolean complete;
+    private final Set<String> changedPaths;
+    private final Set<String> rootsToRescan;
+
+    public FileChangeSet(long token, boolean complete, Set<String> changedPaths, Set<String> rootsToRescan) {
+        this.token = token;
+        this.complete = complete;
+        this.changedPaths = Collections.unmodifiableSet(changedPaths);
+        this.rootsToRescan = Collections.unmodifiableSet(rootsToRescan);
+    }
+
+    /**
+     * Returns the token to pass to the next query to get the changes since this one.
+     */
+    public long getToken() {
+        return token;
+    }
+
+    /**
+     * Returns {@code false} if the changes are unknown, and thus all watched paths need to be rescanned.
+     */
+    public boolean isComplete() {
+        return complete;
+    }
+
+    /**
+     * Returns the changed paths, excluding the ones under {@link #getRootsToRescan() roots to rescan}.
+     */
+    public Set<String> getChangedPaths() {
+        return changedPaths;
+    }
+
+    /**
+     * Returns the watched roots that had too many changes to track them individually.
+     */
+    public Set<String> getRootsToRescan() {
+        return rootsToRescan;
+    }
+
+    @Override
+    public String toString() {
+        return complete
+            ? "changed " + changedPaths + ", rescan " + rootsToRescan
+            : "unknown changes";
+    }
+}
@@ -0,0 +1,167 @@
+package net.rubygrapefruit.platform.file;
+
+import net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType;
+import net.rubygrapefruit.platform.internal.jni.FileEventJournalFunctions;
+
+import java.io.Closeable;
+import java.io.File;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.MappedByteBuffer;
+import java.nio.channels.FileChannel;
+import java.nio.charset.Charset;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Reads the journal of changes written by a file watcher.
+ *
+ * <p>The journal is memory-mapped, so any number of readers, also in different processes,
+ * can read it while the watcher is appending to it. Each record has a sequence number,
+ * which can be used to continue reading where a reader left off. The journal is bounded,
+ * so records that have not been read for a long time may have been dropped.</p>
+ *
+ * <p>A journal needs to be reopened when the watcher writing it has been restarted.</p>
+ *
+ * <p>The sequence numbers are read via the native library, so they are read with the memory ordering they are
+ * written with, which plain reads from the mapped buffer don't guarantee.</p>
+ */
+public class FileEventJournal implements Closeable {
+    private static final int MAGIC = 0x4a454546;
+    private static final int VERSION = 1;
+    private static final int HEADER_SIZE = 64;
+    private static final int RECORD_HEADER_SIZE = 16;
+    private static final int OVERFLOW_RECORD_TYPE = 4;
+    private static final Charset UTF_8 = Charset.forName("UTF-8");
+
+    private final RandomAccessFile file;
+    private final MappedByteBuffer buffer;
+    private final long indexCapacity;
+    private final int indexOffset;
+    private final int dataOffset;
+
+    public static FileEventJournal open(File journalFile) throws IOException {
+        FileEvents.init(null);
+        RandomAccessFile file = new RandomAccessFile(journalFile, "r");
+        try {
+            return new FileEventJournal(journalFile, file);
+        } catch (IOException e) {
+            file.close();
+            throw e;
+        } catch (RuntimeException e) {
+            file.close();
+            throw e;
+        }
+    }
+
+    private FileEventJournal(File journalFile, RandomAccessFile file) throws IOException {
+        this.file = file;
+        this.buffer = file.getChannel().map(FileChannel.MapMode.READ_ONLY, 0, file.length());
+        // Written by the native side in the native byte order
+        buffer.order(ByteOrder.nativeOrder());
+        if (buffer.capacity() < HEADER_SIZE || buffer.getInt(0) != MAGIC || buffer.getInt(4) != VERSION) {
+            throw new IOException("Not a file event journal: " + journalFile);
+        }
+        long dataCapacity = buffer.getLong(8);
+        this.indexCapacity = buffer.getLong(16);
+        this.indexOffset = HEADER_SIZE;
+        this.dataOffset = (int) (indexOffset + indexCapacity * 8);
+        if (dataOffset + dataCapacity > buffer.capacity()) {
+            throw new IOException("Journal has been truncated: " + journalFile);
+        }
+    }
+
+    /**
+     * Returns the sequence number of the oldest record that can still be read.
+     */
+    public long getOldestSequence() {
+        return FileEventJournalFunctions.getOldestSequence0(buffer);
+    }
+
+    /**
+     * Returns the sequence number the next record will be written with.
+     */
+    public long getNextSequence() {
+        return FileEventJournalFunctions.getNextSequence0(buffer);
+    }
+
+    /**
+     * Waits until the record with the given sequence number has been written, or the timeout expires.
+     * The watcher wakes up waiting readers after writing each batch of records.
+     *
+     * @return whether the record has been written.
+     */
+    public boolean awaitRecords(long fromSequence, long timeout, TimeUnit unit) {
+        return FileEventJournalFunctions.awaitRecords0(buffer, fromSequence, unit.toMillis(timeout));
+    }
+
+    /**
+     * Reads the records starting with the given sequence number.
+     *
+     * @param fromSequence the sequence number of the first record to read.
+     * @param maxRecords the maximum number of records to read.
+     * @return the sequence number of the next record to read.
+     */
+    public long read(long fromSequence, int maxRecords, RecordHandler handler) {
+        long sequence = fromSequence;
+        int recordsRead = 0;
+        while (recordsRead < maxRecords) {
+            long oldestSequence = getOldestSequence();
+            if (sequence < oldestSequence) {
+                handler.handleRecordsLost(sequence, oldestSequence);
+                sequence = oldestSequence;
+            }
+            if (sequence >= getNextSequence()) {
+                break;
+            }
+            int offset = dataOffset + (int) buffer.getLong(indexOffset + (int) (sequence % indexCapacity) * 8);
+            long recordSequence = buffer.getLong(offset);
+            int pathLength = buffer.getInt(offset + 8);
+            int type = buffer.getInt(offset + 12);
+            String path = null;
+            if (recordSequence == sequence && pathLength >= 0 && offset + RECORD_HEADER_SIZE + pathLength <= buffer.capacity()) {
+                byte[] pathBytes = new byte[pathLength];
+                ByteBuffer pathBuffer = buffer.duplicate();
+                pathBuffer.position(offset + RECORD_HEADER_SIZE);
+                pathBuffer.get(pathBytes);
+                path = new String(pathBytes, UTF_8);
+            }
+            // The record might have been overwritten while we were reading it
+            if (sequence < getOldestSequence()) {
+                continue;
+            }
+            if (path == null) {
+                throw new IllegalStateException("Corrupt record " + sequence + " in journal");
+            }
+            if (type == OVERFLOW_RECORD_TYPE) {
+                handler.handleOverflow(sequence, path);
+            } else {
+                handler.handleChange(sequence, ChangeType.values()[type], path);
+            }
+            sequence++;
+            recordsRead++;
+        }
+        return sequence;
+    }
+
+    @Override
+    public void close() throws IOException {
+        file.close();
+    }
+
+    public interface RecordHandler {
+        void handleChange(long sequence, ChangeType type, String absolutePath);
+
+        /**
+         * Changes under the given path have been lost.
+         */
+        void handleOverflow(long sequence, String absolutePath);
+
+        /**
+         * Records from {@code fromSequence} (inclusive) to {@code toSequence} (exclusive) have been dropped
+         * from the journal before they could be read.
+         */
+        void handleRecordsLost(long fromSequence, long toSequence);
+    }
+}
@@ -18,6 +18,43 @@ public interface FileWatchEvent {
         void handleTerminated();
     }
 
+    /**
+     * A handler that also receives what the watcher knows about changed files.
+     * Changes without any details, and all changes for other handlers, are reported via
+     * {@link Handler#handleChangeEvent(ChangeType, String)}. Only reported on Linux.
+     */
+    interface MetadataHandler extends Handler {
+        /**
+         * @param directory whether the change is about a directory, as reported by the operating system.
+         * @param metadata the metadata of the file right after the change, if the watcher has been asked to collect it,
+         * and the file still existed.
+         */
+        void handleChangeEvent(ChangeType type, String absolutePath, boolean directory, @Nullable ChangedFileMetadata metadata);
+    }
+
+    /**
+     * A handler that also receives settled events. Other handlers ignore them. Only reported on Linux.
+     */
+    interface SettledHandler extends Handler {
+        /**
+         * No changes have been reported for the given watched path for the configured quiet period.
+         */
+        void handleSettled(String absolutePath);
+    }
+
+    /**
+     * A handler that receives moves of watched directories as a single event.
+     * Other handlers receive the move as the directory being removed and created. Only reported on Linux,
+     * by watchers built with {@link net.rubygrapefruit.platform.internal.jni.LinuxFileEventFunctions.WatcherBuilder#withMoveEvents()}.
+     */
+    interface MoveHandler extends Handler {
+        /**
+         * A watched directory has been moved to a watched directory. It is watched at its new path from now on,
+         * together with the watched directories under it.
+         */
+        void handleMoved(String fromAbsolutePath, String toAbsolutePath);
+    }
+
     enum ChangeType {
         /**
          * An item with the given path has been created.
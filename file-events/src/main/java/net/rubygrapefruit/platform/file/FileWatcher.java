@@ -18,6 +18,32 @@ public interface FileWatcher {
     @CheckReturnValue
     boolean stopWatching(Collection<File> paths);
 
+    /**
+     * Blocks until all events about changes that happened before this call have been
+     * delivered to the event queue, or the timeout occurs, or the current thread is interrupted,
+     * whichever happens first.
+     *
+     * <p>This is currently only supported on Linux.</p>
+     *
+     * @param timeout the maximum time to wait
+     * @param unit the time unit of the timeout argument
+     * @return {@code true} if all pending events have been delivered and
+     *         {@code false} if the timeout elapsed before that
+     * @throws InterruptedException if interrupted while waiting
+     */
+    @CheckReturnValue
+    boolean awaitPendingEvents(long timeout, TimeUnit unit) throws InterruptedException;
+
+    /**
+     * Returns the paths that changed since the query that returned the given token,
+     * and starts collecting changes for the next query.
+     *
+     * <p>Changes are only collected after the first query, which should use {@link FileChangeSet#NO_TOKEN}.
+     * Only the token returned by the latest query is valid, for any other token the changes are unknown.
+     * Changes are collected natively with a bounded number of paths per watched root.</p>
+     */
+    FileChangeSet changesSince(long token);
+
     /**
      * Initiates an orderly shutdown and release of any native resources.
      * No more events will arrive after this method returns.
@@ -0,0 +1,96 @@
+package net.rubygrapefruit.platform.file;
+
+import net.rubygrapefruit.platform.internal.jni.InsufficientResourcesForWatchingException;
+
+import javax.annotation.Nullable;
+import javax.annotation.concurrent.NotThreadSafe;
+import java.io.File;
+import java.util.Collection;
+import java.util.List;
+import java.util.Set;
+
+/**
+ * A {@link FileWatcher} with capabilities only available on Linux.
+ */
+@NotThreadSafe
+public interface LinuxFileWatcher extends FileWatcher {
+    /**
+     * Kinds of changes to watch for.
+     */
+    enum EventKind {
+        /**
+         * Entries being created, removed or renamed.
+         */
+        STRUCTURE,
+
+        /**
+         * Contents of files being modified.
+         */
+        CONTENT
+    }
+
+    /**
+     * Starts watching the given paths, only reporting the given kinds of changes for them.
+     * The kernel does not generate events for other kinds of changes, unless they are
+     * needed for other watched paths in the same directory, for tree hashes or for the mirror.
+     *
+     * <p>Removal of a watched directory itself is always reported.</p>
+     *
+     * @see #startWatching(Collection)
+     */
+    void startWatching(Collection<File> paths, Set<EventKind> eventKinds) throws InsufficientResourcesForWatchingException;
+
+    /**
+     * Stops watching the given path and all watched paths under it.
+     *
+     * <p>The paths are looked up on the native side, so this is a single cheap call even when
+     * thousands of paths are watched under the root, e.g. when closing a project.</p>
+     *
+     * @return the number of paths that are no longer watched.
+     * @see #stopWatching(Collection)
+     */
+    int stopWatchingUnder(File root);
+
+    /**
+     * Returns the current hash of a watched directory.
+     *
+     * <p>The hash covers the names, types, sizes and modification times of the entries of the directory,
+     * and the hashes of the subdirectories that are watched as well. It is kept up-to-date
+     * incrementally as changes are reported, so querying it does not access the file system.</p>
+     *
+     * <p>The hash is only meant to be compared to other hashes from the same watcher.</p>
+     *
+     * @return the hash, or {@code null} if the directory is not watched or tree hashing is not enabled
+     * for this watcher.
+     */
+    @Nullable
+    Long getTreeHash(File directory);
+
+    /**
+     * Looks up the metadata of a file in the mirror of the watched directories.
+     *
+     * <p>Entries of a watched directory are listed the first time they are queried, and are then kept
+     * up-to-date as changes are reported. Files in a watched directory, and files under a path that is
+     * known not to exist in a watched directory, are answered from memory, including the ones
+     * that don't exist.</p>
+     *
+     * <p>The mirror is updated when the watcher handles the events from the operating system, so it doesn't reflect
+     * changes whose events are still queued in the kernel. Call {@link #awaitPendingEvents(long, java.util.concurrent.TimeUnit)} first
+     * to make sure changes made before the call are included.</p>
+     *
+     * @return the metadata, or {@code null} if the file is not in a watched directory or the mirror
+     * is not enabled for this watcher. Then the file system needs to be queried instead.
+     */
+    @Nullable
+    MirroredFile stat(File file);
+
+    /**
+     * Lists the entries of a watched directory from the mirror of the watched directories.
+     *
+     * @return the entries in no particular order, or {@code null} if the directory is not watched,
+     * can't be listed or the mirror is not enabled for this watcher.
+     * @see #stat(File)
+     */
+    @Nullable
+    List<MirroredFile> listDir(File directory);
+}
@@ -0,0 +1,61 @@
+package net.rubygrapefruit.platform.file;
+
+/**
+ * Metadata of a file as mirrored by a {@link LinuxFileWatcher}.
+ */
+public final class MirroredFile {
+    public enum Type {
+        FILE,
+        DIRECTORY,
+        SYMLINK,
+        OTHER,
+
+        /**
+         * The file does not exist.
+         */
+        MISSING
+    }
+
+    private final String name;
+    private final Type type;
+    private final long size;
+    private final long lastModified;
+
+    public MirroredFile(String name, Type type, long size, long lastModified) {
+        this.name = name;
+        this.type = type;
+        this.size = size;
+        this.lastModified = lastModified;
+    }
+
+    /**
+     * Returns the name of the file, without its parent directory.
+     */
+    public String getName() {
+        return name;
+    }
+
+    public Type getType() {
+        return type;
+    }
+
+    /**
+     * Returns the size of the file in bytes, 0 for anything but regular files.
+     */
+    public long getSize() {
+        return size;
+    }
+
+    /**
+     * Returns the last modification time of the file in milliseconds since the epoch.
+     * Symlinks are not followed.
+     */
+    public long getLastModified() {
+        return lastModified;
+    }
+
+    @Override
+    public String toString() {
+        return name + " (" + type + ")";
+    }
+}
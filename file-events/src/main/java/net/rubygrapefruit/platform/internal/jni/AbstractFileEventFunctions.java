@@ -2,15 +2,22 @@ package net.rubygrapefruit.platform.internal.jni;
 
 import net.rubygrapefruit.platform.NativeException;
 import net.rubygrapefruit.platform.NativeIntegration;
+import net.rubygrapefruit.platform.file.ChangedFileMetadata;
+import net.rubygrapefruit.platform.file.FileChangeSet;
 import net.rubygrapefruit.platform.file.FileWatchEvent;
 import net.rubygrapefruit.platform.file.FileWatchEvent.OverflowType;
 import net.rubygrapefruit.platform.file.FileWatcher;
 
 import javax.annotation.Nullable;
 import java.io.File;
+import java.util.ArrayList;
 import java.util.Collection;
+import java.util.HashSet;
+import java.util.LinkedHashMap;
+import java.util.List;
+import java.util.Map;
+import java.util.Set;
 import java.util.concurrent.BlockingQueue;
-import java.util.concurrent.CountDownLatch;
 import java.util.concurrent.TimeUnit;
 
 import static java.util.concurrent.TimeUnit.SECONDS;
@@ -36,11 +43,29 @@ public abstract class AbstractFileEventFunctions implements NativeIntegration {
         public static final long DEFAULT_START_TIMEOUT_IN_SECONDS = 5;
 
         private final BlockingQueue<FileWatchEvent> eventQueue;
+        private final Map<String, BlockingQueue<FileWatchEvent>> routes = new LinkedHashMap<String, BlockingQueue<FileWatchEvent>>();
 
         public AbstractWatcherBuilder(BlockingQueue<FileWatchEvent> eventQueue) {
             this.eventQueue = eventQueue;
         }
 
+        /**
+         * Report events for watch roots under the given directory to a separate queue.
+         *
+         * The routing is decided on the native side for each watch root, so consumers of one queue
+         * don't have to filter out the events of the others, and a slow consumer only makes the events
+         * in its own queue less precise. When prefixes are nested, the longest one wins.
+         * Events for roots not under any of the prefixes go to the queue passed to the builder.
+         * Failures and the termination of the watcher are reported to all queues.
+         *
+         * @param rootPrefix the directory the watch roots need to be in, or be equal to.
+         * @param queue the queue for the events, with the same requirements as the default queue.
+         */
+        public AbstractWatcherBuilder withRoute(File rootPrefix, BlockingQueue<FileWatchEvent> queue) {
+            routes.put(rootPrefix.getAbsolutePath(), queue);
+            return this;
+        }
+
         /**
          * Start the file watcher.
          *
@@ -64,12 +89,20 @@ public abstract class AbstractFileEventFunctions implements NativeIntegration {
          * @see FileWatcher#startWatching(Collection)
          */
         public FileWatcher start(long startTimeout, TimeUnit startTimeoutUnit) throws InterruptedException, InsufficientResourcesForWatchingException {
-            NativeFileWatcherCallback callback = new NativeFileWatcherCallback(eventQueue);
+            NativeFileWatcherCallback callback = new NativeFileWatcherCallback(eventQueue, routes);
             Object server = startWatcher(callback);
-            return new NativeFileWatcher(server, startTimeout, startTimeoutUnit, callback);
+            return createWatcher(server, startTimeout, startTimeoutUnit);
+        }
+
+        protected BlockingQueue<FileWatchEvent> getEventQueue() {
+            return eventQueue;
         }
 
         protected abstract Object startWatcher(NativeFileWatcherCallback callback);
+
+        protected FileWatcher createWatcher(Object server, long startTimeout, TimeUnit startTimeoutUnit) {
+            return new NativeFileWatcher(server, startTimeout, startTimeoutUnit);
+        }
     }
 
     /**
@@ -77,62 +110,139 @@ public abstract class AbstractFileEventFunctions implements NativeIntegration {
      * Call {@link AbstractWatcherBuilder#start()} to actually start the {@link FileWatcher}.
      *
      * The queue must have a total capacity of at least 2 elements.
+     * When a bounded queue is filling up, changes are reported as {@link FileWatchEvent.ChangeType#INVALIDATED}
+     * events for their parent directories, and then for the outermost watched directories containing them, instead of individually.
+     * Changes are reported individually again once the queue has been drained.
      * The caller should only consume events from the queue, and never add any of their own.
+     * Events for some of the watch roots can be sent to other queues via {@link AbstractWatcherBuilder#withRoute(File, BlockingQueue)}.
      */
     public abstract AbstractWatcherBuilder newWatcher(BlockingQueue<FileWatchEvent> queue);
 
     protected static class NativeFileWatcherCallback {
 
-        private final BlockingQueue<FileWatchEvent> eventQueue;
+        /**
+         * The queues events are routed to, the first one is the default queue.
+         */
+        private final List<BlockingQueue<FileWatchEvent>> eventQueues = new ArrayList<BlockingQueue<FileWatchEvent>>();
+        private final String[] routePrefixes;
 
         public NativeFileWatcherCallback(BlockingQueue<FileWatchEvent> eventQueue) {
-            this.eventQueue = eventQueue;
+            this(eventQueue, new LinkedHashMap<String, BlockingQueue<FileWatchEvent>>());
+        }
+
+        public NativeFileWatcherCallback(BlockingQueue<FileWatchEvent> eventQueue, Map<String, BlockingQueue<FileWatchEvent>> routes) {
+            this.eventQueues.add(eventQueue);
+            this.eventQueues.addAll(routes.values());
+            this.routePrefixes = routes.keySet().toArray(new String[0]);
+        }
+
+        // Called from the native side
+        // Returns the prefixes of the routes after the default one, in the order of their indexes
+        @SuppressWarnings("unused")
+        public String[] getRoutePrefixes() {
+            return routePrefixes;
+        }
+
+        // Called from the native side
+        @SuppressWarnings("unused")
+        public int getEventQueueCapacity(int route) {
+            BlockingQueue<FileWatchEvent> eventQueue = eventQueues.get(route);
+            int remainingCapacity = eventQueue.remainingCapacity();
+            return remainingCapacity == Integer.MAX_VALUE
+                ? remainingCapacity
+                : eventQueue.size() + remainingCapacity;
+        }
+
+        // Called from the native side
+        // Lets less precise reporting stop once the consumer has caught up, even when nothing else is delivered
+        @SuppressWarnings("unused")
+        public int getRemainingEventQueueCapacity(int route) {
+            return eventQueues.get(route).remainingCapacity();
         }
 
         // Called from the native side
+        // Returns the remaining capacity so less precise events can be reported when the queue is filling up
         @SuppressWarnings("unused")
-        public void reportChangeEvent(int typeIndex, String path) {
+        public int reportChangeEvent(int typeIndex, String path, int route) {
             FileWatchEvent.ChangeType type = FileWatchEvent.ChangeType.values()[typeIndex];
-            queueEvent(new ChangeEvent(type, path), false);
+            BlockingQueue<FileWatchEvent> eventQueue = eventQueues.get(route);
+            queueEvent(eventQueue, new ChangeEvent(type, path), false);
+            return eventQueue.remainingCapacity();
         }
 
         // Called from the native side
+        // A negative file type index means that no metadata has been collected
         @SuppressWarnings("unused")
-        public void reportUnknownEvent(String path) {
-            queueEvent(new UnknownEvent(path), false);
+        public int reportChangeEvent(int typeIndex, String path, int route, boolean directory, int fileTypeIndex, long size, long lastModified, long inode) {
+            FileWatchEvent.ChangeType type = FileWatchEvent.ChangeType.values()[typeIndex];
+            ChangedFileMetadata metadata = fileTypeIndex < 0
+                ? null
+                : new ChangedFileMetadata(ChangedFileMetadata.Type.values()[fileTypeIndex], size, lastModified, inode);
+            BlockingQueue<FileWatchEvent> eventQueue = eventQueues.get(route);
+            queueEvent(eventQueue, new DetailedChangeEvent(type, path, directory, metadata), false);
+            return eventQueue.remainingCapacity();
         }
 
         // Called from the native side
         @SuppressWarnings("unused")
-        public void reportOverflow(@Nullable String path) {
-            signalOverflow(OverflowType.OPERATING_SYSTEM, path);
+        public void reportUnknownEvent(String path, int route) {
+            queueEvent(eventQueues.get(route), new UnknownEvent(path), false);
+        }
+
+        // Called from the native side
+        @SuppressWarnings("unused")
+        public void reportOverflow(@Nullable String path, int route) {
+            if (path == null) {
+                // We don't know which roots are affected
+                for (BlockingQueue<FileWatchEvent> eventQueue : eventQueues) {
+                    signalOverflow(eventQueue, OverflowType.OPERATING_SYSTEM, null);
+                }
+            } else {
+                signalOverflow(eventQueues.get(route), OverflowType.OPERATING_SYSTEM, path);
+            }
         }
 
         // Called from the native side
         @SuppressWarnings("unused")
         public void reportFailure(Throwable ex) {
-            queueEvent(new FailureEvent(ex), true);
+            for (BlockingQueue<FileWatchEvent> eventQueue : eventQueues) {
+                queueEvent(eventQueue, new FailureEvent(ex), true);
+            }
+        }
+
+        // Called from the native side
+        @SuppressWarnings("unused")
+        public void reportSettled(String path, int route) {
+            queueEvent(eventQueues.get(route), new SettledEvent(path), false);
+        }
+
+        // Called from the native side
+        @SuppressWarnings("unused")
+        public void reportMoved(String fromPath, String toPath, int route) {
+            queueEvent(eventQueues.get(route), new MovedEvent(fromPath, toPath), false);
         }
 
         // Called from the native side
         @SuppressWarnings("unused")
         public void reportTermination() {
-            queueEvent(TerminationEvent.INSTANCE, true);
+            for (BlockingQueue<FileWatchEvent> eventQueue : eventQueues) {
+                queueEvent(eventQueue, TerminationEvent.INSTANCE, true);
+            }
         }
 
-        private void queueEvent(FileWatchEvent event, boolean deliverOnOverflow) {
+        private void queueEvent(BlockingQueue<FileWatchEvent> eventQueue, FileWatchEvent event, boolean deliverOnOverflow) {
             if (!eventQueue.offer(event)) {
                 NativeLogger.LOGGER.info("Event queue overflow, dropping all events");
-                signalOverflow(OverflowType.EVENT_QUEUE, null);
+                signalOverflow(eventQueue, OverflowType.EVENT_QUEUE, null);
                 if (deliverOnOverflow) {
-                    forceQueueEvent(event);
+                    forceQueueEvent(eventQueue, event);
                 }
             }
         }
 
-        private void signalOverflow(OverflowType type, @Nullable String path) {
+        private void signalOverflow(BlockingQueue<FileWatchEvent> eventQueue, OverflowType type, @Nullable String path) {
             eventQueue.clear();
-            forceQueueEvent(new OverflowEvent(type, path));
+            forceQueueEvent(eventQueue, new OverflowEvent(type, path));
         }
 
         /**
@@ -146,7 +256,7 @@ public abstract class AbstractFileEventFunctions implements NativeIntegration {
          * Both a queue with a less than two element capacity and pushing events from user code
          * are forbidden. If they occur the best we can do is log the situation.
          */
-        private void forceQueueEvent(FileWatchEvent event) {
+        private void forceQueueEvent(BlockingQueue<FileWatchEvent> eventQueue, FileWatchEvent event) {
             boolean eventPublished = eventQueue.offer(event);
             if (!eventPublished) {
                 NativeLogger.LOGGER.severe("Couldn't queue event: " + event);
@@ -155,40 +265,19 @@ public abstract class AbstractFileEventFunctions implements NativeIntegration {
     }
 
     protected static class NativeFileWatcher implements FileWatcher {
-        private final Object server;
-        private final Thread processorThread;
+        protected final Object server;
         private boolean shutdown;
 
-        public NativeFileWatcher(final Object server, long startTimeout, TimeUnit startTimeoutUnit, final NativeFileWatcherCallback callback) throws InterruptedException {
+        public NativeFileWatcher(Object server, long startTimeout, TimeUnit startTimeoutUnit) {
             this.server = server;
-            final CountDownLatch runLoopInitialized = new CountDownLatch(1);
-            this.processorThread = new Thread("File watcher server") {
-                @Override
-                public void run() {
-                    initializeRunLoop0(server);
-                    runLoopInitialized.countDown();
-                    try {
-                        executeRunLoop0(server);
-                        if (!shutdown) {
-                            callback.reportFailure(new FileWatcherException("File watcher server did exit without being shutdown"));
-                        }
-                    } catch (Throwable e) {
-                        callback.reportFailure(e);
-                    }
-                }
-            };
-            this.processorThread.setDaemon(true);
-            this.processorThread.start();
-            boolean started = runLoopInitialized.await(startTimeout, startTimeoutUnit);
+            boolean started = start0(server, startTimeoutUnit.toMillis(startTimeout));
             if (!started) {
                 // Note: we don't close here because we have no idea what state the native backend is in
                 throw new FileWatcherTimeoutException("Starting the watcher timed out");
             }
         }
 
-        private native void initializeRunLoop0(Object server);
-
-        private native void executeRunLoop0(Object server);
+        private native boolean start0(Object server, long startTimeoutInMillis);
 
         @Override
         public void startWatching(Collection<File> paths) {
@@ -206,7 +295,15 @@ public abstract class AbstractFileEventFunctions implements NativeIntegration {
 
         private native boolean stopWatching0(Object server, String[] absolutePaths);
 
-        private static String[] toAbsolutePaths(Collection<File> files) {
+        @Override
+        public boolean awaitPendingEvents(long timeout, TimeUnit unit) throws InterruptedException {
+            ensureOpen();
+            return awaitPendingEvents0(server, unit.toMillis(timeout));
+        }
+
+        private native boolean awaitPendingEvents0(Object server, long timeoutInMillis);
+
+        protected static String[] toAbsolutePaths(Collection<File> files) {
             String[] paths = new String[files.size()];
             int index = 0;
             for (File file : files) {
@@ -215,6 +312,33 @@ public abstract class AbstractFileEventFunctions implements NativeIntegration {
             return paths;
         }
 
+        @Override
+        public FileChangeSet changesSince(long token) {
+            ensureOpen();
+            long[] newToken = new long[1];
+            String packedChanges = changesSince0(server, token, newToken);
+            Set<String> changedPaths = new HashSet<String>();
+            Set<String> rootsToRescan = new HashSet<String>();
+            if (packedChanges == null) {
+                return new FileChangeSet(newToken[0], false, changedPaths, rootsToRescan);
+            }
+            int start = 0;
+            while (start < packedChanges.length()) {
+                int end = packedChanges.indexOf('\0', start);
+                String path = packedChanges.substring(start + 1, end);
+                if (packedChanges.charAt(start) == 'R') {
+                    rootsToRescan.add(path);
+                } else {
+                    changedPaths.add(path);
+                }
+                start = end + 1;
+            }
+            return new FileChangeSet(newToken[0], true, changedPaths, rootsToRescan);
+        }
+
+        @Nullable
+        private native String changesSince0(Object server, long token, long[] newToken);
+
         @Override
         public void shutdown() {
             ensureOpen();
@@ -226,24 +350,12 @@ public abstract class AbstractFileEventFunctions implements NativeIntegration {
 
         @Override
         public boolean awaitTermination(long timeout, TimeUnit unit) throws InterruptedException {
-            long timeoutInMillis = unit.toMillis(timeout);
-            long startTime = System.currentTimeMillis();
-            boolean successful = awaitTermination0(server, timeoutInMillis);
-            if (successful) {
-                long endTime = System.currentTimeMillis();
-                long remainingTimeout = timeoutInMillis - (endTime - startTime);
-                if (remainingTimeout > 0) {
-                    processorThread.join(remainingTimeout);
-                }
-                return !processorThread.isAlive();
-            } else {
-                return false;
-            }
+            return awaitTermination0(server, unit.toMillis(timeout));
         }
 
         private native boolean awaitTermination0(Object server, long timeoutInMillis);
 
-        private void ensureOpen() {
+        protected void ensureOpen() {
             if (shutdown) {
                 throw new IllegalStateException("Watcher already closed");
             }
@@ -251,8 +363,8 @@ public abstract class AbstractFileEventFunctions implements NativeIntegration {
     }
 
     private static class ChangeEvent implements FileWatchEvent {
-        private final ChangeType type;
-        private final String path;
+        protected final ChangeType type;
+        protected final String path;
 
         public ChangeEvent(ChangeType type, String path) {
             this.type = type;
@@ -270,6 +382,26 @@ public abstract class AbstractFileEventFunctions implements NativeIntegration {
         }
     }
 
+    private static class DetailedChangeEvent extends ChangeEvent {
+        private final boolean directory;
+        private final ChangedFileMetadata metadata;
+
+        public DetailedChangeEvent(ChangeType type, String path, boolean directory, @Nullable ChangedFileMetadata metadata) {
+            super(type, path);
+            this.directory = directory;
+            this.metadata = metadata;
+        }
+
+        @Override
+        public void handleEvent(Handler handler) {
+            if (handler instanceof MetadataHandler) {
+                ((MetadataHandler) handler).handleChangeEvent(type, path, directory, metadata);
+            } else {
+                super.handleEvent(handler);
+            }
+        }
+    }
+
     private static class OverflowEvent implements FileWatchEvent {
         private final OverflowType type;
         private final String path;
@@ -326,6 +458,51 @@ public abstract class AbstractFileEventFunctions implements NativeIntegration {
         }
     }
 
+    private static class SettledEvent implements FileWatchEvent {
+        private final String path;
+
+        public SettledEvent(String path) {
+            this.path = path;
+        }
+
+        @Override
+        public void handleEvent(Handler handler) {
+            if (handler instanceof SettledHandler) {
+                ((SettledHandler) handler).handleSettled(path);
+            }
+        }
+
+        @Override
+        public String toString() {
+            return "SETTLED " + path;
+        }
+    }
+
+    private static class MovedEvent implements FileWatchEvent {
+        private final String fromPath;
+        private final String toPath;
+
+        public MovedEvent(String fromPath, String toPath) {
+            this.fromPath = fromPath;
+            this.toPath = toPath;
+        }
+
+        @Override
+        public void handleEvent(Handler handler) {
+            if (handler instanceof MoveHandler) {
+                ((MoveHandler) handler).handleMoved(fromPath, toPath);
+            } else {
+                handler.handleChangeEvent(ChangeType.REMOVED, fromPath);
+                handler.handleChangeEvent(ChangeType.CREATED, toPath);
+            }
+        }
+
+        @Override
+        public String toString() {
+            return "MOVED " + fromPath + " -> " + toPath;
+        }
+    }
+
     private static class TerminationEvent implements FileWatchEvent {
         public final static TerminationEvent INSTANCE = new TerminationEvent();
 
@@ -0,0 +1,26 @@
+package net.rubygrapefruit.platform.internal.jni;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Accesses the sequence numbers in the header of a memory-mapped file event journal
+ * with the memory ordering the watcher writes them with.
+ */
+public class FileEventJournalFunctions {
+    /**
+     * Reads the oldest sequence number, after everything read from the journal before.
+     */
+    public static native long getOldestSequence0(ByteBuffer journal);
+
+    /**
+     * Reads the next sequence number, the records before it can be read afterwards.
+     */
+    public static native long getNextSequence0(ByteBuffer journal);
+
+    /**
+     * Waits until the record with the given sequence number has been written, or the timeout expires.
+     *
+     * @return whether the record has been written.
+     */
+    public static native boolean awaitRecords0(ByteBuffer journal, long fromSequence, long timeoutInMillis);
+}
@@ -16,16 +16,39 @@
 
 package net.rubygrapefruit.platform.internal.jni;
 
+import net.rubygrapefruit.platform.NativeException;
 import net.rubygrapefruit.platform.NativeIntegrationUnavailableException;
+import net.rubygrapefruit.platform.file.FileChangeSet;
+import net.rubygrapefruit.platform.file.FileEventJournal;
 import net.rubygrapefruit.platform.file.FileWatchEvent;
 import net.rubygrapefruit.platform.file.FileWatcher;
+import net.rubygrapefruit.platform.file.LinuxFileWatcher;
+import net.rubygrapefruit.platform.file.LinuxFileWatcher.EventKind;
+import net.rubygrapefruit.platform.file.MirroredFile;
 
+import javax.annotation.Nullable;
+import java.io.File;
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.Collection;
+import java.util.HashSet;
+import java.util.List;
+import java.util.Set;
 import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.ConcurrentHashMap;
+import java.util.concurrent.TimeUnit;
 
 /**
  * File watcher for Linux. Reports changes to the watched paths and their immediate children.
  * Changes to deeper descendants are not reported.
  *
+ * Individual files can be watched, too. They share a single inotify watch on their parent directory,
+ * and only changes to the watched files are reported.
+ *
+ * A watcher can be shared with other processes, see {@link WatcherBuilder#withSubscriptionSocket(File)}
+ * and {@link #connectToSharedWatcher(File, BlockingQueue)}. {@link WatcherBuilder#startOrConnect(File)}
+ * connects to a shared watcher when one is running, and starts it otherwise.
+ *
  * <h3>Remarks:</h3>
  *
  * <ul>
@@ -52,16 +75,529 @@ public class LinuxFileEventFunctions extends AbstractFileEventFunctions {
         return new WatcherBuilder(eventQueue);
     }
 
+    /**
+     * Connects to a watcher in another process that has been started with {@link WatcherBuilder#withSubscriptionSocket(File)}.
+     *
+     * <p>Paths watched by the returned watcher are watched by the other watcher, so several processes can share
+     * the same inotify watches. Changes are read from the journal of the other watcher. When the other watcher
+     * shuts down, a failure is reported, followed by the termination of the returned watcher.</p>
+     *
+     * @return the connected watcher, or {@code null} if no watcher is listening on the given socket.
+     */
+    @Nullable
+    public FileWatcher connectToSharedWatcher(File socketFile, BlockingQueue<FileWatchEvent> eventQueue) {
+        return connect(socketFile, eventQueue);
+    }
+
+    @Nullable
+    private static SharedWatcherClient connect(File socketFile, BlockingQueue<FileWatchEvent> eventQueue) {
+        int fd = connectToSharedWatcher0(socketFile.getAbsolutePath());
+        if (fd == -1) {
+            return null;
+        }
+        try {
+            String greeting = readSharedWatcherLine0(fd);
+            if (greeting == null || !greeting.startsWith(JOURNAL_GREETING)) {
+                throw new NativeException("Unexpected greeting from shared watcher: " + greeting);
+            }
+            FileEventJournal journal = FileEventJournal.open(new File(greeting.substring(JOURNAL_GREETING.length())));
+            SharedWatcherClient client = new SharedWatcherClient(fd, journal, new NativeFileWatcherCallback(eventQueue));
+            client.start();
+            return client;
+        } catch (IOException e) {
+            closeSharedWatcherConnection0(fd);
+            throw new NativeException("Couldn't open journal of shared watcher", e);
+        } catch (RuntimeException e) {
+            closeSharedWatcherConnection0(fd);
+            throw e;
+        }
+    }
+
+    private static final String JOURNAL_GREETING = "JOURNAL ";
+
     public static class WatcherBuilder extends AbstractWatcherBuilder {
+        private boolean trackTreeHashes;
+        private boolean mirrorWatchedTrees;
+        private boolean collectChangeMetadata;
+        private boolean reportCanonicalPathsOnly;
+        private boolean reportMoves;
+        private long settledQuietPeriodInMillis;
+        private File journalFile;
+        private long journalCapacityInBytes;
+        private File subscriptionSocketFile;
+
         WatcherBuilder(BlockingQueue<FileWatchEvent> eventQueue) {
             super(eventQueue);
         }
 
+        /**
+         * Maintain hashes of the watched directories that can be queried via {@link LinuxFileWatcher#getTreeHash(File)}.
+         * Watching a directory then requires listing its entries.
+         */
+        public WatcherBuilder withTreeHashes() {
+            trackTreeHashes = true;
+            return this;
+        }
+
+        /**
+         * Keep the metadata of the entries of the watched directories in memory, so it can be queried via
+         * {@link LinuxFileWatcher#stat(File)} and {@link LinuxFileWatcher#listDir(File)}.
+         */
+        public WatcherBuilder withMirror() {
+            mirrorWatchedTrees = true;
+            return this;
+        }
+
+        /**
+         * Query the metadata of created and modified files when the change is detected, and report it with the change
+         * to {@link FileWatchEvent.MetadataHandler handlers} interested in it.
+         * Whether a change is about a directory is always reported, as it is known without querying the file.
+         */
+        public WatcherBuilder withChangeMetadata() {
+            collectChangeMetadata = true;
+            return this;
+        }
+
+        /**
+         * Report changes to a directory registered under several paths, e.g. via symlinks or bind mounts,
+         * only for the path it has been registered under first.
+         * By default such changes are reported once for every registered path.
+         *
+         * <p>Directories are identified by the file system, so a directory registered under several paths only uses a single watch either way.</p>
+         */
+        public WatcherBuilder withCanonicalPathsOnly() {
+            reportCanonicalPathsOnly = true;
+            return this;
+        }
+
+        /**
+         * Report moves of watched directories within the watched directories as a single event to
+         * {@link FileWatchEvent.MoveHandler handlers} interested in them, and keep watching the moved directories
+         * at their new paths.
+         * By default such a move is reported as the directory being removed and created, and the watched paths
+         * stay registered under their old paths.
+         */
+        public WatcherBuilder withMoveEvents() {
+            reportMoves = true;
+            return this;
+        }
+
+        /**
+         * Report a {@link FileWatchEvent.SettledHandler#handleSettled(String) settled} event for a watched path
+         * once no changes have been reported for it for the given quiet period.
+         * Settled events are not reported by default.
+         *
+         * @param quietPeriod the time without changes after which a watched path is settled.
+         * @param unit the time unit for {@code quietPeriod}.
+         */
+        public WatcherBuilder withSettledEvents(long quietPeriod, TimeUnit unit) {
+            if (quietPeriod <= 0) {
+                throw new IllegalArgumentException("Quiet period must be positive");
+            }
+            settledQuietPeriodInMillis = Math.max(1, unit.toMillis(quietPeriod));
+            return this;
+        }
+
+        /**
+         * Append the reported changes to a journal in the given file, which can be read via
+         * {@link net.rubygrapefruit.platform.file.FileEventJournal}, also from other processes.
+         * Any existing journal in the file is replaced, but its sequence numbers are continued.
+         *
+         * @param journalFile the file to store the journal in.
+         * @param capacityInBytes the space for records, older records are dropped when it runs out.
+         */
+        public WatcherBuilder withJournal(File journalFile, long capacityInBytes) {
+            this.journalFile = journalFile;
+            this.journalCapacityInBytes = capacityInBytes;
+            return this;
+        }
+
+        /**
+         * Let other processes share this watcher via {@link LinuxFileEventFunctions#connectToSharedWatcher(File, BlockingQueue)}
+         * by listening on a Unix domain socket at the given path. Requires a {@link #withJournal(File, long) journal},
+         * which is where the other processes read changes from.
+         *
+         * <p>Changes to paths only watched by other processes are not reported to this watcher.
+         * Other processes receive all {@link LinuxFileWatcher.EventKind kinds} of changes, so paths watched by
+         * this watcher and other processes report all kinds of changes to this watcher, too, regardless of the
+         * kinds it has requested. This lasts until this watcher stops watching the path.</p>
+         */
+        public WatcherBuilder withSubscriptionSocket(File socketFile) {
+            this.subscriptionSocketFile = socketFile;
+            return this;
+        }
+
+        /**
+         * Connect to the watcher another process shares via the given socket, like
+         * {@link LinuxFileEventFunctions#connectToSharedWatcher(File, BlockingQueue)}, or start a new watcher
+         * shared via the socket, like with {@link #withSubscriptionSocket(File)}, if no watcher is listening on it.
+         * This way the processes on a host use the same inotify watches, whichever of them starts first.
+         *
+         * <p>Requires a {@link #withJournal(File, long) journal}. The other options of this builder only apply
+         * when a new watcher is started. A connected watcher reports all events to the queue passed to
+         * {@link LinuxFileEventFunctions#newWatcher(BlockingQueue)}, and it stops when the other process
+         * shuts down its watcher.</p>
+         */
+        public FileWatcher startOrConnect(File socketFile) throws InterruptedException {
+            if (journalFile == null) {
+                throw new IllegalStateException("Sharing a watcher requires a journal");
+            }
+            FileWatcher connected = connect(socketFile, getEventQueue());
+            if (connected != null) {
+                return connected;
+            }
+            withSubscriptionSocket(socketFile);
+            try {
+                return start();
+            } catch (NativeException e) {
+                // Another process might have started sharing its watcher in the meantime
+                connected = connect(socketFile, getEventQueue());
+                if (connected != null) {
+                    return connected;
+                }
+                throw e;
+            }
+        }
+
+        @Override
+        public LinuxFileWatcher start() throws InterruptedException {
+            return (LinuxFileWatcher) super.start();
+        }
+
+        @Override
+        public LinuxFileWatcher start(long startTimeout, TimeUnit startTimeoutUnit) throws InterruptedException {
+            return (LinuxFileWatcher) super.start(startTimeout, startTimeoutUnit);
+        }
+
+        @Override
+        public WatcherBuilder withRoute(File rootPrefix, BlockingQueue<FileWatchEvent> queue) {
+            super.withRoute(rootPrefix, queue);
+            return this;
+        }
+
         @Override
         protected Object startWatcher(NativeFileWatcherCallback callback) throws InotifyInstanceLimitTooLowException {
-            return startWatcher0(callback);
+            if (subscriptionSocketFile != null && journalFile == null) {
+                throw new IllegalStateException("Sharing a watcher requires a journal");
+            }
+            String journalPath = journalFile == null ? null : journalFile.getAbsolutePath();
+            String subscriptionSocketPath = subscriptionSocketFile == null ? null : subscriptionSocketFile.getAbsolutePath();
+            return startWatcher0(callback, trackTreeHashes, mirrorWatchedTrees, collectChangeMetadata, reportCanonicalPathsOnly, reportMoves, settledQuietPeriodInMillis, journalPath, journalCapacityInBytes, subscriptionSocketPath);
+        }
+
+        @Override
+        protected FileWatcher createWatcher(Object server, long startTimeout, TimeUnit startTimeoutUnit) {
+            return new NativeLinuxFileWatcher(server, startTimeout, startTimeoutUnit);
         }
     }
 
-    private static native Object startWatcher0(NativeFileWatcherCallback callback);
+    private static native Object startWatcher0(NativeFileWatcherCallback callback, boolean trackTreeHashes, boolean mirrorWatchedTrees, boolean collectChangeMetadata, boolean reportCanonicalPathsOnly, boolean reportMoves, long settledQuietPeriodInMillis, @Nullable String journalPath, long journalCapacityInBytes, @Nullable String subscriptionSocketPath);
+
+    private static class NativeLinuxFileWatcher extends NativeFileWatcher implements LinuxFileWatcher {
+        public NativeLinuxFileWatcher(Object server, long startTimeout, TimeUnit startTimeoutUnit) {
+            super(server, startTimeout, startTimeoutUnit);
+        }
+
+        @Override
+        public void startWatching(Collection<File> paths, Set<EventKind> eventKinds) {
+            if (eventKinds.isEmpty()) {
+                throw new IllegalArgumentException("At least one kind of event must be watched");
+            }
+            ensureOpen();
+            int eventKindBits = 0;
+            for (EventKind eventKind : eventKinds) {
+                eventKindBits |= 1 << eventKind.ordinal();
+            }
+            startWatchingWithEventKinds0(server, toAbsolutePaths(paths), eventKindBits);
+        }
+
+        @Override
+        public int stopWatchingUnder(File root) {
+            ensureOpen();
+            return stopWatchingUnder0(server, root.getAbsolutePath());
+        }
+
+        @Nullable
+        @Override
+        public Long getTreeHash(File directory) {
+            ensureOpen();
+            long[] hash = new long[1];
+            return getTreeHash0(server, directory.getAbsolutePath(), hash)
+                ? Long.valueOf(hash[0])
+                : null;
+        }
+
+        @Nullable
+        @Override
+        public MirroredFile stat(File file) {
+            ensureOpen();
+            File absoluteFile = file.getAbsoluteFile();
+            long[] metadata = new long[3];
+            if (!stat0(server, absoluteFile.getPath(), metadata)) {
+                return null;
+            }
+            return new MirroredFile(absoluteFile.getName(), MirroredFile.Type.values()[(int) metadata[0]], metadata[1], metadata[2]);
+        }
+
+        @Nullable
+        @Override
+        public List<MirroredFile> listDir(File directory) {
+            ensureOpen();
+            MirroredFileCollector collector = new MirroredFileCollector();
+            return listDir0(server, directory.getAbsolutePath(), collector)
+                ? collector.files
+                : null;
+        }
+    }
+
+    // Used from native
+    @SuppressWarnings("unused")
+    private static class MirroredFileCollector {
+        private final List<MirroredFile> files = new ArrayList<MirroredFile>();
+
+        public void add(String name, int type, long size, long lastModified) {
+            files.add(new MirroredFile(name, MirroredFile.Type.values()[type], size, lastModified));
+        }
+    }
+
+    private static native void startWatchingWithEventKinds0(Object server, String[] absolutePaths, int eventKinds);
+
+    private static native int stopWatchingUnder0(Object server, String absoluteRoot);
+
+    private static native boolean getTreeHash0(Object server, String absolutePath, long[] hash);
+
+    private static native boolean stat0(Object server, String absolutePath, long[] metadata);
+
+    private static native boolean listDir0(Object server, String absolutePath, MirroredFileCollector collector);
+
+    /**
+     * A watcher sharing the inotify watches of a watcher in another process.
+     */
+    private static class SharedWatcherClient implements FileWatcher, FileEventJournal.RecordHandler, Runnable {
+        // Also how often to check whether the other watcher is still there while no changes happen
+        private static final long AWAIT_RECORDS_TIMEOUT_IN_MILLIS = 100;
+        private static final int MAX_RECORDS_PER_READ = 1024;
+        private static final int MAX_CHANGED_PATHS = 16384;
+
+        private final int fd;
+        private final FileEventJournal journal;
+        private final NativeFileWatcherCallback callback;
+        private final ConcurrentHashMap<String, Boolean> roots = new ConcurrentHashMap<String, Boolean>();
+        private final Thread readerThread;
+        private volatile boolean stopped;
+
+        private final Object sequenceLock = new Object();
+        private long nextSequence;
+
+        private final Object changeSetLock = new Object();
+        private boolean trackingChanges;
+        private boolean changesLost;
+        private long generation = System.currentTimeMillis();
+        private final Set<String> changedPaths = new HashSet<String>();
+        private final Set<String> rootsToRescan = new HashSet<String>();
+
+        public SharedWatcherClient(int fd, FileEventJournal journal, NativeFileWatcherCallback callback) {
+            this.fd = fd;
+            this.journal = journal;
+            this.callback = callback;
+            // Only changes from after connecting are interesting
+            this.nextSequence = journal.getNextSequence();
+            this.readerThread = new Thread(this, "File watcher journal reader");
+            readerThread.setDaemon(true);
+        }
+
+        void start() {
+            readerThread.start();
+        }
+
+        @Override
+        public void run() {
+            try {
+                while (!stopped) {
+                    long sequence;
+                    synchronized (sequenceLock) {
+                        sequence = nextSequence;
+                    }
+                    long readSequence = journal.read(sequence, MAX_RECORDS_PER_READ, this);
+                    synchronized (sequenceLock) {
+                        nextSequence = readSequence;
+                        sequenceLock.notifyAll();
+                    }
+                    if (readSequence == sequence
+                        && !journal.awaitRecords(sequence, AWAIT_RECORDS_TIMEOUT_IN_MILLIS, TimeUnit.MILLISECONDS)) {
+                        if (isSharedWatcherDisconnected0(fd)) {
+                            callback.reportFailure(new NativeException("Shared watcher has terminated"));
+                            break;
+                        }
+                        if (Thread.interrupted()) {
+                            throw new InterruptedException();
+                        }
+                    }
+                }
+            } catch (InterruptedException e) {
+                // Stopped
+            } catch (Throwable e) {
+                callback.reportFailure(e);
+            } finally {
+                // Wait for a command in flight, so the descriptor isn't closed (and possibly reused) while it is in use
+                synchronized (this) {
+                    stopped = true;
+                    closeSharedWatcherConnection0(fd);
+                }
+                try {
+                    journal.close();
+                } catch (IOException e) {
+                    callback.reportFailure(e);
+                }
+                callback.reportTermination();
+            }
+        }
+
+        @Override
+        public void handleChange(long sequence, FileWatchEvent.ChangeType type, String absolutePath) {
+            // Only direct children of watched directories are reported, like for the other watcher
+            int separator = absolutePath.lastIndexOf('/');
+            String parent = separator <= 0 ? "/" : absolutePath.substring(0, separator);
+            if (!roots.containsKey(absolutePath) && !roots.containsKey(parent)) {
+                return;
+            }
+            synchronized (changeSetLock) {
+                if (trackingChanges && !changesLost) {
+                    changedPaths.add(absolutePath);
+                    if (changedPaths.size() > MAX_CHANGED_PATHS) {
+                        changesLost = true;
+                    }
+                }
+            }
+            callback.reportChangeEvent(type.ordinal(), absolutePath, 0);
+        }
+
+        @Override
+        public void handleOverflow(long sequence, String absolutePath) {
+            if (!roots.containsKey(absolutePath)) {
+                return;
+            }
+            synchronized (changeSetLock) {
+                rootsToRescan.add(absolutePath);
+            }
+            callback.reportOverflow(absolutePath, 0);
+        }
+
+        @Override
+        public void handleRecordsLost(long fromSequence, long toSequence) {
+            synchronized (changeSetLock) {
+                changesLost = true;
+            }
+            callback.reportOverflow(null, 0);
+        }
+
+        @Override
+        public void startWatching(Collection<File> paths) {
+            for (File path : paths) {
+                String absolutePath = path.getAbsolutePath();
+                String reply = sendCommand("WATCH " + absolutePath);
+                if (!reply.equals("OK")) {
+                    throw new NativeException("Couldn't watch " + absolutePath + ": " + reply);
+                }
+                roots.put(absolutePath, Boolean.TRUE);
+            }
+        }
+
+        @Override
+        public boolean stopWatching(Collection<File> paths) {
+            boolean success = true;
+            for (File path : paths) {
+                String absolutePath = path.getAbsolutePath();
+                roots.remove(absolutePath);
+                success &= sendCommand("UNWATCH " + absolutePath).equals("OK");
+            }
+            return success;
+        }
+
+        /**
+         * The other watcher reports when it has written every change from before this call to the journal,
+         * then this waits for the changes to be read from the journal.
+         */
+        @Override
+        public boolean awaitPendingEvents(long timeout, TimeUnit unit) throws InterruptedException {
+            String reply = sendCommand("SYNC");
+            if (!reply.startsWith("OK ")) {
+                throw new NativeException("Couldn't synchronize with shared watcher: " + reply);
+            }
+            long sequence = Long.parseLong(reply.substring(3));
+            long deadline = System.currentTimeMillis() + unit.toMillis(timeout);
+            synchronized (sequenceLock) {
+                while (nextSequence < sequence) {
+                    long remaining = deadline - System.currentTimeMillis();
+                    if (remaining <= 0 || !readerThread.isAlive()) {
+                        return false;
+                    }
+                    sequenceLock.wait(remaining);
+                }
+            }
+            return true;
+        }
+
+        @Override
+        public FileChangeSet changesSince(long token) {
+            synchronized (changeSetLock) {
+                boolean known = trackingChanges && token == generation && !changesLost;
+                FileChangeSet changeSet = new FileChangeSet(++generation, known,
+                    known ? new HashSet<String>(changedPaths) : new HashSet<String>(),
+                    known ? new HashSet<String>(rootsToRescan) : new HashSet<String>());
+                trackingChanges = true;
+                changesLost = false;
+                changedPaths.clear();
+                rootsToRescan.clear();
+                return changeSet;
+            }
+        }
+
+        @Override
+        public void shutdown() {
+            stopped = true;
+            readerThread.interrupt();
+            boolean interrupted = false;
+            while (readerThread.isAlive()) {
+                try {
+                    readerThread.join();
+                } catch (InterruptedException e) {
+                    interrupted = true;
+                }
+            }
+            if (interrupted) {
+                Thread.currentThread().interrupt();
+            }
+        }
+
+        @Override
+        public boolean awaitTermination(long timeout, TimeUnit unit) throws InterruptedException {
+            readerThread.join(Math.max(1, unit.toMillis(timeout)));
+            return !readerThread.isAlive();
+        }
+
+        // Commands and their replies share the connection, so only send one command at a time
+        private synchronized String sendCommand(String command) {
+            if (stopped) {
+                throw new IllegalStateException("Watcher already closed");
+            }
+            writeSharedWatcherLine0(fd, command);
+            String reply = readSharedWatcherLine0(fd);
+            if (reply == null) {
+                throw new NativeException("Shared watcher has terminated");
+            }
+            return reply;
+        }
+    }
+
+    private static native int connectToSharedWatcher0(String socketPath);
+
+    @Nullable
+    private static native String readSharedWatcherLine0(int fd);
+
+    private static native void writeSharedWatcherLine0(int fd, String line);
+
+    private static native boolean isSharedWatcherDisconnected0(int fd);
+
+    private static native void closeSharedWatcherConnection0(int fd);
 }
@@ -19,6 +19,7 @@ package net.rubygrapefruit.platform.internal.jni;
 import net.rubygrapefruit.platform.file.FileWatchEvent;
 import net.rubygrapefruit.platform.file.FileWatcher;
 
+import java.io.File;
 import java.util.concurrent.BlockingQueue;
 import java.util.concurrent.TimeUnit;
 
@@ -68,6 +69,12 @@ public class OsxFileEventFunctions extends AbstractFileEventFunctions {
             return this;
         }
 
+        @Override
+        public WatcherBuilder withRoute(File rootPrefix, BlockingQueue<FileWatchEvent> queue) {
+            super.withRoute(rootPrefix, queue);
+            return this;
+        }
+
         @Override
         protected Object startWatcher(NativeFileWatcherCallback callback) {
             return startWatcher0(latencyInMillis, callback);
@@ -335,6 +335,68 @@ abstract class AbstractFileEventFunctionsTest extends Specification {
         }
     }
 
+    private class ExpectedSettled implements ExpectedEvent {
+        private final File file
+
+        ExpectedSettled(File file) {
+            this.file = file
+        }
+
+        @Override
+        boolean matches(FileWatchEvent event) {
+            def matcher = new MatcherHandler() {
+                @Override
+                void handleSettled(String absolutePath) {
+                    matched = file.absolutePath == absolutePath
+                }
+            }
+            event.handleEvent(matcher)
+            return matcher.matched
+        }
+
+        @Override
+        boolean isOptional() {
+            return false
+        }
+
+        @Override
+        String toString() {
+            return "SETTLED ${shorten(file)}"
+        }
+    }
+
+    private class ExpectedMoved implements ExpectedEvent {
+        private final File fromFile
+        private final File toFile
+
+        ExpectedMoved(File fromFile, File toFile) {
+            this.fromFile = fromFile
+            this.toFile = toFile
+        }
+
+        @Override
+        boolean matches(FileWatchEvent event) {
+            def matcher = new MatcherHandler() {
+                @Override
+                void handleMoved(String fromAbsolutePath, String toAbsolutePath) {
+                    matched = fromFile.absolutePath == fromAbsolutePath && toFile.absolutePath == toAbsolutePath
+                }
+            }
+            event.handleEvent(matcher)
+            return matcher.matched
+        }
+
+        @Override
+        boolean isOptional() {
+            return false
+        }
+
+        @Override
+        String toString() {
+            return "MOVED ${shorten(fromFile)} -> ${shorten(toFile)}"
+        }
+    }
+
     private class ExpectedTermination implements ExpectedEvent {
         @Override
         boolean matches(FileWatchEvent event) {
@@ -488,7 +550,7 @@ abstract class AbstractFileEventFunctionsTest extends Specification {
 
     protected String format(FileWatchEvent event) {
         String shortened = null
-        event.handleEvent(new FileWatchEvent.Handler() {
+        event.handleEvent(new MatcherHandler() {
             @Override
             void handleChangeEvent(ChangeType type, String absolutePath) {
                 shortened = type.name() + " " + shorten(absolutePath)
@@ -509,6 +571,16 @@ abstract class AbstractFileEventFunctionsTest extends Specification {
                 shortened = "FAILURE $failure"
             }
 
+            @Override
+            void handleSettled(String absolutePath) {
+                shortened = "SETTLED ${shorten(absolutePath)}"
+            }
+
+            @Override
+            void handleMoved(String fromAbsolutePath, String toAbsolutePath) {
+                shortened = "MOVED ${shorten(fromAbsolutePath)} -> ${shorten(toAbsolutePath)}"
+            }
+
             @Override
             void handleTerminated() {
                 shortened = "TERMINATE"
@@ -548,6 +620,14 @@ abstract class AbstractFileEventFunctionsTest extends Specification {
         return new ExpectedFailure(type, message)
     }
 
+    protected ExpectedEvent settled(File file) {
+        return new ExpectedSettled(file)
+    }
+
+    protected ExpectedEvent moved(File fromFile, File toFile) {
+        return new ExpectedMoved(fromFile, toFile)
+    }
+
     protected ExpectedEvent termination() {
         return new ExpectedTermination()
     }
@@ -575,7 +655,7 @@ abstract class AbstractFileEventFunctionsTest extends Specification {
         }
     }
 
-    private static class MatcherHandler implements FileWatchEvent.Handler {
+    private static class MatcherHandler implements FileWatchEvent.SettledHandler, FileWatchEvent.MoveHandler {
         boolean matched
 
         @Override
@@ -590,11 +670,17 @@ abstract class AbstractFileEventFunctionsTest extends Specification {
         @Override
         void handleFailure(Throwable failure) {}
 
+        @Override
+        void handleSettled(String absolutePath) {}
+
+        @Override
+        void handleMoved(String fromAbsolutePath, String toAbsolutePath) {}
+
         @Override
         void handleTerminated() {}
     }
 
-    protected static class TestHandler implements FileWatchEvent.Handler {
+    protected static class TestHandler implements FileWatchEvent.SettledHandler, FileWatchEvent.MoveHandler {
         @Override
         void handleChangeEvent(ChangeType type, String absolutePath) {
             throw new IllegalStateException(String.format("Received unexpected change with %s / %s", type, absolutePath))
@@ -615,6 +701,16 @@ abstract class AbstractFileEventFunctionsTest extends Specification {
             throw new IllegalStateException(String.format("Received unexpected failure", failure))
         }
 
+        @Override
+        void handleSettled(String absolutePath) {
+            throw new IllegalStateException(String.format("Received unexpected settled event at %s", absolutePath))
+        }
+
+        @Override
+        void handleMoved(String fromAbsolutePath, String toAbsolutePath) {
+            throw new IllegalStateException(String.format("Received unexpected move from %s to %s", fromAbsolutePath, toAbsolutePath))
+        }
+
         @Override
         void handleTerminated() {
             throw new IllegalStateException("Received unexpected termination")
@@ -73,6 +73,28 @@ class BasicFileEventFunctionsTest extends AbstractFileEventFunctionsTest {
         expectEvents termination()
     }
 
+    def "server thread is only attached to the JVM when delivering events"() {
+        given:
+        def createdFile = new File(rootDir, "created.txt")
+
+        when:
+        startWatcher(rootDir)
+
+        then:
+        !fileWatcherServerThreadRunning()
+
+        when:
+        createNewFile(createdFile)
+
+        then:
+        expectEvents change(CREATED, createdFile)
+        fileWatcherServerThreadRunning()
+    }
+
+    private static boolean fileWatcherServerThreadRunning() {
+        Thread.allStackTraces.keySet().any { it.name == "File watcher server" }
+    }
+
     def "can detect file created"() {
         given:
         def createdFile = new File(rootDir, "created.txt")
@@ -801,6 +823,69 @@ class BasicFileEventFunctionsTest extends AbstractFileEventFunctionsTest {
         ex.message == "Starting the watcher timed out"
     }
 
+    def "can query changes since previous query"() {
+        given:
+        def createdFile = new File(rootDir, "created.txt")
+        startWatcher(rootDir)
+        def initialChanges = watcher.changesSince(FileChangeSet.NO_TOKEN)
+
+        expect:
+        !initialChanges.complete
+
+        when:
+        createNewFile(createdFile)
+        expectEvents change(CREATED, createdFile)
+        def changes = watcher.changesSince(initialChanges.token)
+
+        then:
+        changes.complete
+        changes.changedPaths == [createdFile.absolutePath] as Set
+        changes.rootsToRescan.empty
+
+        when:
+        def noChanges = watcher.changesSince(changes.token)
+
+        then:
+        noChanges.complete
+        noChanges.changedPaths.empty
+
+        when:
+        def staleChanges = watcher.changesSince(changes.token)
+
+        then:
+        !staleChanges.complete
+    }
+
+    @Requires({ Platform.current().linux })
+    def "can await pending events"() {
+        given:
+        def createdFile = new File(rootDir, "created.txt")
+        def modifiedFile = new File(rootDir, "modified.txt")
+        createNewFile(modifiedFile)
+        startWatcher(rootDir)
+
+        when:
+        createNewFile(createdFile)
+        modifiedFile << "change"
+        def caughtUp = watcher.awaitPendingEvents(5, SECONDS)
+
+        then:
+        caughtUp
+        eventQueue.size() == 2
+        expectEvents change(CREATED, createdFile), change(MODIFIED, modifiedFile)
+    }
+
+    @Requires({ Platform.current().linux })
+    def "can await pending events when there are none"() {
+        given:
+        startWatcher(rootDir)
+
+        expect:
+        watcher.awaitPendingEvents(5, SECONDS)
+        watcher.awaitPendingEvents(5, SECONDS)
+        expectNoEvents()
+    }
+
     def "can detect events in directory removed then re-added"() {
         given:
         def watchedDir = new File(rootDir, "watched")
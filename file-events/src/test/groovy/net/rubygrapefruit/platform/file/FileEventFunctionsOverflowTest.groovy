@@ -21,15 +21,18 @@ import org.spockframework.util.Nullable
 import spock.lang.Ignore
 import spock.lang.Requires
 
+import java.nio.file.Files
 import java.util.concurrent.ArrayBlockingQueue
 import java.util.concurrent.BlockingQueue
 import java.util.concurrent.CountDownLatch
 import java.util.concurrent.Executors
+import java.util.concurrent.LinkedBlockingQueue
 import java.util.concurrent.TimeUnit
 
 import static java.util.concurrent.TimeUnit.SECONDS
 import static java.util.logging.Level.INFO
 import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.CREATED
+import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.INVALIDATED
 
 @Requires({ Platform.current().macOs || Platform.current().linux || Platform.current().windows })
 class FileEventFunctionsOverflowTest extends AbstractFileEventFunctionsTest {
@@ -120,6 +123,137 @@ class FileEventFunctionsOverflowTest extends AbstractFileEventFunctionsTest {
         expectLogMessage(INFO, "Event queue overflow, dropping all events")
     }
 
+    def "reports invalidated directory instead of overflowing when event queue is filling up"() {
+        given:
+        def queue = new ArrayBlockingQueue<FileWatchEvent>(16)
+        startWatcher(queue, rootDir)
+
+        when:
+        32.times { index ->
+            createNewFile(new File(rootDir, "file-${index}.txt"))
+        }
+        waitForChangeEventLatency()
+
+        then:
+        drainInvalidatedPaths(queue) == [rootDir.absolutePath]
+    }
+
+    def "reports changes individually again after the filled up event queue has been drained"() {
+        given:
+        def queue = new ArrayBlockingQueue<FileWatchEvent>(16)
+        def afterDrainFile = new File(rootDir, "after-drain.txt")
+        startWatcher(queue, rootDir)
+
+        32.times { index ->
+            createNewFile(new File(rootDir, "file-${index}.txt"))
+        }
+        waitForChangeEventLatency()
+        assert drainInvalidatedPaths(queue) == [rootDir.absolutePath]
+
+        when:
+        createNewFile(afterDrainFile)
+
+        then:
+        expectEvents queue, change(CREATED, afterDrainFile)
+    }
+
+    @Requires({ Platform.current().linux })
+    def "reports invalidated nested watched directories before invalidating the outermost one"() {
+        given:
+        def queue = new ArrayBlockingQueue<FileWatchEvent>(64)
+        def subDirs = (0..<12).collect { index ->
+            def subDir = new File(rootDir, "sub-${index}")
+            assert subDir.mkdirs()
+            subDir
+        }
+        startWatcher(queue, ([rootDir] + subDirs) as File[])
+
+        when:
+        // Leave less than a quarter of the queue free, so changes are reported per directory
+        49.times { index ->
+            createNewFile(new File(rootDir, "file-${index}.txt"))
+        }
+        // Leave less than a sixteenth of the queue free, so changes are reported per outermost watched directory
+        subDirs.each { subDir ->
+            createNewFile(new File(subDir, "file.txt"))
+        }
+        createNewFile(new File(subDirs[0], "another-file.txt"))
+        waitForChangeEventLatency()
+
+        then:
+        drainInvalidatedPaths(queue) == subDirs*.absolutePath + [rootDir.absolutePath]
+    }
+
+    @Requires({ Platform.current().linux })
+    def "reports overflow for every path a directory is watched under"() {
+        given:
+        // We don't want to fail when overflow is logged
+        ignoreLogMessages()
+
+        def watchedDir = new File(rootDir, "watched")
+        assert watchedDir.mkdirs()
+        def linkedDir = new File(rootDir, "linked")
+        Files.createSymbolicLink(linkedDir.toPath(), watchedDir.toPath())
+        def firstFile = new File(watchedDir, "first.txt")
+        def churnedFile = new File(watchedDir, "churned.txt")
+        def maxQueuedEvents = new File("/proc/sys/fs/inotify/max_queued_events").text.trim() as int
+
+        // Stall the watcher thread on the first event, so the kernel queue overflows behind it
+        def released = new CountDownLatch(1)
+        def queue = new LinkedBlockingQueue<FileWatchEvent>() {
+            @Override
+            boolean offer(FileWatchEvent event) {
+                released.await()
+                return super.offer(event)
+            }
+        }
+        startWatcher(queue, watchedDir, linkedDir)
+
+        when:
+        createNewFile(firstFile)
+        (maxQueuedEvents.intdiv(2) + 1).times {
+            assert churnedFile.createNewFile()
+            assert churnedFile.delete()
+        }
+        released.countDown()
+
+        then:
+        def overflowPaths = [] as Set
+        expectEvents(queue, 10, SECONDS, { -> overflowPaths.size() < 2 }, { event ->
+            if (event == null) {
+                return false
+            }
+            event.handleEvent(new AbstractFileEventFunctionsTest.TestHandler() {
+                @Override
+                void handleChangeEvent(FileWatchEvent.ChangeType type, String absolutePath) {}
+
+                @Override
+                void handleOverflow(FileWatchEvent.OverflowType type, @Nullable String absolutePath) {
+                    overflowPaths << absolutePath
+                }
+            })
+            return true
+        })
+        overflowPaths == [watchedDir.absolutePath, linkedDir.absolutePath] as Set
+    }
+
+    private static List<String> drainInvalidatedPaths(BlockingQueue<FileWatchEvent> queue) {
+        def events = new ArrayList<FileWatchEvent>()
+        queue.drainTo(events)
+        def invalidatedPaths = []
+        events.each { event ->
+            event.handleEvent(new AbstractFileEventFunctionsTest.TestHandler() {
+                @Override
+                void handleChangeEvent(FileWatchEvent.ChangeType type, String absolutePath) {
+                    if (type == INVALIDATED) {
+                        invalidatedPaths << absolutePath
+                    }
+                }
+            })
+        }
+        return invalidatedPaths
+    }
+
     private boolean expectOverflow(BlockingQueue<FileWatchEvent> eventQueue = this.eventQueue, int timeoutValue, TimeUnit timeoutUnit) {
         boolean overflow = false
         expectEvents(eventQueue, timeoutValue, timeoutUnit, { -> true }, { event ->
@@ -0,0 +1,683 @@
+/*
+ * Copyright 2020 the original author or authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package net.rubygrapefruit.platform.file
+
+import net.rubygrapefruit.platform.NativeException
+import net.rubygrapefruit.platform.internal.Platform
+import net.rubygrapefruit.platform.internal.jni.LinuxFileEventFunctions
+import spock.lang.Requires
+
+import javax.annotation.Nullable
+import java.nio.file.Files
+import java.nio.file.attribute.PosixFilePermissions
+import java.util.concurrent.LinkedBlockingQueue
+import java.util.regex.Pattern
+
+import static java.util.concurrent.TimeUnit.MILLISECONDS
+import static java.util.concurrent.TimeUnit.SECONDS
+import static java.util.logging.Level.SEVERE
+import static java.util.logging.Level.WARNING
+import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.CREATED
+import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.MODIFIED
+import static net.rubygrapefruit.platform.file.FileWatchEvent.ChangeType.REMOVED
+import static net.rubygrapefruit.platform.file.LinuxFileWatcher.EventKind.CONTENT
+import static net.rubygrapefruit.platform.file.LinuxFileWatcher.EventKind.STRUCTURE
+
+@Requires({ Platform.current().linux })
+class LinuxFileEventFunctionsTest extends AbstractFileEventFunctionsTest {
+
+    LinuxFileWatcher linuxWatcher
+
+    def "can watch individual files"() {
+        given:
+        def watchedFile = new File(rootDir, "watched.txt")
+        def otherWatchedFile = new File(rootDir, "other-watched.txt")
+        def siblingFile = new File(rootDir, "sibling.txt")
+        [watchedFile, otherWatchedFile, siblingFile].each { assert it.createNewFile() }
+        startWatcher(watchedFile, otherWatchedFile)
+
+        when:
+        siblingFile.text = "modified"
+        watchedFile.text = "modified"
+
+        then:
+        expectEvents change(MODIFIED, watchedFile)
+
+        when:
+        assert watcher.stopWatching(watchedFile)
+        watchedFile.text = "modified again"
+        assert otherWatchedFile.delete()
+
+        then:
+        expectEvents change(REMOVED, otherWatchedFile)
+    }
+
+    def "can watch a file in a watched directory"() {
+        given:
+        def file = new File(rootDir, "file.txt")
+        assert file.createNewFile()
+        def siblingFile = new File(rootDir, "sibling.txt")
+        startWatcher(rootDir, file)
+
+        when:
+        assert watcher.stopWatching(rootDir)
+        createNewFile(siblingFile)
+        file.text = "modified"
+
+        then:
+        expectEvents change(MODIFIED, file)
+    }
+
+    def "only reports requested kinds of events"() {
+        given:
+        def structureDir = new File(rootDir, "structure")
+        def contentDir = new File(rootDir, "content")
+        [structureDir, contentDir].each { assert it.mkdirs() }
+        def existingFileInStructureDir = new File(structureDir, "existing.txt")
+        def existingFileInContentDir = new File(contentDir, "existing.txt")
+        [existingFileInStructureDir, existingFileInContentDir].each { assert it.createNewFile() }
+        startLinuxWatcher { it }
+        linuxWatcher.startWatching([structureDir], EnumSet.of(STRUCTURE))
+        linuxWatcher.startWatching([contentDir], EnumSet.of(CONTENT))
+
+        when:
+        existingFileInStructureDir.text = "modified"
+        createNewFile(new File(contentDir, "new.txt"))
+
+        then:
+        expectNoEvents()
+
+        when:
+        def newFileInStructureDir = new File(structureDir, "new.txt")
+        createNewFile(newFileInStructureDir)
+        existingFileInContentDir.text = "modified"
+
+        then:
+        expectEvents change(CREATED, newFileInStructureDir), change(MODIFIED, existingFileInContentDir)
+    }
+
+    def "can stop watching all paths under a directory"() {
+        given:
+        def projectDir = new File(rootDir, "project")
+        def moduleDir = new File(projectDir, "module")
+        def siblingDir = new File(rootDir, "project-sibling")
+        [moduleDir, siblingDir].each { assert it.mkdirs() }
+        def buildFile = new File(projectDir, "build.gradle")
+        assert buildFile.createNewFile()
+        startLinuxWatcher { it }
+        linuxWatcher.startWatching([projectDir, moduleDir, siblingDir, buildFile])
+
+        when:
+        def unwatched = linuxWatcher.stopWatchingUnder(projectDir)
+
+        then:
+        unwatched == 3
+
+        when:
+        buildFile.text = "modified"
+        createNewFile(new File(moduleDir, "created.txt"))
+        def createdInSibling = new File(siblingDir, "created.txt")
+        createNewFile(createdInSibling)
+
+        then:
+        expectEvents change(CREATED, createdInSibling)
+    }
+
+    def "keeps watching directories moved within watched directories"() {
+        given:
+        def moduleDir = new File(rootDir, "module")
+        def srcDir = new File(moduleDir, "src")
+        assert srcDir.mkdirs()
+        def renamedModuleDir = new File(rootDir, "renamed")
+        def renamedSrcDir = new File(renamedModuleDir, "src")
+        def createdFile = new File(renamedSrcDir, "created.txt")
+        startLinuxWatcher { it.withMoveEvents() }
+        linuxWatcher.startWatching([rootDir, moduleDir, srcDir])
+
+        when:
+        assert moduleDir.renameTo(renamedModuleDir)
+
+        then:
+        expectEvents moved(moduleDir, renamedModuleDir)
+
+        when:
+        createNewFile(createdFile)
+
+        then:
+        expectEvents change(CREATED, createdFile)
+
+        when:
+        assert watcher.stopWatching(renamedModuleDir, renamedSrcDir)
+        createNewFile(new File(renamedSrcDir, "unwatched.txt"))
+
+        then:
+        expectNoEvents()
+    }
+
+    def "reports moves of watched directories as removal and creation to handlers not interested in moves"() {
+        given:
+        def moduleDir = new File(rootDir, "module")
+        assert moduleDir.mkdirs()
+        def renamedModuleDir = new File(rootDir, "renamed")
+        def recorder = new ChangeRecorder()
+        startLinuxWatcher { it.withMoveEvents() }
+        linuxWatcher.startWatching([rootDir, moduleDir])
+
+        when:
+        assert moduleDir.renameTo(renamedModuleDir)
+        assert watcher.awaitPendingEvents(5, SECONDS)
+        eventQueue.each { it.handleEvent(recorder) }
+
+        then:
+        recorder.changes == [[REMOVED, moduleDir.absolutePath], [CREATED, renamedModuleDir.absolutePath]]
+    }
+
+    def "keeps directories moved within watched directories watched at their old paths by default"() {
+        given:
+        def moduleDir = new File(rootDir, "module")
+        assert moduleDir.mkdirs()
+        def renamedModuleDir = new File(rootDir, "renamed")
+        startWatcher(rootDir, moduleDir)
+
+        when:
+        assert moduleDir.renameTo(renamedModuleDir)
+        assert watcher.awaitPendingEvents(5, SECONDS)
+        eventQueue.clear()
+        def stopped = watcher.stopWatching(moduleDir)
+
+        then:
+        stopped
+        // The watched directory itself only learns that it has been moved, not where to
+        expectLogMessage(WARNING, Pattern.compile("Unknown event 0x800 for ${Pattern.quote(moduleDir.absolutePath)}"))
+    }
+
+    def "reports watched paths as settled after quiet period"() {
+        given:
+        def watchedDir = new File(rootDir, "watched")
+        def otherWatchedDir = new File(rootDir, "other")
+        [watchedDir, otherWatchedDir].each { assert it.mkdirs() }
+        def firstFile = new File(watchedDir, "first.txt")
+        def secondFile = new File(watchedDir, "second.txt")
+        startLinuxWatcher { it.withSettledEvents(200, MILLISECONDS) }
+        linuxWatcher.startWatching([watchedDir, otherWatchedDir])
+
+        when:
+        createNewFile(firstFile)
+        createNewFile(secondFile)
+
+        then:
+        expectEvents change(CREATED, firstFile), change(CREATED, secondFile), settled(watchedDir)
+    }
+
+    def "writes changes to journal"() {
+        given:
+        def journalFile = new File(testDir, "journal.bin")
+        def createdFile = new File(rootDir, "created.txt")
+        def modifiedFile = new File(rootDir, "modified.txt")
+        assert modifiedFile.createNewFile()
+        startLinuxWatcher { it.withJournal(journalFile, 1024 * 1024) }
+        linuxWatcher.startWatching([rootDir])
+        def journal = FileEventJournal.open(journalFile)
+        def startSequence = journal.nextSequence
+        def records = []
+        def handler = new FileEventJournal.RecordHandler() {
+            @Override
+            void handleChange(long sequence, FileWatchEvent.ChangeType type, String absolutePath) {
+                records << "$type $absolutePath"
+            }
+
+            @Override
+            void handleOverflow(long sequence, String absolutePath) {
+                records << "OVERFLOW $absolutePath"
+            }
+
+            @Override
+            void handleRecordsLost(long fromSequence, long toSequence) {
+                records << "LOST $fromSequence-$toSequence"
+            }
+        }
+
+        expect:
+        !journal.awaitRecords(startSequence, 10, MILLISECONDS)
+
+        when:
+        createNewFile(createdFile)
+        assert journal.awaitRecords(startSequence, 5, SECONDS)
+        def nextSequence = journal.read(startSequence, 1, handler)
+
+        then:
+        nextSequence == startSequence + 1
+        records == ["CREATED ${createdFile.absolutePath}"]
+
+        when:
+        records.clear()
+        modifiedFile.text = "modified"
+        assert linuxWatcher.awaitPendingEvents(5, SECONDS)
+        journal.read(nextSequence, Integer.MAX_VALUE, handler)
+
+        then:
+        !records.empty
+        records.every { it == "MODIFIED ${modifiedFile.absolutePath}" }
+
+        cleanup:
+        journal?.close()
+    }
+
+    def "replaces the journal of a previous watcher without breaking its readers"() {
+        given:
+        def journalFile = new File(testDir, "journal.bin")
+        startLinuxWatcher { it.withJournal(journalFile, 1024 * 1024) }
+        linuxWatcher.startWatching([rootDir])
+        createNewFile(new File(rootDir, "created.txt"))
+        assert linuxWatcher.awaitPendingEvents(5, SECONDS)
+        def previousJournal = FileEventJournal.open(journalFile)
+        def previousNextSequence = previousJournal.nextSequence
+
+        when:
+        def otherWatcher = FileEvents.get(LinuxFileEventFunctions).newWatcher(newEventQueue())
+            .withJournal(journalFile, 1024 * 1024)
+            .start()
+        def journal = FileEventJournal.open(journalFile)
+
+        then:
+        // The previous journal stays mapped, and the new one continues its numbering
+        previousJournal.nextSequence == previousNextSequence
+        journal.nextSequence == previousNextSequence
+
+        cleanup:
+        otherWatcher?.shutdown()
+        otherWatcher?.awaitTermination(5, SECONDS)
+        journal?.close()
+        previousJournal?.close()
+    }
+
+    def "shares watcher with other watchers"() {
+        given:
+        def journalFile = new File(testDir, "journal.bin")
+        def socketFile = new File(testDir, "watcher.sock")
+        def sharedDir = new File(rootDir, "shared")
+        assert sharedDir.mkdirs()
+        def createdFile = new File(sharedDir, "created.txt")
+        def createdRootFile = new File(rootDir, "created.txt")
+        startLinuxWatcher { it.withJournal(journalFile, 1024 * 1024).withSubscriptionSocket(socketFile) }
+        linuxWatcher.startWatching([rootDir])
+        def clientQueue = new LinkedBlockingQueue<FileWatchEvent>()
+        def client = FileEvents.get(LinuxFileEventFunctions).connectToSharedWatcher(socketFile, clientQueue)
+
+        expect:
+        client != null
+        FileEvents.get(LinuxFileEventFunctions).connectToSharedWatcher(new File(testDir, "missing.sock"), clientQueue) == null
+        // Only the user running the watcher can subscribe and read the journal
+        PosixFilePermissions.toString(Files.getPosixFilePermissions(socketFile.toPath())) == "rw-------"
+        PosixFilePermissions.toString(Files.getPosixFilePermissions(journalFile.toPath())) == "rw-------"
+
+        when:
+        client.startWatching([sharedDir, rootDir])
+        createNewFile(createdFile)
+        createNewFile(createdRootFile)
+        assert client.awaitPendingEvents(5, SECONDS)
+
+        then:
+        expectEvents clientQueue, change(CREATED, createdFile), change(CREATED, createdRootFile)
+        // Only the paths watched by this watcher are reported to it
+        expectEvents change(CREATED, createdRootFile)
+
+        when:
+        client.shutdown()
+
+        then:
+        expectEvents clientQueue, termination()
+
+        cleanup:
+        client?.shutdown()
+    }
+
+    def "connects to a shared watcher when there is one, and starts one otherwise"() {
+        given:
+        def journalFile = new File(testDir, "journal.bin")
+        def socketFile = new File(testDir, "watcher.sock")
+        def createdFile = new File(rootDir, "created.txt")
+        def clientQueue = new LinkedBlockingQueue<FileWatchEvent>()
+
+        when:
+        linuxWatcher = FileEvents.get(LinuxFileEventFunctions).newWatcher(eventQueue)
+            .withJournal(journalFile, 1024 * 1024)
+            .startOrConnect(socketFile) as LinuxFileWatcher
+        watcher = new TestFileWatcher(linuxWatcher)
+        def client = FileEvents.get(LinuxFileEventFunctions).newWatcher(clientQueue)
+            .withJournal(new File(testDir, "other-journal.bin"), 1024 * 1024)
+            .startOrConnect(socketFile)
+
+        then:
+        !(client instanceof LinuxFileWatcher)
+        // The journal of the running watcher is used
+        !new File(testDir, "other-journal.bin").exists()
+
+        when:
+        client.startWatching([rootDir])
+        createNewFile(createdFile)
+        assert client.awaitPendingEvents(5, SECONDS)
+
+        then:
+        expectEvents clientQueue, change(CREATED, createdFile)
+
+        cleanup:
+        client?.shutdown()
+    }
+
+    def "reports all kinds of changes to paths shared with other watchers"() {
+        given:
+        def journalFile = new File(testDir, "journal.bin")
+        def socketFile = new File(testDir, "watcher.sock")
+        def sharedDir = new File(rootDir, "shared")
+        assert sharedDir.mkdirs()
+        def modifiedFile = new File(sharedDir, "modified.txt")
+        assert modifiedFile.createNewFile()
+        startLinuxWatcher { it.withJournal(journalFile, 1024 * 1024).withSubscriptionSocket(socketFile) }
+        linuxWatcher.startWatching([sharedDir], EnumSet.of(STRUCTURE))
+        def clientQueue = new LinkedBlockingQueue<FileWatchEvent>()
+        def client = FileEvents.get(LinuxFileEventFunctions).connectToSharedWatcher(socketFile, clientQueue)
+        client.startWatching([sharedDir])
+
+        when:
+        modifiedFile.text = "modified"
+        assert client.awaitPendingEvents(5, SECONDS)
+
+        then:
+        expectEvents clientQueue, change(MODIFIED, modifiedFile)
+        expectEvents change(MODIFIED, modifiedFile)
+
+        cleanup:
+        client?.shutdown()
+    }
+
+    def "does not replace other files with the subscription socket"() {
+        given:
+        def journalFile = new File(testDir, "journal.bin")
+        def socketFile = new File(testDir, "watcher.sock")
+        socketFile.text = "not a socket"
+
+        when:
+        startLinuxWatcher { it.withJournal(journalFile, 1024 * 1024).withSubscriptionSocket(socketFile) }
+
+        then:
+        def ex = thrown NativeException
+        ex.message == "Couldn't replace file at subscription socket path: ${socketFile.absolutePath}"
+        socketFile.text == "not a socket"
+
+        expectLogMessage(SEVERE, "Caught exception: ${ex.message}")
+    }
+
+    def "keeps directories watched only for other watchers private after they have been moved"() {
+        given:
+        def journalFile = new File(testDir, "journal.bin")
+        def socketFile = new File(testDir, "watcher.sock")
+        def sharedDir = new File(rootDir, "shared")
+        assert sharedDir.mkdirs()
+        def movedDir = new File(rootDir, "moved")
+        startLinuxWatcher { it.withMoveEvents().withJournal(journalFile, 1024 * 1024).withSubscriptionSocket(socketFile) }
+        linuxWatcher.startWatching([rootDir])
+        def clientQueue = new LinkedBlockingQueue<FileWatchEvent>()
+        def client = FileEvents.get(LinuxFileEventFunctions).connectToSharedWatcher(socketFile, clientQueue)
+        client.startWatching([sharedDir])
+
+        when:
+        assert sharedDir.renameTo(movedDir)
+        createNewFile(new File(movedDir, "created.txt"))
+        assert client.awaitPendingEvents(5, SECONDS)
+
+        then:
+        // Only the paths watched by this watcher are reported to it
+        expectEvents change(REMOVED, sharedDir), change(CREATED, movedDir)
+
+        when:
+        def stopped = client.stopWatching([sharedDir])
+
+        then:
+        // Still known by the path it has been registered under
+        stopped
+
+        cleanup:
+        client?.shutdown()
+    }
+
+    def "routes events to queues by watch root"() {
+        given:
+        def routedDir = new File(rootDir, "routed")
+        def nestedRoutedDir = new File(routedDir, "nested")
+        def otherDir = new File(testDir, "other")
+        assert nestedRoutedDir.mkdirs()
+        assert otherDir.mkdirs()
+        def routedFile = new File(routedDir, "created.txt")
+        def nestedRoutedFile = new File(nestedRoutedDir, "created.txt")
+        def otherFile = new File(otherDir, "created.txt")
+        def routedQueue = newEventQueue()
+        def nestedRoutedQueue = newEventQueue()
+        startLinuxWatcher {
+            it.withRoute(rootDir, routedQueue)
+                .withRoute(nestedRoutedDir, nestedRoutedQueue)
+        }
+        linuxWatcher.startWatching([routedDir, nestedRoutedDir, otherDir])
+
+        when:
+        createNewFile(routedFile)
+        createNewFile(nestedRoutedFile)
+        createNewFile(otherFile)
+
+        then:
+        expectEvents routedQueue, change(CREATED, routedFile)
+        expectEvents nestedRoutedQueue, change(CREATED, nestedRoutedFile)
+        expectEvents change(CREATED, otherFile)
+    }
+
+    def "tracks tree hashes of watched directories"() {
+        given:
+        def subDir = new File(rootDir, "sub")
+        assert subDir.mkdirs()
+        def file = new File(subDir, "file.txt")
+        file.text = "initial"
+        startLinuxWatcher { it.withTreeHashes() }
+        linuxWatcher.startWatching([rootDir, subDir])
+        def initialRootHash = linuxWatcher.getTreeHash(rootDir)
+        def initialSubDirHash = linuxWatcher.getTreeHash(subDir)
+
+        expect:
+        initialRootHash != null
+        initialSubDirHash != null
+        linuxWatcher.getTreeHash(file) == null
+
+        when:
+        file.text = "changed contents"
+        assert linuxWatcher.awaitPendingEvents(5, SECONDS)
+
+        then:
+        linuxWatcher.getTreeHash(subDir) != initialSubDirHash
+        linuxWatcher.getTreeHash(rootDir) != initialRootHash
+
+        when:
+        def changedRootHash = linuxWatcher.getTreeHash(rootDir)
+        assert linuxWatcher.stopWatching([subDir])
+
+        then:
+        linuxWatcher.getTreeHash(subDir) == null
+        linuxWatcher.getTreeHash(rootDir) != changedRootHash
+
+        when:
+        linuxWatcher.startWatching([subDir])
+
+        then:
+        linuxWatcher.getTreeHash(rootDir) == changedRootHash
+    }
+
+    def "tree hashes are not tracked by default"() {
+        given:
+        startLinuxWatcher { it }
+        linuxWatcher.startWatching([rootDir])
+
+        expect:
+        linuxWatcher.getTreeHash(rootDir) == null
+    }
+
+    def "answers queries about watched directories from the mirror"() {
+        given:
+        def subDir = new File(rootDir, "sub")
+        assert subDir.mkdirs()
+        def file = new File(rootDir, "file.txt")
+        file.text = "initial"
+        def missingFile = new File(rootDir, "missing.txt")
+        startLinuxWatcher { it.withMirror() }
+        linuxWatcher.startWatching([rootDir])
+
+        expect:
+        linuxWatcher.stat(file).type == MirroredFile.Type.FILE
+        linuxWatcher.stat(file).size == 7
+        linuxWatcher.stat(subDir).type == MirroredFile.Type.DIRECTORY
+        linuxWatcher.stat(missingFile).type == MirroredFile.Type.MISSING
+        linuxWatcher.stat(new File(missingFile, "child.txt")).type == MirroredFile.Type.MISSING
+        linuxWatcher.stat(new File(subDir, "unwatched.txt")) == null
+        linuxWatcher.stat(testDir) == null
+        linuxWatcher.listDir(rootDir)*.name as Set == ["sub", "file.txt"] as Set
+        linuxWatcher.listDir(subDir) == null
+
+        when:
+        file.text = "changed contents"
+        createNewFile(missingFile)
+        assert linuxWatcher.awaitPendingEvents(5, SECONDS)
+
+        then:
+        linuxWatcher.stat(file).size == 16
+        linuxWatcher.stat(missingFile).type == MirroredFile.Type.FILE
+        linuxWatcher.listDir(rootDir)*.name as Set == ["sub", "file.txt", "missing.txt"] as Set
+
+        when:
+        assert linuxWatcher.stopWatching([rootDir])
+
+        then:
+        linuxWatcher.stat(file) == null
+    }
+
+    def "mirror is not enabled by default"() {
+        given:
+        startLinuxWatcher { it }
+        linuxWatcher.startWatching([rootDir])
+
+        expect:
+        linuxWatcher.stat(rootDir) == null
+        linuxWatcher.listDir(rootDir) == null
+    }
+
+    def "reports changes to directory watched via several paths only for canonical path when requested"() {
+        given:
+        def canonicalDir = new File(rootDir, "watchedDir")
+        assert canonicalDir.mkdirs()
+        def linkedDir = new File(rootDir, "linked")
+        Files.createSymbolicLink(linkedDir.toPath(), canonicalDir.toPath())
+        def createdFile = new File(linkedDir, "created.txt")
+        startLinuxWatcher { it.withCanonicalPathsOnly() }
+        linuxWatcher.startWatching([canonicalDir, linkedDir])
+
+        when:
+        createNewFile(createdFile)
+
+        then:
+        expectEvents change(CREATED, new File(canonicalDir, "created.txt"))
+    }
+
+    def "reports metadata of changed files"() {
+        given:
+        def createdFile = new File(rootDir, "created.txt")
+        def createdDir = new File(rootDir, "created-dir")
+        def recorder = new ChangeMetadataRecorder()
+        startLinuxWatcher { it.withChangeMetadata() }
+        linuxWatcher.startWatching([rootDir])
+
+        when:
+        createNewFile(createdFile)
+        assert createdDir.mkdirs()
+        2.times {
+            eventQueue.poll(5, SECONDS).handleEvent(recorder)
+        }
+
+        then:
+        recorder.changes == [
+            (createdFile.absolutePath): "CREATED file FILE 0",
+            (createdDir.absolutePath): "CREATED directory DIRECTORY 0"
+        ]
+        recorder.inodes[createdFile.absolutePath] == Files.getAttribute(createdFile.toPath(), "unix:ino")
+    }
+
+    def "reports whether changes are about directories without collecting metadata"() {
+        given:
+        def createdDir = new File(rootDir, "created-dir")
+        def recorder = new ChangeMetadataRecorder()
+        startLinuxWatcher { it }
+        linuxWatcher.startWatching([rootDir])
+
+        when:
+        assert createdDir.mkdirs()
+        eventQueue.poll(5, SECONDS).handleEvent(recorder)
+
+        then:
+        recorder.changes == [(createdDir.absolutePath): "CREATED directory null 0"]
+    }
+
+    private void startLinuxWatcher(Closure<LinuxFileEventFunctions.WatcherBuilder> configure) {
+        def builder = FileEvents.get(LinuxFileEventFunctions).newWatcher(eventQueue)
+        linuxWatcher = configure(builder).start()
+        watcher = new TestFileWatcher(linuxWatcher)
+    }
+
+    private static class ChangeRecorder implements FileWatchEvent.Handler {
+        final List<List<Object>> changes = []
+
+        @Override
+        void handleChangeEvent(FileWatchEvent.ChangeType type, String absolutePath) {
+            changes << [type, absolutePath]
+        }
+
+        @Override
+        void handleUnknownEvent(String absolutePath) {
+            throw new IllegalStateException("Received unexpected unknown event at $absolutePath")
+        }
+
+        @Override
+        void handleOverflow(FileWatchEvent.OverflowType type, @Nullable String absolutePath) {
+            throw new IllegalStateException("Received unexpected $type overflow at $absolutePath")
+        }
+
+        @Override
+        void handleFailure(Throwable failure) {
+            throw new IllegalStateException("Received unexpected failure", failure)
+        }
+
+        @Override
+        void handleTerminated() {
+            throw new IllegalStateException("Received unexpected termination")
+        }
+    }
+
+    private static class ChangeMetadataRecorder extends TestHandler implements FileWatchEvent.MetadataHandler {
+        final Map<String, String> changes = [:]
+        final Map<String, Long> inodes = [:]
+
+        @Override
+        void handleChangeEvent(FileWatchEvent.ChangeType type, String absolutePath, boolean directory, @Nullable ChangedFileMetadata metadata) {
+            changes[absolutePath] = "$type ${directory ? "directory" : "file"} ${metadata?.type} ${metadata?.size ?: 0}".toString()
+            inodes[absolutePath] = metadata?.inode
+        }
+    }
+}
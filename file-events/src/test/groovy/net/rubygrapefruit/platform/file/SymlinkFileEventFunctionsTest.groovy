@@ -16,9 +16,7 @@
 
 package net.rubygrapefruit.platform.file
 
-import net.rubygrapefruit.platform.NativeException
 import net.rubygrapefruit.platform.internal.Platform
-import spock.lang.Ignore
 import spock.lang.Requires
 import spock.lang.Unroll
 
@@ -146,7 +144,6 @@ class SymlinkFileEventFunctionsTest extends AbstractFileEventFunctionsTest {
         )
     }
 
-    @Requires({ Platform.current().macOs || Platform.current().windows })
     def "can watch directory via symlink and directly at the same time"() {
         given:
         def canonicalDir = new File(rootDir, "watchedDir")
@@ -169,29 +166,28 @@ class SymlinkFileEventFunctionsTest extends AbstractFileEventFunctionsTest {
     }
 
     @Requires({ Platform.current().linux })
-    @Ignore("The behavior doesn't seem consistent across Linux variants")
-    // Sometimes we get the same watch descriptor back when registering the watch with a different path,
-    // other times not, but freeing the resulting watchers leads to errors
-    def "fails when watching same directory both directly and via symlink"() {
+    def "stops watching directory via symlink and directly independently"() {
         given:
         def canonicalDir = new File(rootDir, "watchedDir")
         canonicalDir.mkdirs()
         def linkedDir = new File(rootDir, "linked")
         createSymlink(linkedDir, canonicalDir)
+        startWatcher(canonicalDir, linkedDir)
 
         when:
-        startWatcher(canonicalDir, linkedDir)
+        assert watcher.stopWatching(canonicalDir)
+        def createdFile = new File(canonicalDir, "created.txt")
+        createNewFile(createdFile)
 
         then:
-        def ex = thrown NativeException
-        ex.message == "Already watching path: ${linkedDir.absolutePath}"
+        expectEvents change(CREATED, new File(linkedDir, "created.txt"))
 
         when:
-        startWatcher(linkedDir, canonicalDir)
+        assert watcher.stopWatching(linkedDir)
+        createNewFile(new File(canonicalDir, "other.txt"))
 
         then:
-        ex = thrown NativeException
-        ex.message == "Already watching path: ${canonicalDir.absolutePath}"
+        expectNoEvents()
     }
 
     private void createSymlink(File linked, File target) {
@@ -22,11 +22,21 @@
 #include "generic.h"
 #include "net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions.h"
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <mntent.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/inotify.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#if defined(STATX_BASIC_STATS) && __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
 
 /*
  * File system functions
@@ -54,4 +64,186 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileSystemFunctions_listFileS
     endmntent(fp);
 }
 
+/*
+ * io_uring based file functions
+ */
+#ifdef HAVE_IO_URING
+
+// Requests in flight at the same time, so the file system can work on many of them at once
+#define URING_QUEUE_DEPTH 256
+
+// Whether io_uring can stat files on this machine: 0 when not known yet, 1 when it can, -1 when it can't
+static int uringSupport = 0;
+
+typedef struct uring {
+    int fd;
+    unsigned entries;
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+} uring_t;
+
+static void closeUring(uring_t* ring) {
+    if (ring->sqes != MAP_FAILED) {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    if (ring->cqRing != MAP_FAILED && ring->cqRing != ring->sqRing) {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqRing != MAP_FAILED) {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    close(ring->fd);
+}
+
+static bool openUring(uring_t* ring, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        return false;
+    }
+    ring->entries = params.sq_entries;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap && ring->cqRingSize > ring->sqRingSize) {
+        ring->sqRingSize = ring->cqRingSize;
+    }
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    ring->cqRing = singleMmap
+        ? ring->sqRing
+        : mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = (struct io_uring_sqe*) mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        closeUring(ring);
+        return false;
+    }
+    char* sq = (char*) ring->sqRing;
+    ring->sqHead = (unsigned*) (sq + params.sq_off.head);
+    ring->sqTail = (unsigned*) (sq + params.sq_off.tail);
+    ring->sqMask = (unsigned*) (sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned*) (sq + params.sq_off.array);
+    char* cq = (char*) ring->cqRing;
+    ring->cqHead = (unsigned*) (cq + params.cq_off.head);
+    ring->cqTail = (unsigned*) (cq + params.cq_off.tail);
+    ring->cqMask = (unsigned*) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+    return true;
+}
+
+/*
+ * Checks whether the kernel supports IORING_OP_STATX, which needs Linux 5.6.
+ */
+static bool uringSupportsStatx(uring_t* ring) {
+    size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe* probe = (struct io_uring_probe*) calloc(1, size);
+    if (probe == NULL) {
+        return false;
+    }
+    bool supported = syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) == 0
+        && probe->last_op >= IORING_OP_STATX
+        && (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED) != 0;
+    free(probe);
+    return supported;
+}
+
+bool uring_statx(char** paths, int count, int flags, unsigned int mask, struct statx* results, int* errors) {
+    if (__atomic_load_n(&uringSupport, __ATOMIC_RELAXED) < 0) {
+        return false;
+    }
+    uring_t ring;
+    if (!openUring(&ring, count < URING_QUEUE_DEPTH ? count : URING_QUEUE_DEPTH)) {
+        if (errno == ENOSYS || errno == EPERM || errno == EACCES) {
+            // Not built into the kernel, or disabled
+            __atomic_store_n(&uringSupport, -1, __ATOMIC_RELAXED);
+        }
+        return false;
+    }
+    if (__atomic_load_n(&uringSupport, __ATOMIC_RELAXED) == 0) {
+        __atomic_store_n(&uringSupport, uringSupportsStatx(&ring) ? 1 : -1, __ATOMIC_RELAXED);
+    }
+    if (__atomic_load_n(&uringSupport, __ATOMIC_RELAXED) < 0) {
+        closeUring(&ring);
+        return false;
+    }
+
+    for (int i = 0; i < count; i++) {
+        errors[i] = -1;
+    }
+    int submitted = 0;
+    unsigned inFlight = 0;
+    bool failed = false;
+    while ((submitted < count && !failed) || inFlight > 0) {
+        // The kernel doesn't take more requests than the ring holds, so the completion ring never overflows
+        unsigned tail = *ring.sqTail;
+        while (!failed && submitted < count && inFlight < ring.entries) {
+            unsigned index = tail & *ring.sqMask;
+            struct io_uring_sqe* sqe = &ring.sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = (unsigned long) paths[submitted];
+            sqe->len = mask;
+            sqe->off = (unsigned long) &results[submitted];
+            sqe->statx_flags = flags;
+            sqe->user_data = submitted;
+            ring.sqArray[index] = index;
+            tail++;
+            submitted++;
+            inFlight++;
+        }
+        __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+
+        // Also submits what the kernel did not take the last time
+        unsigned toSubmit = tail - __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE);
+        int retval = (int) syscall(__NR_io_uring_enter, ring.fd, toSubmit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (retval < 0 && errno == EINTR) {
+            // Interrupted while waiting, whatever has completed is reaped below
+        } else if (retval < 0 && (errno == EAGAIN || errno == EBUSY) && inFlight > toSubmit) {
+            // Out of resources until some of the requests the kernel has taken complete, wait for them before submitting again
+            syscall(__NR_io_uring_enter, ring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        } else if (retval < 0 && !failed) {
+            // Take back what the kernel hasn't picked up and wait for the requests in flight, the caller stats the rest.
+            // The requests in flight write to the results, so they need to complete before returning
+            failed = true;
+            unsigned unsubmitted = tail - __atomic_load_n(ring.sqHead, __ATOMIC_ACQUIRE);
+            inFlight -= unsubmitted;
+            __atomic_store_n(ring.sqTail, tail - unsubmitted, __ATOMIC_RELEASE);
+        }
+
+        unsigned head = *ring.cqHead;
+        unsigned cqTail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+        while (head != cqTail) {
+            struct io_uring_cqe* cqe = &ring.cqes[head & *ring.cqMask];
+            errors[cqe->user_data] = cqe->res < 0 ? -cqe->res : 0;
+            head++;
+            inFlight--;
+        }
+        __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+    }
+    closeUring(&ring);
+    return true;
+}
+
+#else
+
+bool uring_statx(char** paths, int count, int flags, unsigned int mask, struct statx* results, int* errors) {
+    return false;
+}
+
+#endif
+
 #endif
@@ -25,18 +25,28 @@
 #include "net_rubygrapefruit_platform_internal_jni_PosixProcessFunctions.h"
 #include "net_rubygrapefruit_platform_internal_jni_PosixTerminalFunctions.h"
 #include "net_rubygrapefruit_platform_internal_jni_PosixTypeFunctions.h"
+#include "sha256.h"
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
 #include <sys/types.h>
 #include <sys/utsname.h>
 #include <termios.h>
 #include <unistd.h>
 
 jmethodID fileStatDetailsMethodId;
+jmethodID fileDetailsMethodId;
 
 JNIEXPORT void JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_NativeLibraryFunctions_getSystemInfo(JNIEnv* env, jclass target, jobject info, jobject result) {
@@ -73,41 +83,61 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixTypeFunctions_getNativeTypeIn
  * File functions
  */
 
+/*
+ * The functions taking a char* path below take ownership of the path, and are shared between the variants
+ * of the JNI functions that take the path as a Java string and as the raw bytes of the path.
+ */
+
+static void chmodFile(JNIEnv* env, char* pathStr, jint mode, jobject result) {
+    int retval = chmod(pathStr, mode);
+    free(pathStr);
+    if (retval != 0) {
+        mark_failed_with_errno(env, "could not chmod file", result);
+    }
+}
+
 JNIEXPORT void JNICALL
 Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_chmod(JNIEnv* env, jclass target, jstring path, jint mode, jobject result) {
     char* pathStr = java_to_char(env, path, result);
     if (pathStr == NULL) {
         return;
     }
-    int retval = chmod(pathStr, mode);
-    free(pathStr);
-    if (retval != 0) {
-        mark_failed_with_errno(env, "could not chmod file", result);
+    chmodFile(env, pathStr, mode, result);
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_chmodBytes(JNIEnv* env, jclass target, jbyteArray path, jint mode, jobject result) {
+    char* pathStr = java_bytes_to_char(env, path, result);
+    if (pathStr == NULL) {
+        return;
     }
+    chmodFile(env, pathStr, mode, result);
 }
 
 jlong toMillis(struct timespec t) {
     return (jlong)(t.tv_sec) * 1000 + (jlong)(t.tv_nsec) / 1000000;
 }
 
-void unpackStat(struct stat* source, file_stat_t* result) {
-    switch (source->st_mode & S_IFMT) {
+static jlong toNanos(struct timespec t) {
+    return (jlong)(t.tv_sec) * 1000000000 + (jlong)(t.tv_nsec);
+}
+
+static jint toFileType(mode_t mode) {
+    switch (mode & S_IFMT) {
         case S_IFREG:
-            result->fileType = FILE_TYPE_FILE;
-            result->size = source->st_size;
-            break;
+            return FILE_TYPE_FILE;
         case S_IFDIR:
-            result->fileType = FILE_TYPE_DIRECTORY;
-            result->size = 0;
-            break;
+            return FILE_TYPE_DIRECTORY;
         case S_IFLNK:
-            result->fileType = FILE_TYPE_SYMLINK;
-            result->size = 0;
-            break;
+            return FILE_TYPE_SYMLINK;
         default:
-            result->fileType = FILE_TYPE_OTHER;
-            result->size = 0;
+            return FILE_TYPE_OTHER;
     }
+}
+
+void unpackStat(struct stat* source, file_stat_t* result) {
+    result->fileType = toFileType(source->st_mode);
+    result->size = result->fileType == FILE_TYPE_FILE ? source->st_size : 0;
 #ifdef __linux__
     result->lastModified = toMillis(source->st_mtim);
 #else
@@ -115,13 +145,8 @@ void unpackStat(struct stat* source, file_stat_t* result) {
 #endif
 }
 
-JNIEXPORT void JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_stat(JNIEnv* env, jclass target, jstring path, jboolean followLink, jobject dest, jobject result) {
+static void statFile(JNIEnv* env, char* pathStr, jboolean followLink, jobject dest, jobject result) {
     struct stat fileInfo;
-    char* pathStr = java_to_char(env, path, result);
-    if (pathStr == NULL) {
-        return;
-    }
     int retval;
     if (followLink) {
         retval = stat(pathStr, &fileInfo);
@@ -152,103 +177,1849 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_stat(JNIEnv* en
 }
 
 JNIEXPORT void JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_readdir(JNIEnv* env, jclass target, jstring path, jboolean followLink, jobject contents, jobject result) {
-    jclass contentsClass = env->GetObjectClass(contents);
-    jmethodID mid = env->GetMethodID(contentsClass, "addFile", "(Ljava/lang/String;IJJ)V");
-    if (mid == NULL) {
-        mark_failed_with_message(env, "could not find method", result);
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_stat(JNIEnv* env, jclass target, jstring path, jboolean followLink, jobject dest, jobject result) {
+    char* pathStr = java_to_char(env, path, result);
+    if (pathStr == NULL) {
+        return;
+    }
+    statFile(env, pathStr, followLink, dest, result);
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_statBytes(JNIEnv* env, jclass target, jbyteArray path, jboolean followLink, jobject dest, jobject result) {
+    char* pathStr = java_bytes_to_char(env, path, result);
+    if (pathStr == NULL) {
+        return;
+    }
+    statFile(env, pathStr, followLink, dest, result);
+}
+
+// Corresponds to the layout of the arrays used by DefaultPosixFiles for batches: type, mode, uid, gid, block size, errno
+#define STAT_BATCH_INTS 6
+// Size, last modified
+#define STAT_BATCH_LONGS 2
+
+// Smallest number of files worth starting another thread for
+#define STAT_BATCH_MIN_PER_THREAD 256
+#define STAT_BATCH_MAX_THREADS 8
+
+typedef struct stat_batch {
+    char** paths;
+    jboolean followLink;
+    jint* ints;
+    jlong* longs;
+    jsize start;
+    jsize end;
+} stat_batch_t;
+
+static void statBatchEntry(const char* path, jboolean followLink, jint* ints, jlong* longs) {
+    struct stat fileInfo;
+    int retval = followLink ? stat(path, &fileInfo) : lstat(path, &fileInfo);
+    if (retval != 0) {
+        ints[0] = FILE_TYPE_MISSING;
+        ints[5] = (errno == ENOENT || errno == ENOTDIR) ? 0 : errno;
+        return;
+    }
+    file_stat_t fileResult;
+    unpackStat(&fileInfo, &fileResult);
+    ints[0] = fileResult.fileType;
+    ints[1] = 0777 & fileInfo.st_mode;
+    ints[2] = fileInfo.st_uid;
+    ints[3] = fileInfo.st_gid;
+    ints[4] = fileInfo.st_blksize;
+    longs[0] = fileResult.size;
+    longs[1] = fileResult.lastModified;
+}
+
+static void* statBatch(void* arg) {
+    stat_batch_t* batch = (stat_batch_t*) arg;
+    for (jsize i = batch->start; i < batch->end; i++) {
+        statBatchEntry(batch->paths[i], batch->followLink, batch->ints + i * STAT_BATCH_INTS, batch->longs + i * STAT_BATCH_LONGS);
+    }
+    return NULL;
+}
+
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+// Smallest number of files worth setting up an io_uring for
+#define STAT_BATCH_MIN_URING 64
+
+/*
+ * Stats the files of the batch with io_uring, which saves most of the system calls. Returns false when
+ * io_uring can't be used, in which case nothing has been stat'ed.
+ */
+static bool statBatchWithUring(char** paths, jsize count, jboolean followLink, jint* ints, jlong* longs) {
+    struct statx* results = (struct statx*) malloc(count * sizeof(struct statx));
+    int* errors = (int*) malloc(count * sizeof(int));
+    if (results == NULL || errors == NULL || !uring_statx(paths, count, followLink ? 0 : AT_SYMLINK_NOFOLLOW, STATX_BASIC_STATS, results, errors)) {
+        free(results);
+        free(errors);
+        return false;
+    }
+    for (jsize i = 0; i < count; i++) {
+        jint* entryInts = ints + i * STAT_BATCH_INTS;
+        jlong* entryLongs = longs + i * STAT_BATCH_LONGS;
+        if (errors[i] == -1) {
+            statBatchEntry(paths[i], followLink, entryInts, entryLongs);
+        } else if (errors[i] != 0) {
+            entryInts[0] = FILE_TYPE_MISSING;
+            entryInts[5] = (errors[i] == ENOENT || errors[i] == ENOTDIR) ? 0 : errors[i];
+        } else {
+            struct statx* fileInfo = &results[i];
+            entryInts[0] = toFileType(fileInfo->stx_mode);
+            entryInts[1] = 0777 & fileInfo->stx_mode;
+            entryInts[2] = fileInfo->stx_uid;
+            entryInts[3] = fileInfo->stx_gid;
+            entryInts[4] = fileInfo->stx_blksize;
+            entryLongs[0] = entryInts[0] == FILE_TYPE_FILE ? fileInfo->stx_size : 0;
+            entryLongs[1] = (jlong)(fileInfo->stx_mtime.tv_sec) * 1000 + fileInfo->stx_mtime.tv_nsec / 1000000;
+        }
+    }
+    free(results);
+    free(errors);
+    return true;
+}
+#endif
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_statAll(JNIEnv* env, jclass target, jobjectArray paths, jboolean followLink, jboolean useIoUring, jintArray intsDest, jlongArray longsDest, jobject result) {
+    jsize count = env->GetArrayLength(paths);
+    if (count == 0) {
+        return;
+    }
+    char** pathStrs = (char**) calloc(count, sizeof(char*));
+    jint* ints = (jint*) calloc(count * STAT_BATCH_INTS, sizeof(jint));
+    jlong* longs = (jlong*) calloc(count * STAT_BATCH_LONGS, sizeof(jlong));
+    if (pathStrs == NULL || ints == NULL || longs == NULL) {
+        mark_failed_with_message(env, "could not allocate memory", result);
+        free(pathStrs);
+        free(ints);
+        free(longs);
         return;
     }
+    bool converted = true;
+    for (jsize i = 0; i < count && converted; i++) {
+        jstring path = (jstring) env->GetObjectArrayElement(paths, i);
+        pathStrs[i] = java_to_char(env, path, result);
+        env->DeleteLocalRef(path);
+        converted = pathStrs[i] != NULL;
+    }
+
+    bool done = !converted;
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+    if (!done && useIoUring && count >= STAT_BATCH_MIN_URING) {
+        done = statBatchWithUring(pathStrs, count, followLink, ints, longs);
+    }
+#endif
+    if (!done) {
+        // Split large batches between threads, the files are stat'ed while the JVM carries on
+        long threadCount = sysconf(_SC_NPROCESSORS_ONLN);
+        if (threadCount > count / STAT_BATCH_MIN_PER_THREAD) {
+            threadCount = count / STAT_BATCH_MIN_PER_THREAD;
+        }
+        if (threadCount > STAT_BATCH_MAX_THREADS) {
+            threadCount = STAT_BATCH_MAX_THREADS;
+        }
+        if (threadCount < 1) {
+            threadCount = 1;
+        }
+        stat_batch_t batches[STAT_BATCH_MAX_THREADS];
+        pthread_t threads[STAT_BATCH_MAX_THREADS];
+        bool started[STAT_BATCH_MAX_THREADS];
+        for (long t = 0; t < threadCount; t++) {
+            batches[t].paths = pathStrs;
+            batches[t].followLink = followLink;
+            batches[t].ints = ints;
+            batches[t].longs = longs;
+            batches[t].start = (jsize) (count * t / threadCount);
+            batches[t].end = (jsize) (count * (t + 1) / threadCount);
+            // The calling thread takes the first batch itself, and any batch a thread could not be started for
+            started[t] = t > 0 && pthread_create(&threads[t], NULL, statBatch, &batches[t]) == 0;
+        }
+        for (long t = 0; t < threadCount; t++) {
+            if (!started[t]) {
+                statBatch(&batches[t]);
+            }
+        }
+        for (long t = 1; t < threadCount; t++) {
+            if (started[t]) {
+                pthread_join(threads[t], NULL);
+            }
+        }
+    }
+
+    if (converted) {
+        env->SetIntArrayRegion(intsDest, 0, count * STAT_BATCH_INTS, ints);
+        env->SetLongArrayRegion(longsDest, 0, count * STAT_BATCH_LONGS, longs);
+        for (jsize i = 0; i < count; i++) {
+            if (ints[i * STAT_BATCH_INTS + 5] != 0) {
+                // Report the first failure, the caller finds the file from the error code of each entry
+                errno = ints[i * STAT_BATCH_INTS + 5];
+                mark_failed_with_errno(env, "could not stat file", result);
+                break;
+            }
+        }
+    }
 
+    for (jsize i = 0; i < count; i++) {
+        free(pathStrs[i]);
+    }
+    free(pathStrs);
+    free(ints);
+    free(longs);
+}
+
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+static jlong toNanos(struct statx_timestamp t) {
+    return (jlong)(t.tv_sec) * 1000000000 + (jlong)(t.tv_nsec);
+}
+
+static struct statx_timestamp toStatxTimestamp(struct timespec t) {
+    struct statx_timestamp result;
+    memset(&result, 0, sizeof(result));
+    result.tv_sec = t.tv_sec;
+    result.tv_nsec = t.tv_nsec;
+    return result;
+}
+
+static int statxOrFstatat(const char* pathStr, jboolean followLink, unsigned int mask, struct statx* result) {
+    int retval;
+#ifdef SYS_statx
+    // Call the kernel directly, the C library might be too old to provide statx()
+    int flags = AT_STATX_DONT_SYNC | (followLink ? 0 : AT_SYMLINK_NOFOLLOW);
+    retval = syscall(SYS_statx, AT_FDCWD, pathStr, flags, mask, result);
+    // Kernels before 4.11 don't know statx(), and the seccomp filters of some containers reject it
+    if (retval == 0 || (errno != ENOSYS && errno != EPERM)) {
+        return retval;
+    }
+#endif
+    struct stat fileInfo;
+    retval = fstatat(AT_FDCWD, pathStr, &fileInfo, followLink ? 0 : AT_SYMLINK_NOFOLLOW);
+    if (retval != 0) {
+        return retval;
+    }
+    memset(result, 0, sizeof(struct statx));
+    result->stx_mask = STATX_BASIC_STATS;
+    result->stx_mode = fileInfo.st_mode;
+    result->stx_size = fileInfo.st_size;
+    result->stx_mtime = toStatxTimestamp(fileInfo.st_mtim);
+    result->stx_ctime = toStatxTimestamp(fileInfo.st_ctim);
+    result->stx_ino = fileInfo.st_ino;
+    result->stx_dev_major = major(fileInfo.st_dev);
+    result->stx_dev_minor = minor(fileInfo.st_dev);
+    result->stx_nlink = fileInfo.st_nlink;
+    return 0;
+}
+#endif
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_statx(JNIEnv* env, jclass target, jstring path, jboolean followLink, jint fields, jobject dest, jobject result) {
     char* pathStr = java_to_char(env, path, result);
     if (pathStr == NULL) {
         return;
     }
-    long pathLen = strlen(pathStr);
-    DIR* dir = opendir(pathStr);
-    if (dir == NULL) {
-        mark_failed_with_errno(env, "could not open directory", result);
-        free(pathStr);
+    jint fileType;
+    jint available = 0;
+    jint mode = 0;
+    jlong size = 0;
+    jlong modified = 0;
+    jlong changed = 0;
+    jlong created = 0;
+    jlong inode = 0;
+    jlong device = 0;
+    jlong linkCount = 0;
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+    // Only ask for what is needed, so the file system can skip the work for the rest
+    unsigned int mask = STATX_TYPE;
+    if (fields & FILE_FIELD_MODE) {
+        mask |= STATX_MODE;
+    }
+    if (fields & FILE_FIELD_SIZE) {
+        mask |= STATX_SIZE;
+    }
+    if (fields & FILE_FIELD_MODIFIED) {
+        mask |= STATX_MTIME;
+    }
+    if (fields & FILE_FIELD_CHANGED) {
+        mask |= STATX_CTIME;
+    }
+    if (fields & FILE_FIELD_CREATED) {
+        mask |= STATX_BTIME;
+    }
+    if (fields & FILE_FIELD_INODE) {
+        mask |= STATX_INO;
+    }
+    if (fields & FILE_FIELD_LINK_COUNT) {
+        mask |= STATX_NLINK;
+    }
+    struct statx fileInfo;
+    int retval = statxOrFstatat(pathStr, followLink, mask, &fileInfo);
+#else
+    struct stat fileInfo;
+    int retval = fstatat(AT_FDCWD, pathStr, &fileInfo, followLink ? 0 : AT_SYMLINK_NOFOLLOW);
+#endif
+    free(pathStr);
+    if (retval != 0 && errno != ENOENT && errno != ENOTDIR) {
+        mark_failed_with_errno(env, "could not stat file", result);
         return;
     }
-    struct dirent entry;
-    struct dirent* next;
-    while (true) {
-        if (readdir_r(dir, &entry, &next) != 0) {
-            mark_failed_with_errno(env, "could not read directory entry", result);
+
+    if (retval != 0) {
+        fileType = FILE_TYPE_MISSING;
+    } else {
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+        fileType = toFileType(fileInfo.stx_mode);
+        // The device is always reported
+        jint returned = FILE_FIELD_DEVICE;
+        if (fileInfo.stx_mask & STATX_MODE) {
+            returned |= FILE_FIELD_MODE;
+        }
+        if (fileInfo.stx_mask & STATX_SIZE) {
+            returned |= FILE_FIELD_SIZE;
+        }
+        if (fileInfo.stx_mask & STATX_MTIME) {
+            returned |= FILE_FIELD_MODIFIED;
+        }
+        if (fileInfo.stx_mask & STATX_CTIME) {
+            returned |= FILE_FIELD_CHANGED;
+        }
+        if (fileInfo.stx_mask & STATX_BTIME) {
+            returned |= FILE_FIELD_CREATED;
+        }
+        if (fileInfo.stx_mask & STATX_INO) {
+            returned |= FILE_FIELD_INODE;
+        }
+        if (fileInfo.stx_mask & STATX_NLINK) {
+            returned |= FILE_FIELD_LINK_COUNT;
+        }
+        available = fields & returned;
+        mode = 0777 & fileInfo.stx_mode;
+        size = fileInfo.stx_size;
+        modified = toNanos(fileInfo.stx_mtime);
+        changed = toNanos(fileInfo.stx_ctime);
+        created = toNanos(fileInfo.stx_btime);
+        inode = fileInfo.stx_ino;
+        device = makedev(fileInfo.stx_dev_major, fileInfo.stx_dev_minor);
+        linkCount = fileInfo.stx_nlink;
+#else
+        fileType = toFileType(fileInfo.st_mode);
+        available = fields & ~FILE_FIELD_CREATED;
+        mode = 0777 & fileInfo.st_mode;
+        size = fileInfo.st_size;
+#ifdef __linux__
+        modified = toNanos(fileInfo.st_mtim);
+        changed = toNanos(fileInfo.st_ctim);
+#else
+        modified = toNanos(fileInfo.st_mtimespec);
+        changed = toNanos(fileInfo.st_ctimespec);
+        created = toNanos(fileInfo.st_birthtimespec);
+        available |= fields & FILE_FIELD_CREATED;
+#endif
+        inode = fileInfo.st_ino;
+        device = fileInfo.st_dev;
+        linkCount = fileInfo.st_nlink;
+#endif
+        if (fileType != FILE_TYPE_FILE) {
+            size = 0;
+        }
+    }
+
+    env->CallVoidMethod(dest,
+        fileDetailsMethodId,
+        fileType,
+        available,
+        (available & FILE_FIELD_MODE) ? mode : 0,
+        (available & FILE_FIELD_SIZE) ? size : 0,
+        (available & FILE_FIELD_MODIFIED) ? modified : 0,
+        (available & FILE_FIELD_CHANGED) ? changed : 0,
+        (available & FILE_FIELD_CREATED) ? created : 0,
+        (available & FILE_FIELD_INODE) ? inode : 0,
+        (available & FILE_FIELD_DEVICE) ? device : 0,
+        (available & FILE_FIELD_LINK_COUNT) ? linkCount : 0);
+}
+
+#ifdef __linux__
+// Layout of the records returned by getdents64(), which glibc only exposes as of 2.30
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Read many entries per system call, directories with lots of entries are common for build outputs
+#define DIRENT_BUFFER_SIZE (64 * 1024)
+#endif
+
+/*
+ * Called for each entry of a directory, with the type of the entry as reported by the file system.
+ * Returns false when the listing needs to be aborted.
+ */
+typedef bool (*dir_entry_visitor_t)(void* context, int dirFd, const char* name, unsigned char dType);
+
+/*
+ * Calls the visitor for each entry of the given open directory, including "." and "..", and closes the directory.
+ * Returns the errno of the failure to read the directory, or 0.
+ */
+static int visitDirEntries(int dirFd, dir_entry_visitor_t visitor, void* context) {
+#ifdef __linux__
+    char* buffer = (char*) malloc(DIRENT_BUFFER_SIZE);
+    if (buffer == NULL) {
+        close(dirFd);
+        return ENOMEM;
+    }
+    int error = 0;
+    bool stopped = false;
+    while (!stopped) {
+        long bytesRead = syscall(SYS_getdents64, dirFd, buffer, DIRENT_BUFFER_SIZE);
+        if (bytesRead == -1) {
+            error = errno;
             break;
         }
-        if (next == NULL) {
+        if (bytesRead == 0) {
             break;
         }
-        if (strcmp(".", entry.d_name) == 0 || strcmp("..", entry.d_name) == 0) {
-            continue;
+        for (long offset = 0; offset < bytesRead;) {
+            struct linux_dirent64* entry = (struct linux_dirent64*) (buffer + offset);
+            offset += entry->d_reclen;
+            if (!visitor(context, dirFd, entry->d_name, entry->d_type)) {
+                stopped = true;
+                break;
+            }
+        }
+    }
+    free(buffer);
+    close(dirFd);
+    return error;
+#else
+    DIR* dir = fdopendir(dirFd);
+    if (dir == NULL) {
+        int error = errno;
+        close(dirFd);
+        return error;
+    }
+    int error = 0;
+    while (true) {
+        // readdir() is thread-safe for different directory streams, unlike the deprecated readdir_r() it handles long names
+        errno = 0;
+        struct dirent* entry = readdir(dir);
+        if (entry == NULL) {
+            error = errno;
+            break;
+        }
+        if (!visitor(context, dirFd, entry->d_name, entry->d_type)) {
+            break;
         }
+    }
+    // Also closes the file descriptor
+    closedir(dir);
+    return error;
+#endif
+}
+
+/*
+ * Maps the type reported with a directory entry to the FILE_TYPE_* constants. Returns -1 when the
+ * file system doesn't report the type, or when the type of the symlink target is needed.
+ */
+static int fileTypeOf(unsigned char dType, jboolean followLink) {
+    switch (dType) {
+        case DT_REG:
+            return FILE_TYPE_FILE;
+        case DT_DIR:
+            return FILE_TYPE_DIRECTORY;
+        case DT_LNK:
+            return followLink ? -1 : FILE_TYPE_SYMLINK;
+        case DT_UNKNOWN:
+            return -1;
+        default:
+            return FILE_TYPE_OTHER;
+    }
+}
+
+typedef struct dir_list_context {
+    JNIEnv* env;
+    jobject contents;
+    jmethodID mid;
+    jboolean followLink;
+    jboolean typesOnly;
+    // Report the raw bytes of the names instead of Java strings
+    bool encodedNames;
+    jobject result;
+} dir_list_context_t;
 
-        size_t childPathLen = pathLen + strlen(entry.d_name) + 2;
-        char* childPath = (char*) malloc(childPathLen);
-        strncpy(childPath, pathStr, pathLen);
-        childPath[pathLen] = '/';
-        strcpy(childPath + pathLen + 1, entry.d_name);
+/*
+ * Stats an entry relative to its directory and reports it to the DirList, so the kernel doesn't
+ * need to resolve the whole path again. When only types are requested, the entry is only stat'ed
+ * if its type is not known from the directory entry itself.
+ */
+static bool addDirEntry(void* context, int dirFd, const char* name, unsigned char dType) {
+    if (strcmp(".", name) == 0 || strcmp("..", name) == 0) {
+        return true;
+    }
+    dir_list_context_t* list = (dir_list_context_t*) context;
+    JNIEnv* env = list->env;
 
+    file_stat fileResult;
+    int fileType = list->typesOnly ? fileTypeOf(dType, list->followLink) : -1;
+    if (fileType != -1) {
+        fileResult.fileType = fileType;
+    } else {
         struct stat fileInfo;
-        int retval;
-        if (followLink) {
-            retval = stat(childPath, &fileInfo);
-        } else {
-            retval = lstat(childPath, &fileInfo);
-        }
-        free(childPath);
-        file_stat fileResult;
+        int retval = fstatat(dirFd, name, &fileInfo, list->followLink ? 0 : AT_SYMLINK_NOFOLLOW);
         if (retval != 0) {
-            if (!followLink || errno != ENOENT) {
-                mark_failed_with_errno(env, "could not stat file", result);
-                break;
+            if (!list->followLink || errno != ENOENT) {
+                mark_failed_with_errno(env, "could not stat file", list->result);
+                return false;
             }
             fileResult.fileType = FILE_TYPE_MISSING;
-            fileResult.size = 0;
-            fileResult.lastModified = 0;
         } else {
             unpackStat(&fileInfo, &fileResult);
         }
+    }
+    if (list->typesOnly || fileResult.fileType == FILE_TYPE_MISSING) {
+        fileResult.size = 0;
+        fileResult.lastModified = 0;
+    }
 
-        jstring childName = char_to_java(env, entry.d_name, result);
-        env->CallVoidMethod(contents, mid, childName, fileResult.fileType, fileResult.size, fileResult.lastModified);
+    jobject childName = list->encodedNames ? (jobject) char_to_java_bytes(env, name, list->result) : (jobject) char_to_java(env, name, list->result);
+    if (childName == NULL) {
+        return false;
     }
+    env->CallVoidMethod(list->contents, list->mid, childName, fileResult.fileType, fileResult.size, fileResult.lastModified);
+    // Large directories would otherwise fill up the local reference table
+    env->DeleteLocalRef(childName);
+    return true;
+}
 
-    closedir(dir);
+static void readdirFile(JNIEnv* env, char* pathStr, jboolean followLink, jboolean typesOnly, bool encodedNames, jobject contents, jobject result) {
+    jclass contentsClass = env->GetObjectClass(contents);
+    jmethodID mid = env->GetMethodID(contentsClass, "addFile", encodedNames ? "([BIJJ)V" : "(Ljava/lang/String;IJJ)V");
+    if (mid == NULL) {
+        free(pathStr);
+        mark_failed_with_message(env, "could not find method", result);
+        return;
+    }
+
+    int dirFd = open(pathStr, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
     free(pathStr);
+    if (dirFd == -1) {
+        mark_failed_with_errno(env, "could not open directory", result);
+        return;
+    }
+
+    dir_list_context_t context = { env, contents, mid, followLink, typesOnly, encodedNames, result };
+    int error = visitDirEntries(dirFd, addDirEntry, &context);
+    if (error != 0) {
+        errno = error;
+        mark_failed_with_errno(env, "could not read directory entry", result);
+    }
 }
 
 JNIEXPORT void JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_symlink(JNIEnv* env, jclass target, jstring path, jstring contents, jobject result) {
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_readdir(JNIEnv* env, jclass target, jstring path, jboolean followLink, jboolean typesOnly, jobject contents, jobject result) {
     char* pathStr = java_to_char(env, path, result);
     if (pathStr == NULL) {
         return;
     }
-    char* contentStr = java_to_char(env, contents, result);
-    if (contentStr == NULL) {
-        free(pathStr);
+    readdirFile(env, pathStr, followLink, typesOnly, false, contents, result);
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_readdirBytes(JNIEnv* env, jclass target, jbyteArray path, jboolean followLink, jobject contents, jobject result) {
+    char* pathStr = java_bytes_to_char(env, path, result);
+    if (pathStr == NULL) {
         return;
     }
-    int retval = symlink(contentStr, pathStr);
-    free(contentStr);
-    free(pathStr);
-    if (retval != 0) {
-        mark_failed_with_errno(env, "could not symlink", result);
+    readdirFile(env, pathStr, followLink, false, true, contents, result);
+}
+
+/*
+ * Streaming directory listing
+ */
+
+// Corresponds to the layout of the records read by PosixDirStream: type, name offset, name length, padding, size, last modified
+#define DIR_STREAM_RECORD_SIZE 32
+
+typedef struct dir_stream {
+    int fd;
+#ifdef __linux__
+    char* buffer;
+    long bytesRead;
+    long offset;
+#else
+    DIR* dir;
+    struct dirent* pending;
+#endif
+} dir_stream_t;
+
+/*
+ * Returns the next entry of the directory without consuming it. Returns NULL at the end of the directory,
+ * and on failure with errno set.
+ */
+static const char* peekDirEntry(dir_stream_t* stream) {
+#ifdef __linux__
+    if (stream->offset >= stream->bytesRead) {
+        long bytesRead = syscall(SYS_getdents64, stream->fd, stream->buffer, DIRENT_BUFFER_SIZE);
+        if (bytesRead <= 0) {
+            if (bytesRead == 0) {
+                errno = 0;
+            }
+            return NULL;
+        }
+        stream->bytesRead = bytesRead;
+        stream->offset = 0;
     }
+    return ((struct linux_dirent64*) (stream->buffer + stream->offset))->d_name;
+#else
+    if (stream->pending == NULL) {
+        errno = 0;
+        stream->pending = readdir(stream->dir);
+        if (stream->pending == NULL) {
+            return NULL;
+        }
+    }
+    return stream->pending->d_name;
+#endif
 }
 
-JNIEXPORT jstring JNICALL
-Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_readlink(JNIEnv* env, jclass target, jstring path, jobject result) {
-    struct stat link_info;
+static void consumeDirEntry(dir_stream_t* stream) {
+#ifdef __linux__
+    stream->offset += ((struct linux_dirent64*) (stream->buffer + stream->offset))->d_reclen;
+#else
+    stream->pending = NULL;
+#endif
+}
+
+JNIEXPORT jlong JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_opendir(JNIEnv* env, jclass target, jstring path, jobject result) {
     char* pathStr = java_to_char(env, path, result);
     if (pathStr == NULL) {
-        return NULL;
+        return 0;
     }
-    int retval = lstat(pathStr, &link_info);
-    if (retval != 0) {
-        free(pathStr);
+    int dirFd = open(pathStr, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    free(pathStr);
+    if (dirFd == -1) {
+        mark_failed_with_errno(env, "could not open directory", result);
+        return 0;
+    }
+    dir_stream_t* stream = (dir_stream_t*) calloc(1, sizeof(dir_stream_t));
+    if (stream == NULL) {
+        mark_failed_with_message(env, "could not allocate memory", result);
+        close(dirFd);
+        return 0;
+    }
+    stream->fd = dirFd;
+#ifdef __linux__
+    stream->buffer = (char*) malloc(DIRENT_BUFFER_SIZE);
+    if (stream->buffer == NULL) {
+        mark_failed_with_message(env, "could not allocate memory", result);
+        close(dirFd);
+        free(stream);
+        return 0;
+    }
+#else
+    stream->dir = fdopendir(dirFd);
+    if (stream->dir == NULL) {
+        mark_failed_with_errno(env, "could not open directory", result);
+        close(dirFd);
+        free(stream);
+        return 0;
+    }
+#endif
+    return (jlong) (intptr_t) stream;
+}
+
+/*
+ * Fills the given direct buffer with as many entries as fit. Records are written from the start of the buffer,
+ * and the names they point to from the end. Returns the number of entries written, 0 at the end of the directory.
+ */
+JNIEXPORT jint JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_readdirChunk(JNIEnv* env, jclass target, jlong handle, jboolean followLink, jobject buffer, jobject result) {
+    dir_stream_t* stream = (dir_stream_t*) (intptr_t) handle;
+    char* records = (char*) env->GetDirectBufferAddress(buffer);
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (records == NULL || capacity < 0) {
+        mark_failed_with_message(env, "could not access buffer", result);
+        return 0;
+    }
+    jint count = 0;
+    size_t recordsEnd = 0;
+    size_t namesStart = (size_t) capacity;
+    while (true) {
+        const char* name = peekDirEntry(stream);
+        if (name == NULL) {
+            if (errno != 0) {
+                mark_failed_with_errno(env, "could not read directory entry", result);
+            }
+            break;
+        }
+        if (strcmp(".", name) == 0 || strcmp("..", name) == 0) {
+            consumeDirEntry(stream);
+            continue;
+        }
+        size_t nameLength = strlen(name);
+        if (recordsEnd + DIR_STREAM_RECORD_SIZE + nameLength > namesStart) {
+            if (count == 0) {
+                mark_failed_with_message(env, "buffer too small for directory entry", result);
+            }
+            // Stays pending for the next chunk
+            break;
+        }
+
+        file_stat_t fileResult;
+        struct stat fileInfo;
+        if (fstatat(stream->fd, name, &fileInfo, followLink ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+            if (!followLink || errno != ENOENT) {
+                mark_failed_with_errno(env, "could not stat file", result);
+                break;
+            }
+            fileResult.fileType = FILE_TYPE_MISSING;
+            fileResult.size = 0;
+            fileResult.lastModified = 0;
+        } else {
+            unpackStat(&fileInfo, &fileResult);
+        }
+
+        namesStart -= nameLength;
+        memcpy(records + namesStart, name, nameLength);
+        char* record = records + recordsEnd;
+        jint type = fileResult.fileType;
+        jint nameOffset = (jint) namesStart;
+        jint length = (jint) nameLength;
+        jint padding = 0;
+        memcpy(record, &type, sizeof(jint));
+        memcpy(record + 4, &nameOffset, sizeof(jint));
+        memcpy(record + 8, &length, sizeof(jint));
+        memcpy(record + 12, &padding, sizeof(jint));
+        memcpy(record + 16, &fileResult.size, sizeof(jlong));
+        memcpy(record + 24, &fileResult.lastModified, sizeof(jlong));
+        recordsEnd += DIR_STREAM_RECORD_SIZE;
+        count++;
+        consumeDirEntry(stream);
+    }
+    return count;
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_closedir(JNIEnv* env, jclass target, jlong handle) {
+    dir_stream_t* stream = (dir_stream_t*) (intptr_t) handle;
+#ifdef __linux__
+    free(stream->buffer);
+    close(stream->fd);
+#else
+    // Also closes the file descriptor
+    closedir(stream->dir);
+#endif
+    free(stream);
+}
+
+/*
+ * Recursive directory walk
+ */
+
+// Entries delivered to Java per call, corresponds to WalkCollector.BATCH_SIZE
+#define WALK_BATCH_SIZE 1024
+// Batches waiting to be delivered to Java per thread, before the walking threads wait for Java to catch up
+#define WALK_PENDING_BATCHES_PER_THREAD 4
+
+typedef struct dir_id {
+    dev_t dev;
+    ino_t ino;
+} dir_id_t;
+
+// An open directory whose subdirectories are opened relative to it, shared by the subdirectories waiting to be walked
+typedef struct walk_parent {
+    int fd;
+    // Guarded by the walk lock, the directory is closed once the listing and all subdirectories are done with it
+    int refs;
+} walk_parent_t;
+
+typedef struct walk_dir {
+    // Relative to the root, empty for the root itself
+    char* path;
+    int depth;
+    // NULL for the root, and once the directory has been opened
+    walk_parent_t* parent;
+    // The directory followed by its parents, only used when following symlinks
+    dir_id_t* ancestors;
+    struct walk_dir* next;
+} walk_dir_t;
+
+typedef struct walk_batch {
+    int count;
+    jint types[WALK_BATCH_SIZE];
+    jlong sizes[WALK_BATCH_SIZE];
+    jlong lastModified[WALK_BATCH_SIZE];
+    // Offsets of the NULL terminated relative paths in names
+    size_t offsets[WALK_BATCH_SIZE];
+    char* names;
+    size_t namesLength;
+    size_t namesCapacity;
+    struct walk_batch* next;
+} walk_batch_t;
+
+struct fingerprint;
+
+typedef struct walk {
+    const char* root;
+    int maxDepth;
+    jboolean followLinks;
+
+    // Guards everything below
+    pthread_mutex_t lock;
+    // Signalled when directories are added, or the walk stops
+    pthread_cond_t dirsChanged;
+    // Signalled when batches are added, or a thread finishes
+    pthread_cond_t batchesAdded;
+    // Signalled when batches are taken, or the walk stops
+    pthread_cond_t batchesTaken;
+
+    // Directories waiting to be listed, listed depth first to keep this short
+    walk_dir_t* dirs;
+    // Number of directories being listed
+    int busy;
+    walk_batch_t* batches;
+    walk_batch_t* lastBatch;
+    int pendingBatches;
+    int maxPendingBatches;
+    int runningThreads;
+    bool stopped;
+    int failureErrno;
+    char* failurePath;
+
+    // When set, the directories are fingerprinted instead of reported in batches
+    struct fingerprint* fingerprint;
+} walk_t;
+
+/*
+ * Stops the walk, remembering the first failure. Called with the lock held.
+ */
+static void failWalk(walk_t* walk, int error, const char* path) {
+    if (!walk->stopped) {
+        walk->failureErrno = error;
+        walk->failurePath = strdup(path);
+        walk->stopped = true;
+    }
+    pthread_cond_broadcast(&walk->dirsChanged);
+    pthread_cond_broadcast(&walk->batchesTaken);
+}
+
+static void freeBatch(walk_batch_t* batch) {
+    free(batch->names);
+    free(batch);
+}
+
+/*
+ * Hands a batch over to the thread delivering batches to Java. Called with the lock held.
+ * Returns false when the walk has stopped.
+ */
+static bool publishBatch(walk_t* walk, walk_batch_t* batch) {
+    while (walk->pendingBatches >= walk->maxPendingBatches && !walk->stopped) {
+        pthread_cond_wait(&walk->batchesTaken, &walk->lock);
+    }
+    if (walk->stopped) {
+        freeBatch(batch);
+        return false;
+    }
+    batch->next = NULL;
+    if (walk->lastBatch == NULL) {
+        walk->batches = batch;
+    } else {
+        walk->lastBatch->next = batch;
+    }
+    walk->lastBatch = batch;
+    walk->pendingBatches++;
+    pthread_cond_signal(&walk->batchesAdded);
+    return true;
+}
+
+/*
+ * Returns the parent handle for the subdirectories of the directory being listed, opening it for the first one.
+ * Called with the lock held. Returns NULL on failure.
+ */
+static walk_parent_t* retainWalkParent(walk_parent_t** parent, int dirFd) {
+    if (*parent == NULL) {
+        walk_parent_t* created = (walk_parent_t*) malloc(sizeof(walk_parent_t));
+        if (created == NULL) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        // The listing closes its own descriptor when it is done
+        created->fd = fcntl(dirFd, F_DUPFD_CLOEXEC, 0);
+        if (created->fd == -1) {
+            free(created);
+            return NULL;
+        }
+        // Held by the listing
+        created->refs = 1;
+        *parent = created;
+    }
+    (*parent)->refs++;
+    return *parent;
+}
+
+static void releaseWalkParent(walk_t* walk, walk_parent_t* parent) {
+    if (parent == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&walk->lock);
+    bool unused = --parent->refs == 0;
+    pthread_mutex_unlock(&walk->lock);
+    if (unused) {
+        close(parent->fd);
+        free(parent);
+    }
+}
+
+static void freeWalkDir(walk_t* walk, walk_dir_t* dir) {
+    releaseWalkParent(walk, dir->parent);
+    free(dir->path);
+    free(dir->ancestors);
+    free(dir);
+}
+
+/*
+ * Returns the path of the given entry relative to the root, which the caller should free(). Returns NULL on failure.
+ */
+static char* walkEntryPath(walk_dir_t* dir, const char* name) {
+    size_t dirPathLength = strlen(dir->path);
+    size_t pathLength = dirPathLength == 0 ? strlen(name) : dirPathLength + 1 + strlen(name);
+    char* path = (char*) malloc(pathLength + 1);
+    if (path == NULL) {
+        return NULL;
+    }
+    if (dirPathLength == 0) {
+        strcpy(path, name);
+    } else {
+        snprintf(path, pathLength + 1, "%s/%s", dir->path, name);
+    }
+    return path;
+}
+
+/*
+ * Records the root as the only ancestor of the directories below it. Returns false on failure, in which case the walk
+ * has been stopped.
+ */
+static bool initWalkAncestors(walk_t* walk, walk_dir_t* dir, int dirFd) {
+    struct stat fileInfo;
+    dir->ancestors = (dir_id_t*) malloc(sizeof(dir_id_t));
+    int error = dir->ancestors == NULL ? ENOMEM : fstat(dirFd, &fileInfo) != 0 ? errno : 0;
+    if (error != 0) {
+        pthread_mutex_lock(&walk->lock);
+        failWalk(walk, error, dir->path);
+        pthread_mutex_unlock(&walk->lock);
+        return false;
+    }
+    dir->ancestors[0].dev = fileInfo.st_dev;
+    dir->ancestors[0].ino = fileInfo.st_ino;
+    return true;
+}
+
+/*
+ * Returns whether the given directory is the directory being listed or one of its parents.
+ */
+static bool isWalkAncestor(walk_dir_t* dir, struct stat* fileInfo) {
+    for (int i = 0; i <= dir->depth; i++) {
+        if (dir->ancestors[i].dev == fileInfo->st_dev && dir->ancestors[i].ino == fileInfo->st_ino) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Returns the ancestors of the given child directory, which the caller should free(). Returns NULL on failure.
+ */
+static dir_id_t* childWalkAncestors(walk_dir_t* dir, struct stat* fileInfo) {
+    dir_id_t* ancestors = (dir_id_t*) malloc((dir->depth + 2) * sizeof(dir_id_t));
+    if (ancestors != NULL) {
+        ancestors[0].dev = fileInfo->st_dev;
+        ancestors[0].ino = fileInfo->st_ino;
+        memcpy(ancestors + 1, dir->ancestors, (dir->depth + 1) * sizeof(dir_id_t));
+    }
+    return ancestors;
+}
+
+typedef struct walk_dir_context {
+    walk_t* walk;
+    walk_dir_t* dir;
+    walk_batch_t** batch;
+    walk_parent_t* parent;
+} walk_dir_context_t;
+
+static bool addWalkEntry(void* context, int dirFd, const char* name, unsigned char dType) {
+    if (strcmp(".", name) == 0 || strcmp("..", name) == 0) {
+        return true;
+    }
+    walk_dir_context_t* walkContext = (walk_dir_context_t*) context;
+    walk_t* walk = walkContext->walk;
+    walk_dir_t* dir = walkContext->dir;
+
+    char* path = walkEntryPath(dir, name);
+    if (path == NULL) {
+        pthread_mutex_lock(&walk->lock);
+        failWalk(walk, ENOMEM, dir->path);
+        pthread_mutex_unlock(&walk->lock);
+        return false;
+    }
+    size_t pathLength = strlen(path);
+
+    file_stat_t fileResult;
+    struct stat fileInfo;
+    if (fstatat(dirFd, name, &fileInfo, walk->followLinks ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+        int error = errno;
+        if (error != ENOENT && error != ELOOP) {
+            pthread_mutex_lock(&walk->lock);
+            failWalk(walk, error, path);
+            pthread_mutex_unlock(&walk->lock);
+            free(path);
+            return false;
+        }
+        if (!walk->followLinks) {
+            // Removed since the directory has been read
+            free(path);
+            return true;
+        }
+        // A broken symlink, or one that leads back to itself
+        fileResult.fileType = FILE_TYPE_MISSING;
+        fileResult.size = 0;
+        fileResult.lastModified = 0;
+    } else {
+        unpackStat(&fileInfo, &fileResult);
+    }
+
+    walk_batch_t* batch = *walkContext->batch;
+    if (batch != NULL && batch->count == WALK_BATCH_SIZE) {
+        pthread_mutex_lock(&walk->lock);
+        bool published = publishBatch(walk, batch);
+        pthread_mutex_unlock(&walk->lock);
+        batch = NULL;
+        *walkContext->batch = NULL;
+        if (!published) {
+            free(path);
+            return false;
+        }
+    }
+    if (batch == NULL) {
+        batch = (walk_batch_t*) calloc(1, sizeof(walk_batch_t));
+        if (batch == NULL) {
+            pthread_mutex_lock(&walk->lock);
+            failWalk(walk, ENOMEM, path);
+            pthread_mutex_unlock(&walk->lock);
+            free(path);
+            return false;
+        }
+        *walkContext->batch = batch;
+    }
+    if (batch->namesLength + pathLength + 1 > batch->namesCapacity) {
+        size_t capacity = batch->namesCapacity == 0 ? 64 * 1024 : batch->namesCapacity * 2;
+        while (capacity < batch->namesLength + pathLength + 1) {
+            capacity *= 2;
+        }
+        char* names = (char*) realloc(batch->names, capacity);
+        if (names == NULL) {
+            pthread_mutex_lock(&walk->lock);
+            failWalk(walk, ENOMEM, path);
+            pthread_mutex_unlock(&walk->lock);
+            free(path);
+            return false;
+        }
+        batch->names = names;
+        batch->namesCapacity = capacity;
+    }
+    memcpy(batch->names + batch->namesLength, path, pathLength + 1);
+    batch->offsets[batch->count] = batch->namesLength;
+    batch->types[batch->count] = fileResult.fileType;
+    batch->sizes[batch->count] = fileResult.size;
+    batch->lastModified[batch->count] = fileResult.lastModified;
+    batch->namesLength += pathLength + 1;
+    batch->count++;
+
+    if (fileResult.fileType != FILE_TYPE_DIRECTORY || (walk->maxDepth >= 0 && dir->depth + 1 >= walk->maxDepth)) {
+        free(path);
+        return true;
+    }
+    dir_id_t* ancestors = NULL;
+    if (walk->followLinks) {
+        // Symlinks can lead back to a parent directory. Directories reachable in several other ways are walked for
+        // each path, so that what is reported does not depend on the order in which the directories are walked
+        if (isWalkAncestor(dir, &fileInfo)) {
+            free(path);
+            return true;
+        }
+        ancestors = childWalkAncestors(dir, &fileInfo);
+    }
+    walk_dir_t* child = (walk_dir_t*) malloc(sizeof(walk_dir_t));
+    pthread_mutex_lock(&walk->lock);
+    if (child == NULL || (walk->followLinks && ancestors == NULL)) {
+        failWalk(walk, ENOMEM, path);
+        pthread_mutex_unlock(&walk->lock);
+        free(ancestors);
+        free(child);
+        free(path);
+        return false;
+    }
+    child->parent = retainWalkParent(&walkContext->parent, dirFd);
+    if (child->parent == NULL) {
+        failWalk(walk, errno, dir->path);
+        pthread_mutex_unlock(&walk->lock);
+        free(ancestors);
+        free(child);
+        free(path);
+        return false;
+    }
+    child->path = path;
+    child->depth = dir->depth + 1;
+    child->ancestors = ancestors;
+    child->next = walk->dirs;
+    walk->dirs = child;
+    pthread_cond_signal(&walk->dirsChanged);
+    pthread_mutex_unlock(&walk->lock);
+    return true;
+}
+
+/*
+ * Opens the given directory. Returns -1 when the directory should be skipped, or on failure, in which case the walk
+ * has been stopped.
+ */
+static int openWalkDir(walk_t* walk, walk_dir_t* dir) {
+    int dirFd;
+    if (dir->parent == NULL) {
+        dirFd = open(walk->root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    } else {
+        // Open the directory relative to its parent, so the path is not resolved again for every directory,
+        // and a directory replaced by a symlink since it has been stat'ed is not followed
+        const char* name = strrchr(dir->path, '/');
+        name = name == NULL ? dir->path : name + 1;
+        dirFd = openat(dir->parent->fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | (walk->followLinks ? 0 : O_NOFOLLOW));
+        int error = errno;
+        releaseWalkParent(walk, dir->parent);
+        dir->parent = NULL;
+        errno = error;
+    }
+    if (dirFd == -1) {
+        int error = errno;
+        if (dir->depth > 0 && (error == ENOENT || error == ENOTDIR || error == ELOOP)) {
+            // Removed or replaced since its parent has been read
+            return -1;
+        }
+        pthread_mutex_lock(&walk->lock);
+        failWalk(walk, error, dir->path);
+        pthread_mutex_unlock(&walk->lock);
+        return -1;
+    }
+    return dirFd;
+}
+
+static void walkDir(walk_t* walk, walk_dir_t* dir, walk_batch_t** batch) {
+    int dirFd = openWalkDir(walk, dir);
+    if (dirFd == -1) {
+        return;
+    }
+    if (walk->maxDepth == 0) {
+        close(dirFd);
+        return;
+    }
+    if (dir->depth == 0 && walk->followLinks && !initWalkAncestors(walk, dir, dirFd)) {
+        close(dirFd);
+        return;
+    }
+
+    walk_dir_context_t context = { walk, dir, batch, NULL };
+    int error = visitDirEntries(dirFd, addWalkEntry, &context);
+    if (error != 0) {
+        pthread_mutex_lock(&walk->lock);
+        failWalk(walk, error, dir->path);
+        pthread_mutex_unlock(&walk->lock);
+    }
+    releaseWalkParent(walk, context.parent);
+}
+
+static void fingerprintDir(walk_t* walk, walk_dir_t* dir);
+
+static void* walkThread(void* arg) {
+    walk_t* walk = (walk_t*) arg;
+    walk_batch_t* batch = NULL;
+    pthread_mutex_lock(&walk->lock);
+    while (true) {
+        while (walk->dirs == NULL && walk->busy > 0 && !walk->stopped) {
+            pthread_cond_wait(&walk->dirsChanged, &walk->lock);
+        }
+        if (walk->stopped || walk->dirs == NULL) {
+            break;
+        }
+        walk_dir_t* dir = walk->dirs;
+        walk->dirs = dir->next;
+        walk->busy++;
+        pthread_mutex_unlock(&walk->lock);
+
+        if (walk->fingerprint != NULL) {
+            fingerprintDir(walk, dir);
+        } else {
+            walkDir(walk, dir, &batch);
+        }
+        freeWalkDir(walk, dir);
+
+        pthread_mutex_lock(&walk->lock);
+        walk->busy--;
+        if (walk->busy == 0 && walk->dirs == NULL) {
+            // Nothing left to do, wake up the other threads so they can finish
+            pthread_cond_broadcast(&walk->dirsChanged);
+        }
+    }
+    if (batch != NULL) {
+        publishBatch(walk, batch);
+    }
+    walk->runningThreads--;
+    pthread_cond_signal(&walk->batchesAdded);
+    pthread_mutex_unlock(&walk->lock);
+    return NULL;
+}
+
+static void initWalk(walk_t* walk, const char* root, int maxDepth, jboolean followLinks, walk_dir_t* rootDir) {
+    memset(walk, 0, sizeof(walk_t));
+    walk->root = root;
+    walk->maxDepth = maxDepth;
+    walk->followLinks = followLinks;
+    walk->dirs = rootDir;
+    pthread_mutex_init(&walk->lock, NULL);
+    pthread_cond_init(&walk->dirsChanged, NULL);
+    pthread_cond_init(&walk->batchesAdded, NULL);
+    pthread_cond_init(&walk->batchesTaken, NULL);
+}
+
+/*
+ * Starts up to the given number of walking threads. Returns the number of threads started, the walk has failed when none are.
+ */
+static int startWalkThreads(walk_t* walk, pthread_t* threads, int threadCount) {
+    int startedThreads = 0;
+    for (int i = 0; i < threadCount; i++) {
+        pthread_mutex_lock(&walk->lock);
+        walk->runningThreads++;
+        pthread_mutex_unlock(&walk->lock);
+        int error = pthread_create(&threads[startedThreads], NULL, walkThread, walk);
+        if (error != 0) {
+            pthread_mutex_lock(&walk->lock);
+            walk->runningThreads--;
+            if (startedThreads == 0) {
+                failWalk(walk, error, "");
+            }
+            pthread_mutex_unlock(&walk->lock);
+            break;
+        }
+        startedThreads++;
+    }
+    return startedThreads;
+}
+
+/*
+ * Releases the resources of a walk, after all of its threads have finished.
+ */
+static void destroyWalk(walk_t* walk) {
+    while (walk->dirs != NULL) {
+        walk_dir_t* dir = walk->dirs;
+        walk->dirs = dir->next;
+        freeWalkDir(walk, dir);
+    }
+    free(walk->failurePath);
+    pthread_mutex_destroy(&walk->lock);
+    pthread_cond_destroy(&walk->dirsChanged);
+    pthread_cond_destroy(&walk->batchesAdded);
+    pthread_cond_destroy(&walk->batchesTaken);
+}
+
+/*
+ * Delivers a batch to the WalkCollector. Returns false when Java code has failed.
+ */
+static bool deliverBatch(JNIEnv* env, jobject collector, jmethodID batchMethod, jobjectArray paths, jintArray types, jlongArray sizes, jlongArray lastModified, walk_batch_t* batch, jobject result) {
+    for (int i = 0; i < batch->count; i++) {
+        jstring path = char_to_java(env, batch->names + batch->offsets[i], result);
+        if (path == NULL) {
+            return false;
+        }
+        env->SetObjectArrayElement(paths, i, path);
+        env->DeleteLocalRef(path);
+    }
+    env->SetIntArrayRegion(types, 0, batch->count, batch->types);
+    env->SetLongArrayRegion(sizes, 0, batch->count, batch->sizes);
+    env->SetLongArrayRegion(lastModified, 0, batch->count, batch->lastModified);
+    env->CallVoidMethod(collector, batchMethod, (jint) batch->count);
+    return !env->ExceptionCheck();
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_walk(JNIEnv* env, jclass target, jstring path, jint maxDepth, jboolean followLinks, jint threadCount, jobject collector, jobject result) {
+    jclass collectorClass = env->GetObjectClass(collector);
+    jmethodID batchMethod = env->GetMethodID(collectorClass, "batch", "(I)V");
+    jmethodID failedMethod = env->GetMethodID(collectorClass, "failed", "(Ljava/lang/String;)V");
+    jfieldID pathsField = env->GetFieldID(collectorClass, "paths", "[Ljava/lang/String;");
+    jfieldID typesField = env->GetFieldID(collectorClass, "types", "[I");
+    jfieldID sizesField = env->GetFieldID(collectorClass, "sizes", "[J");
+    jfieldID lastModifiedField = env->GetFieldID(collectorClass, "lastModified", "[J");
+    if (batchMethod == NULL || failedMethod == NULL || pathsField == NULL || typesField == NULL || sizesField == NULL || lastModifiedField == NULL) {
+        mark_failed_with_message(env, "could not find method", result);
+        return;
+    }
+    jobjectArray paths = (jobjectArray) env->GetObjectField(collector, pathsField);
+    jintArray types = (jintArray) env->GetObjectField(collector, typesField);
+    jlongArray sizes = (jlongArray) env->GetObjectField(collector, sizesField);
+    jlongArray lastModified = (jlongArray) env->GetObjectField(collector, lastModifiedField);
+
+    char* pathStr = java_to_char(env, path, result);
+    if (pathStr == NULL) {
+        return;
+    }
+    walk_dir_t* root = (walk_dir_t*) calloc(1, sizeof(walk_dir_t));
+    char* rootPath = (char*) calloc(1, 1);
+    pthread_t* threads = (pthread_t*) calloc(threadCount, sizeof(pthread_t));
+    if (root == NULL || rootPath == NULL || threads == NULL) {
+        mark_failed_with_message(env, "could not allocate memory", result);
+        free(root);
+        free(rootPath);
+        free(threads);
+        free(pathStr);
+        return;
+    }
+    root->path = rootPath;
+
+    walk_t walk;
+    initWalk(&walk, pathStr, maxDepth, followLinks, root);
+    walk.maxPendingBatches = threadCount * WALK_PENDING_BATCHES_PER_THREAD;
+    int startedThreads = startWalkThreads(&walk, threads, threadCount);
+
+    // Deliver the batches on this thread while the other threads walk the tree
+    bool javaFailed = false;
+    pthread_mutex_lock(&walk.lock);
+    while (true) {
+        while (walk.batches == NULL && walk.runningThreads > 0) {
+            pthread_cond_wait(&walk.batchesAdded, &walk.lock);
+        }
+        walk_batch_t* batch = walk.batches;
+        if (batch == NULL) {
+            break;
+        }
+        walk.batches = batch->next;
+        if (walk.batches == NULL) {
+            walk.lastBatch = NULL;
+        }
+        walk.pendingBatches--;
+        pthread_cond_signal(&walk.batchesTaken);
+        pthread_mutex_unlock(&walk.lock);
+
+        if (!javaFailed && !deliverBatch(env, collector, batchMethod, paths, types, sizes, lastModified, batch, result)) {
+            javaFailed = true;
+            pthread_mutex_lock(&walk.lock);
+            walk.stopped = true;
+            pthread_cond_broadcast(&walk.dirsChanged);
+            pthread_cond_broadcast(&walk.batchesTaken);
+            pthread_mutex_unlock(&walk.lock);
+        }
+        freeBatch(batch);
+        pthread_mutex_lock(&walk.lock);
+    }
+    pthread_mutex_unlock(&walk.lock);
+
+    for (int i = 0; i < startedThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (walk.failurePath != NULL && !javaFailed) {
+        jstring failurePath = char_to_java(env, walk.failurePath, result);
+        env->CallVoidMethod(collector, failedMethod, failurePath);
+        errno = walk.failureErrno;
+        mark_failed_with_errno(env, "could not list directory", result);
+    }
+
+    destroyWalk(&walk);
+    free(threads);
+    free(pathStr);
+}
+
+/*
+ * Directory tree fingerprinting
+ *
+ * The walking threads hash each directory on its own, over its entries sorted by name. The digests are then combined
+ * bottom up, so that the digest of a directory also covers the directories below it.
+ */
+
+typedef struct fingerprint_entry {
+    // Offset of the name in the names of the directory, the name itself is only known once all entries are read
+    size_t nameOffset;
+    const char* name;
+    // The target of a symlink follows its name in the names of the directory
+    size_t targetLength;
+    jint type;
+    jlong size;
+    jlong lastModified;
+    jint mode;
+} fingerprint_entry_t;
+
+typedef struct fingerprint_dir {
+    // Relative to the root, empty for the root itself
+    char* path;
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    // Index of the parent, and the children in the order of their names, as indexes into the sorted directories
+    int parent;
+    int firstChild;
+    int nextSibling;
+} fingerprint_dir_t;
+
+typedef struct fingerprint {
+    bool lastModified;
+    bool modes;
+    // Guarded by the lock of the walk
+    fingerprint_dir_t* dirs;
+    size_t count;
+    size_t capacity;
+} fingerprint_t;
+
+typedef struct fingerprint_dir_context {
+    walk_t* walk;
+    walk_dir_t* dir;
+    walk_parent_t* parent;
+    fingerprint_entry_t* entries;
+    size_t count;
+    size_t capacity;
+    char* names;
+    size_t namesLength;
+    size_t namesCapacity;
+} fingerprint_dir_context_t;
+
+/*
+ * Adds a child directory to be walked, unless it is one of its own parents. Returns false on failure.
+ */
+static bool addFingerprintDir(walk_t* walk, walk_dir_t* dir, walk_parent_t** parent, int dirFd, const char* name, struct stat* fileInfo) {
+    dir_id_t* ancestors = NULL;
+    if (walk->followLinks) {
+        // Symlinks can lead back to a parent directory. Directories reachable in several other ways are walked for
+        // each path, so that the fingerprint does not depend on the order in which the directories are walked
+        if (isWalkAncestor(dir, fileInfo)) {
+            return true;
+        }
+        ancestors = childWalkAncestors(dir, fileInfo);
+    }
+    char* path = walkEntryPath(dir, name);
+    walk_dir_t* child = (walk_dir_t*) malloc(sizeof(walk_dir_t));
+    pthread_mutex_lock(&walk->lock);
+    if (path == NULL || child == NULL || (walk->followLinks && ancestors == NULL)) {
+        failWalk(walk, ENOMEM, dir->path);
+        pthread_mutex_unlock(&walk->lock);
+        free(ancestors);
+        free(path);
+        free(child);
+        return false;
+    }
+    child->parent = retainWalkParent(parent, dirFd);
+    if (child->parent == NULL) {
+        failWalk(walk, errno, dir->path);
+        pthread_mutex_unlock(&walk->lock);
+        free(ancestors);
+        free(path);
+        free(child);
+        return false;
+    }
+    child->path = path;
+    child->depth = dir->depth + 1;
+    child->ancestors = ancestors;
+    child->next = walk->dirs;
+    walk->dirs = child;
+    pthread_cond_signal(&walk->dirsChanged);
+    pthread_mutex_unlock(&walk->lock);
+    return true;
+}
+
+static bool addFingerprintEntry(void* context, int dirFd, const char* name, unsigned char dType) {
+    if (strcmp(".", name) == 0 || strcmp("..", name) == 0) {
+        return true;
+    }
+    fingerprint_dir_context_t* dirContext = (fingerprint_dir_context_t*) context;
+    walk_t* walk = dirContext->walk;
+    walk_dir_t* dir = dirContext->dir;
+
+    fingerprint_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    struct stat fileInfo;
+    if (fstatat(dirFd, name, &fileInfo, walk->followLinks ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+        int error = errno;
+        if (error != ENOENT && error != ELOOP) {
+            char* path = walkEntryPath(dir, name);
+            pthread_mutex_lock(&walk->lock);
+            failWalk(walk, error, path == NULL ? dir->path : path);
+            pthread_mutex_unlock(&walk->lock);
+            free(path);
+            return false;
+        }
+        if (!walk->followLinks) {
+            // Removed since the directory has been read
+            return true;
+        }
+        // A broken symlink, or one that leads back to itself
+        entry.type = FILE_TYPE_MISSING;
+    } else {
+        entry.type = toFileType(fileInfo.st_mode);
+        entry.size = entry.type == FILE_TYPE_FILE ? fileInfo.st_size : 0;
+        // The modification time of a directory only reflects changes to its entries, which are hashed anyway
+        if (entry.type != FILE_TYPE_DIRECTORY) {
+#ifdef __linux__
+            entry.lastModified = toNanos(fileInfo.st_mtim);
+#else
+            entry.lastModified = toNanos(fileInfo.st_mtimespec);
+#endif
+        }
+        entry.mode = fileInfo.st_mode & 07777;
+    }
+
+    // Symlinks are only seen when not following them, where what they point to is part of the tree
+    char target[PATH_MAX];
+    if (entry.type == FILE_TYPE_SYMLINK) {
+        ssize_t targetLength = readlinkat(dirFd, name, target, sizeof(target));
+        if (targetLength == -1) {
+            int error = errno;
+            if (error == ENOENT) {
+                // Removed since the directory has been read
+                return true;
+            }
+            char* path = walkEntryPath(dir, name);
+            pthread_mutex_lock(&walk->lock);
+            failWalk(walk, error, path == NULL ? dir->path : path);
+            pthread_mutex_unlock(&walk->lock);
+            free(path);
+            return false;
+        }
+        entry.targetLength = (size_t) targetLength;
+    }
+
+    size_t nameLength = strlen(name);
+    size_t namesLength = nameLength + 1 + (entry.type == FILE_TYPE_SYMLINK ? entry.targetLength + 1 : 0);
+    if (dirContext->count == dirContext->capacity) {
+        size_t capacity = dirContext->capacity == 0 ? 64 : dirContext->capacity * 2;
+        fingerprint_entry_t* entries = (fingerprint_entry_t*) realloc(dirContext->entries, capacity * sizeof(fingerprint_entry_t));
+        if (entries == NULL) {
+            pthread_mutex_lock(&walk->lock);
+            failWalk(walk, ENOMEM, dir->path);
+            pthread_mutex_unlock(&walk->lock);
+            return false;
+        }
+        dirContext->entries = entries;
+        dirContext->capacity = capacity;
+    }
+    if (dirContext->namesLength + namesLength > dirContext->namesCapacity) {
+        size_t capacity = dirContext->namesCapacity == 0 ? 4096 : dirContext->namesCapacity * 2;
+        while (capacity < dirContext->namesLength + namesLength) {
+            capacity *= 2;
+        }
+        char* names = (char*) realloc(dirContext->names, capacity);
+        if (names == NULL) {
+            pthread_mutex_lock(&walk->lock);
+            failWalk(walk, ENOMEM, dir->path);
+            pthread_mutex_unlock(&walk->lock);
+            return false;
+        }
+        dirContext->names = names;
+        dirContext->namesCapacity = capacity;
+    }
+    memcpy(dirContext->names + dirContext->namesLength, name, nameLength + 1);
+    if (entry.type == FILE_TYPE_SYMLINK) {
+        memcpy(dirContext->names + dirContext->namesLength + nameLength + 1, target, entry.targetLength);
+        dirContext->names[dirContext->namesLength + namesLength - 1] = 0;
+    }
+    entry.nameOffset = dirContext->namesLength;
+    dirContext->namesLength += namesLength;
+    dirContext->entries[dirContext->count++] = entry;
+
+    if (entry.type != FILE_TYPE_DIRECTORY || (walk->maxDepth >= 0 && dir->depth + 1 >= walk->maxDepth)) {
+        return true;
+    }
+    return addFingerprintDir(walk, dir, &dirContext->parent, dirFd, name, &fileInfo);
+}
+
+static int compareFingerprintEntries(const void* a, const void* b) {
+    return strcmp(((const fingerprint_entry_t*) a)->name, ((const fingerprint_entry_t*) b)->name);
+}
+
+/*
+ * Appends the value to the buffer in big endian byte order, returns the number of bytes written.
+ */
+static size_t putFingerprintValue(unsigned char* buffer, jlong value, int length) {
+    for (int i = 0; i < length; i++) {
+        buffer[i] = (unsigned char) (value >> ((length - 1 - i) * 8));
+    }
+    return length;
+}
+
+static void fingerprintDir(walk_t* walk, walk_dir_t* dir) {
+    int dirFd = openWalkDir(walk, dir);
+    if (dirFd == -1) {
+        return;
+    }
+    if (dir->depth == 0 && walk->followLinks && !initWalkAncestors(walk, dir, dirFd)) {
+        close(dirFd);
+        return;
+    }
+
+    fingerprint_dir_context_t context;
+    memset(&context, 0, sizeof(context));
+    context.walk = walk;
+    context.dir = dir;
+    if (walk->maxDepth == 0) {
+        close(dirFd);
+    } else {
+        int error = visitDirEntries(dirFd, addFingerprintEntry, &context);
+        if (error != 0) {
+            pthread_mutex_lock(&walk->lock);
+            failWalk(walk, error, dir->path);
+            pthread_mutex_unlock(&walk->lock);
+        }
+        releaseWalkParent(walk, context.parent);
+    }
+
+    fingerprint_t* fingerprint = walk->fingerprint;
+    sha256_t hash;
+    sha256_init(&hash);
+    for (size_t i = 0; i < context.count; i++) {
+        context.entries[i].name = context.names + context.entries[i].nameOffset;
+    }
+    qsort(context.entries, context.count, sizeof(fingerprint_entry_t), compareFingerprintEntries);
+    for (size_t i = 0; i < context.count; i++) {
+        fingerprint_entry_t* entry = &context.entries[i];
+        unsigned char values[21];
+        size_t length = 0;
+        length += putFingerprintValue(values + length, entry->type, 1);
+        length += putFingerprintValue(values + length, entry->size, 8);
+        if (fingerprint->lastModified) {
+            length += putFingerprintValue(values + length, entry->lastModified, 8);
+        }
+        if (fingerprint->modes) {
+            length += putFingerprintValue(values + length, entry->mode, 4);
+        }
+        size_t nameLength = strlen(entry->name);
+        sha256_update(&hash, entry->name, nameLength + 1);
+        sha256_update(&hash, values, length);
+        if (entry->type == FILE_TYPE_SYMLINK) {
+            sha256_update(&hash, entry->name + nameLength + 1, entry->targetLength + 1);
+        }
+    }
+    free(context.entries);
+    free(context.names);
+
+    pthread_mutex_lock(&walk->lock);
+    if (!walk->stopped && fingerprint->count == fingerprint->capacity) {
+        size_t capacity = fingerprint->capacity == 0 ? 64 : fingerprint->capacity * 2;
+        fingerprint_dir_t* dirs = (fingerprint_dir_t*) realloc(fingerprint->dirs, capacity * sizeof(fingerprint_dir_t));
+        if (dirs == NULL) {
+            failWalk(walk, ENOMEM, dir->path);
+        } else {
+            fingerprint->dirs = dirs;
+            fingerprint->capacity = capacity;
+        }
+    }
+    if (!walk->stopped) {
+        fingerprint_dir_t* fingerprintDir = &fingerprint->dirs[fingerprint->count++];
+        sha256_final(&hash, fingerprintDir->digest);
+        // Owned by the fingerprint from now on
+        fingerprintDir->path = dir->path;
+        dir->path = NULL;
+    }
+    pthread_mutex_unlock(&walk->lock);
+}
+
+/*
+ * Orders paths so that the directories below a directory directly follow it, sorted by name.
+ */
+static int compareFingerprintDirs(const void* a, const void* b) {
+    const unsigned char* path1 = (const unsigned char*) ((const fingerprint_dir_t*) a)->path;
+    const unsigned char* path2 = (const unsigned char*) ((const fingerprint_dir_t*) b)->path;
+    while (*path1 != 0 && *path1 == *path2) {
+        path1++;
+        path2++;
+    }
+    int char1 = *path1 == 0 ? 0 : *path1 == '/' ? 1 : *path1 + 1;
+    int char2 = *path2 == 0 ? 0 : *path2 == '/' ? 1 : *path2 + 1;
+    return char1 - char2;
+}
+
+static bool isParentPath(const char* parent, const char* path) {
+    size_t length = strlen(parent);
+    if (length == 0) {
+        return *path != 0;
+    }
+    return strncmp(parent, path, length) == 0 && path[length] == '/';
+}
+
+/*
+ * Sorts the directories and replaces the digest of each directory with the digest of the tree under it.
+ * Returns false on failure to allocate memory.
+ */
+static bool combineFingerprints(fingerprint_t* fingerprint) {
+    fingerprint_dir_t* dirs = fingerprint->dirs;
+    int count = (int) fingerprint->count;
+    int* parents = (int*) malloc(count * sizeof(int));
+    if (parents == NULL) {
+        return false;
+    }
+    qsort(dirs, count, sizeof(fingerprint_dir_t), compareFingerprintDirs);
+
+    // Find the parent of each directory, using the parents of the previous directory
+    int depth = 0;
+    for (int i = 0; i < count; i++) {
+        while (depth > 0 && !isParentPath(dirs[parents[depth - 1]].path, dirs[i].path)) {
+            depth--;
+        }
+        dirs[i].parent = depth > 0 ? parents[depth - 1] : -1;
+        dirs[i].firstChild = -1;
+        dirs[i].nextSibling = -1;
+        parents[depth++] = i;
+    }
+    free(parents);
+
+    // Visit the children before their parents, and in reverse order so that each list of children ends up sorted
+    for (int i = count - 1; i >= 0; i--) {
+        sha256_t hash;
+        sha256_init(&hash);
+        sha256_update(&hash, dirs[i].digest, SHA256_DIGEST_LENGTH);
+        for (int child = dirs[i].firstChild; child != -1; child = dirs[child].nextSibling) {
+            const char* name = strrchr(dirs[child].path, '/');
+            name = name == NULL ? dirs[child].path : name + 1;
+            sha256_update(&hash, name, strlen(name) + 1);
+            sha256_update(&hash, dirs[child].digest, SHA256_DIGEST_LENGTH);
+        }
+        sha256_final(&hash, dirs[i].digest);
+        int parent = dirs[i].parent;
+        if (parent != -1) {
+            dirs[i].nextSibling = dirs[parent].firstChild;
+            dirs[parent].firstChild = i;
+        }
+    }
+    return true;
+}
+
+static jbyteArray digestToJava(JNIEnv* env, const unsigned char* digest) {
+    jbyteArray bytes = env->NewByteArray(SHA256_DIGEST_LENGTH);
+    if (bytes != NULL) {
+        env->SetByteArrayRegion(bytes, 0, SHA256_DIGEST_LENGTH, (const jbyte*) digest);
+    }
+    return bytes;
+}
+
+JNIEXPORT jbyteArray JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_fingerprint(JNIEnv* env, jclass target, jstring path, jint maxDepth, jboolean followLinks, jint threadCount, jboolean lastModified, jboolean modes, jboolean directoryDigests, jobject collector, jobject result) {
+    jclass collectorClass = env->GetObjectClass(collector);
+    jmethodID directoryMethod = env->GetMethodID(collectorClass, "directory", "(Ljava/lang/String;[B)V");
+    jmethodID failedMethod = env->GetMethodID(collectorClass, "failed", "(Ljava/lang/String;)V");
+    if (directoryMethod == NULL || failedMethod == NULL) {
+        mark_failed_with_message(env, "could not find method", result);
+        return NULL;
+    }
+
+    char* pathStr = java_to_char(env, path, result);
+    if (pathStr == NULL) {
+        return NULL;
+    }
+    walk_dir_t* root = (walk_dir_t*) calloc(1, sizeof(walk_dir_t));
+    char* rootPath = (char*) calloc(1, 1);
+    pthread_t* threads = (pthread_t*) calloc(threadCount, sizeof(pthread_t));
+    if (root == NULL || rootPath == NULL || threads == NULL) {
+        mark_failed_with_message(env, "could not allocate memory", result);
+        free(root);
+        free(rootPath);
+        free(threads);
+        free(pathStr);
+        return NULL;
+    }
+    root->path = rootPath;
+
+    fingerprint_t fingerprint;
+    memset(&fingerprint, 0, sizeof(fingerprint));
+    fingerprint.lastModified = lastModified;
+    fingerprint.modes = modes;
+    walk_t walk;
+    initWalk(&walk, pathStr, maxDepth, followLinks, root);
+    walk.fingerprint = &fingerprint;
+    int startedThreads = startWalkThreads(&walk, threads, threadCount);
+    for (int i = 0; i < startedThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    jbyteArray digest = NULL;
+    if (walk.failurePath != NULL) {
+        jstring failurePath = char_to_java(env, walk.failurePath, result);
+        env->CallVoidMethod(collector, failedMethod, failurePath);
+        errno = walk.failureErrno;
+        mark_failed_with_errno(env, "could not list directory", result);
+    } else if (!combineFingerprints(&fingerprint)) {
+        mark_failed_with_message(env, "could not allocate memory", result);
+    } else {
+        digest = digestToJava(env, fingerprint.dirs[0].digest);
+        for (size_t i = 0; directoryDigests && digest != NULL && i < fingerprint.count; i++) {
+            jstring dirPath = char_to_java(env, fingerprint.dirs[i].path, result);
+            jbyteArray dirDigest = dirPath == NULL ? NULL : digestToJava(env, fingerprint.dirs[i].digest);
+            if (dirDigest == NULL) {
+                digest = NULL;
+                break;
+            }
+            env->CallVoidMethod(collector, directoryMethod, dirPath, dirDigest);
+            env->DeleteLocalRef(dirPath);
+            env->DeleteLocalRef(dirDigest);
+            if (env->ExceptionCheck()) {
+                digest = NULL;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < fingerprint.count; i++) {
+        free(fingerprint.dirs[i].path);
+    }
+    free(fingerprint.dirs);
+    destroyWalk(&walk);
+    free(threads);
+    free(pathStr);
+    return digest;
+}
+
+static void symlinkFile(JNIEnv* env, char* pathStr, char* contentStr, jobject result) {
+    int retval = symlink(contentStr, pathStr);
+    free(contentStr);
+    free(pathStr);
+    if (retval != 0) {
+        mark_failed_with_errno(env, "could not symlink", result);
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_symlink(JNIEnv* env, jclass target, jstring path, jstring contents, jobject result) {
+    char* pathStr = java_to_char(env, path, result);
+    if (pathStr == NULL) {
+        return;
+    }
+    char* contentStr = java_to_char(env, contents, result);
+    if (contentStr == NULL) {
+        free(pathStr);
+        return;
+    }
+    symlinkFile(env, pathStr, contentStr, result);
+}
+
+JNIEXPORT void JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_symlinkBytes(JNIEnv* env, jclass target, jbyteArray path, jbyteArray contents, jobject result) {
+    char* pathStr = java_bytes_to_char(env, path, result);
+    if (pathStr == NULL) {
+        return;
+    }
+    char* contentStr = java_bytes_to_char(env, contents, result);
+    if (contentStr == NULL) {
+        free(pathStr);
+        return;
+    }
+    symlinkFile(env, pathStr, contentStr, result);
+}
+
+/*
+ * Returns the contents of the symlink, which the caller should free(). Returns NULL on failure.
+ */
+static char* readlinkFile(JNIEnv* env, char* pathStr, jobject result) {
+    struct stat link_info;
+    int retval = lstat(pathStr, &link_info);
+    if (retval != 0) {
+        free(pathStr);
         mark_failed_with_errno(env, "could not lstat file", result);
         return NULL;
     }
@@ -268,11 +2039,39 @@ Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_readlink(JNIEnv
         return NULL;
     }
     contents[link_info.st_size] = 0;
+    return contents;
+}
+
+JNIEXPORT jstring JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_readlink(JNIEnv* env, jclass target, jstring path, jobject result) {
+    char* pathStr = java_to_char(env, path, result);
+    if (pathStr == NULL) {
+        return NULL;
+    }
+    char* contents = readlinkFile(env, pathStr, result);
+    if (contents == NULL) {
+        return NULL;
+    }
     jstring contents_str = char_to_java(env, contents, result);
     free(contents);
     return contents_str;
 }
 
+JNIEXPORT jbyteArray JNICALL
+Java_net_rubygrapefruit_platform_internal_jni_PosixFileFunctions_readlinkBytes(JNIEnv* env, jclass target, jbyteArray path, jobject result) {
+    char* pathStr = java_bytes_to_char(env, path, result);
+    if (pathStr == NULL) {
+        return NULL;
+    }
+    char* contents = readlinkFile(env, pathStr, result);
+    if (contents == NULL) {
+        return NULL;
+    }
+    jbyteArray contents_bytes = char_to_java_bytes(env, contents, result);
+    free(contents);
+    return contents_bytes;
+}
+
 /*
  * Process functions
  */
@@ -415,6 +2214,8 @@ JNI_OnLoad(JavaVM* jvm, void*) {
     }
     jclass destClass = env->FindClass("net/rubygrapefruit/platform/internal/FileStat");
     fileStatDetailsMethodId = env->GetMethodID(destClass, "details", "(IIIIJJI)V");
+    jclass detailsClass = env->FindClass("net/rubygrapefruit/platform/internal/FileDetails");
+    fileDetailsMethodId = env->GetMethodID(detailsClass, "details", "(IIIJJJJJJJ)V");
     return JNI_VERSION_1_6;
 }
 
@@ -0,0 +1,36 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.file;
+
+import net.rubygrapefruit.platform.NativeException;
+
+import java.io.Closeable;
+import java.util.Iterator;
+
+/**
+ * The entries of a directory, read in chunks while iterating. Opened using {@link Files#openDir(java.io.File, boolean)}.
+ *
+ * <p>The stream holds a native handle to the directory until the last entry has been read or the stream is closed.
+ * {@link #hasNext()} and {@link #next()} throw a {@link NativeException} on failure to read the directory.</p>
+ */
+public interface DirStream extends Iterator<DirEntry>, Closeable {
+    /**
+     * Releases the directory. Does nothing when the stream is already closed.
+     */
+    void close();
+}
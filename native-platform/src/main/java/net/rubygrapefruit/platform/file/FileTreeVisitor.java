@@ -0,0 +1,33 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.file;
+
+/**
+ * Receives the entries found by {@link Files#walk(java.io.File, WalkOptions, FileTreeVisitor)}.
+ */
+public interface FileTreeVisitor {
+    /**
+     * Visits an entry of the tree. Called on the thread that started the walk, with the entries in no particular order.
+     *
+     * @param path The path of the entry, relative to the root of the walk.
+     * @param type The type of the entry. {@link FileInfo.Type#Missing} for broken symlinks when following symlinks.
+     * @param size The size of the entry in bytes, 0 when it is not a regular file.
+     * @param lastModifiedTime The last modification time of the entry, in ms since epoch.
+     */
+    void visitEntry(String path, FileInfo.Type type, long size, long lastModifiedTime);
+}
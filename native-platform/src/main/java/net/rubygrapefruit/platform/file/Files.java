@@ -57,6 +57,26 @@ public interface Files extends NativeIntegration {
     @ThreadSafe
     FileInfo stat(File file, boolean linkTarget) throws NativeException;
 
+    /**
+     * Returns basic information about each of the given files, in the same order. This is cheaper than calling
+     * {@link #stat(File, boolean)} for each file, as the files are queried together and possibly in parallel.
+     *
+     * @param files The paths of the files to get details of. Follows symlinks to the parent directory of each file.
+     * @param linkTarget When true and a file is a symlink, return details of the target of the symlink instead of details of the symlink itself.
+     * @return Details of each file. Returns details with type {@link FileInfo.Type#Missing} for a file that does not
+     * exist.
+     * @throws NativeException On failure to query the information of one of the files.
+     * @throws FilePermissionException When the user has insufficient permissions to query the information of one of the files.
+     */
+    @ThreadSafe
+    List<? extends FileInfo> stat(List<File> files, boolean linkTarget) throws NativeException;
+
+    /**
+     * Returns basic information about each of the given paths, in the same order. Same as {@link #stat(List, boolean)}.
+     */
+    @ThreadSafe
+    List<? extends FileInfo> statPaths(List<String> paths, boolean linkTarget) throws NativeException;
+
     /**
      * Lists the entries of the given directory.
      *
@@ -83,4 +103,64 @@ public interface Files extends NativeIntegration {
      */
     @ThreadSafe
     List<? extends DirEntry> listDir(File dir, boolean linkTarget) throws NativeException;
+
+    /**
+     * Lists the names and types of the entries of the given directory. This is cheaper than {@link #listDir(File, boolean)}
+     * on file systems that report the type of each entry together with its name, as the entries don't need to be
+     * queried one by one.
+     *
+     * <p>The size and last modified time of the returned entries are always 0.</p>
+     *
+     * @param dir The path of the directory to list. Follows symlinks to this directory.
+     * @param linkTarget When true and a directory entry is a symlink, return the type of the target of the symlink instead of the type of the symlink itself.
+     * @throws NativeException On failure.
+     * @throws NoSuchFileException When the specified directory does not exist.
+     * @throws NotADirectoryException When the specified file is not a directory.
+     * @throws FilePermissionException When the user has insufficient permissions to list the entries
+     */
+    @ThreadSafe
+    List<? extends DirEntry> listDirTypes(File dir, boolean linkTarget) throws NativeException;
+
+    /**
+     * Walks the tree under the given directory and visits each entry in it. Directories are listed in parallel where
+     * supported, while the visitor is called on the calling thread.
+     *
+     * <p>The walk stops when the visitor throws an exception, which is rethrown to the caller.</p>
+     *
+     * @param root The path of the directory to walk. Follows symlinks to this directory. Not visited itself.
+     * @throws NativeException On failure.
+     * @throws NoSuchFileException When the specified directory does not exist.
+     * @throws NotADirectoryException When the specified file is not a directory.
+     * @throws FilePermissionException When the user has insufficient permissions to list the root or a directory under it.
+     */
+    @ThreadSafe
+    void walk(File root, WalkOptions options, FileTreeVisitor visitor) throws NativeException;
+
+    /**
+     * Computes a fingerprint of the metadata of the tree under the given directory, without reading the contents of
+     * any files. Directories are listed in parallel where supported.
+     *
+     * @param root The path of the directory to fingerprint. Follows symlinks to this directory.
+     * @throws NativeException On failure.
+     * @throws NoSuchFileException When the specified directory does not exist.
+     * @throws NotADirectoryException When the specified file is not a directory.
+     * @throws FilePermissionException When the user has insufficient permissions to list the root or a directory under it.
+     */
+    @ThreadSafe
+    TreeFingerprint fingerprint(File root, FingerprintOptions options) throws NativeException;
+
+    /**
+     * Opens a stream over the entries of the given directory. The entries are read in chunks of bounded size while
+     * iterating, so memory use does not grow with the size of the directory. The stream needs to be closed, unless
+     * it has been iterated to the end.
+     *
+     * @param dir The path of the directory to list. Follows symlinks to this directory.
+     * @param linkTarget When true and a directory entry is a symlink, return details of the target of the symlink instead of details of the symlink itself.
+     * @throws NativeException On failure.
+     * @throws NoSuchFileException When the specified directory does not exist.
+     * @throws NotADirectoryException When the specified file is not a directory.
+     * @throws FilePermissionException When the user has insufficient permissions to list the entries
+     */
+    @ThreadSafe
+    DirStream openDir(File dir, boolean linkTarget) throws NativeException;
 }
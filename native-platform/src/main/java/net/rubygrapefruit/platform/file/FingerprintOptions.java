@@ -0,0 +1,116 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.file;
+
+/**
+ * Options for fingerprinting a directory tree with {@link Files#fingerprint(java.io.File, FingerprintOptions)}.
+ */
+public final class FingerprintOptions {
+    private int maxDepth = -1;
+    private boolean followLinks;
+    private int threads;
+    private boolean lastModifiedTimes = true;
+    private boolean modes;
+    private boolean directoryDigests;
+
+    /**
+     * Limits the fingerprint to the given number of levels below the root. 1 only includes the entries of the root
+     * directory. The fingerprint is not limited by default.
+     */
+    public FingerprintOptions withMaxDepth(int maxDepth) {
+        this.maxDepth = maxDepth;
+        return this;
+    }
+
+    /**
+     * Includes the targets of symlinks instead of the symlinks themselves, and the directories symlinks point to.
+     * Symlinks leading back to a parent directory are not followed. Symlinks are not followed by default, the paths
+     * they point to are then included instead, except on Windows.
+     *
+     * <p>A directory reachable via several symlinks is walked once for each of them, so that the fingerprint does not
+     * depend on the order the tree is walked in. A tree where symlinks lead into each other's subtrees can therefore
+     * take time exponential in the number of such symlinks to fingerprint.</p>
+     */
+    public FingerprintOptions withFollowLinks(boolean followLinks) {
+        this.followLinks = followLinks;
+        return this;
+    }
+
+    /**
+     * Uses the given number of threads to walk the tree. Uses as many threads as there are processors by default.
+     */
+    public FingerprintOptions withThreads(int threads) {
+        this.threads = threads;
+        return this;
+    }
+
+    /**
+     * Includes the last modification times of the entries other than directories, in nanosecond precision where
+     * the file system supports it. Included by default.
+     */
+    public FingerprintOptions withLastModifiedTimes(boolean lastModifiedTimes) {
+        this.lastModifiedTimes = lastModifiedTimes;
+        return this;
+    }
+
+    /**
+     * Includes the permission bits of the entries. Always 0 on Windows. Not included by default.
+     */
+    public FingerprintOptions withModes(boolean modes) {
+        this.modes = modes;
+        return this;
+    }
+
+    /**
+     * Also returns the digest of each directory in the tree. Only the digest of the root is returned by default.
+     */
+    public FingerprintOptions withDirectoryDigests(boolean directoryDigests) {
+        this.directoryDigests = directoryDigests;
+        return this;
+    }
+
+    /**
+     * Returns the maximum depth of the fingerprint, or -1 for no limit.
+     */
+    public int getMaxDepth() {
+        return maxDepth;
+    }
+
+    public boolean isFollowLinks() {
+        return followLinks;
+    }
+
+    /**
+     * Returns the number of threads to use, or 0 to use as many threads as there are processors.
+     */
+    public int getThreads() {
+        return threads;
+    }
+
+    public boolean isLastModifiedTimes() {
+        return lastModifiedTimes;
+    }
+
+    public boolean isModes() {
+        return modes;
+    }
+
+    public boolean isDirectoryDigests() {
+        return directoryDigests;
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.file;
+
+import net.rubygrapefruit.platform.ThreadSafe;
+
+/**
+ * Selected details about a file on a Posix file system, with timestamps in nanosecond precision. This is a snapshot
+ * and does not change.
+ *
+ * <p>A snapshot can be fetched using {@link PosixFiles#stat(java.io.File, boolean, java.util.Set)}. The type of the
+ * file is always available, the other details only when they have been requested and the file system provides them.
+ * Details that are not available are reported as 0.</p>
+ */
+@ThreadSafe
+public interface PosixFileDetails extends FileInfo {
+    // Order is significant here, see generic.h
+    enum Field {
+        Mode, Size, LastModifiedTime, ChangeTime, CreationTime, Inode, Device, LinkCount
+    }
+
+    /**
+     * Returns whether the given detail is available for this file.
+     */
+    boolean has(Field field);
+
+    /**
+     * Returns the mode, or permissions, of this file.
+     */
+    int getMode();
+
+    /**
+     * Returns the last modification time of this file, in ns since epoch.
+     */
+    long getLastModifiedTimeNanos();
+
+    /**
+     * Returns the last time the contents or the attributes of this file changed, in ns since epoch.
+     */
+    long getChangeTimeNanos();
+
+    /**
+     * Returns the creation time of this file, in ns since epoch. Not all file systems provide this.
+     */
+    long getCreationTimeNanos();
+
+    long getInode();
+
+    /**
+     * Returns the ID of the device containing this file.
+     */
+    long getDevice();
+
+    /**
+     * Returns the number of hard links to this file.
+     */
+    long getLinkCount();
+}
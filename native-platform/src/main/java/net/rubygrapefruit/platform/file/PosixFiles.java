@@ -21,6 +21,8 @@ import net.rubygrapefruit.platform.NativeIntegration;
 import net.rubygrapefruit.platform.ThreadSafe;
 
 import java.io.File;
+import java.util.List;
+import java.util.Set;
 
 /**
  * Functions to query and modify files on a Posix file system.
@@ -70,4 +72,80 @@ public interface PosixFiles extends Files, NativeIntegration {
      */
     @ThreadSafe
     PosixFileInfo stat(File file, boolean linkTarget) throws NativeException;
+
+    /**
+     * {@inheritDoc}
+     */
+    @ThreadSafe
+    List<? extends PosixFileInfo> stat(List<File> files, boolean linkTarget) throws NativeException;
+
+    /**
+     * {@inheritDoc}
+     */
+    @ThreadSafe
+    List<? extends PosixFileInfo> statPaths(List<String> paths, boolean linkTarget) throws NativeException;
+
+    /**
+     * Returns the requested details of the given file, with timestamps in nanosecond precision. Where the operating
+     * system supports it, only the requested details are queried, and network file systems are not asked to
+     * synchronize the details with the server.
+     *
+     * @param file The path of the file to get details of. Follows symlinks to the parent directory of this file.
+     * @param linkTarget When true and the file is a symlink, return details of the target of the symlink instead of details of the symlink itself.
+     * @param fields The details to query. The type of the file is always queried.
+     * @return Details of the file. Returns details with type {@link FileInfo.Type#Missing} for a file that does not
+     * exist.
+     * @throws NativeException On failure to query the file information.
+     * @throws FilePermissionException When the user has insufficient permissions to query the file information
+     */
+    @ThreadSafe
+    PosixFileDetails stat(File file, boolean linkTarget, Set<PosixFileDetails.Field> fields) throws NativeException;
+
+    /**
+     * Sets the mode for the given file, with the path given as the raw bytes of the path as used by the file system.
+     * No conversion using the locale of the process is applied.
+     *
+     * @throws NativeException On failure.
+     */
+    @ThreadSafe
+    void setMode(byte[] path, int perms) throws NativeException;
+
+    /**
+     * Creates a symbolic link with given contents, with the path and contents given as raw bytes. No conversion using
+     * the locale of the process is applied.
+     *
+     * @throws NativeException On failure.
+     */
+    @ThreadSafe
+    void symlink(byte[] link, byte[] contents) throws NativeException;
+
+    /**
+     * Reads the contents of a symbolic link as raw bytes, with the path given as raw bytes. No conversion using
+     * the locale of the process is applied.
+     *
+     * @throws NativeException On failure.
+     */
+    @ThreadSafe
+    byte[] readLink(byte[] link) throws NativeException;
+
+    /**
+     * Queries the details of a file, with the path given as raw bytes. No conversion using the locale of the process
+     * is applied.
+     *
+     * @see #stat(File, boolean)
+     * @throws NativeException On failure.
+     */
+    @ThreadSafe
+    PosixFileInfo stat(byte[] path, boolean linkTarget) throws NativeException;
+
+    /**
+     * Lists the entries of a directory, with the path of the directory and the names of the entries as raw bytes.
+     * No conversion using the locale of the process is applied, so names that cannot be represented in the
+     * locale are returned as is.
+     *
+     * @see #listDir(File, boolean)
+     * @throws NativeException On failure.
+     */
+    @ThreadSafe
+    List<? extends RawDirEntry> listDir(byte[] dir, boolean linkTarget) throws NativeException;
 }
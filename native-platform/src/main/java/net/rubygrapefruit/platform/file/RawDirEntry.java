@@ -0,0 +1,33 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.file;
+
+import net.rubygrapefruit.platform.ThreadSafe;
+
+/**
+ * Details about a file in a directory, with the name as the raw bytes reported by the file system. This is a snapshot and does not change.
+ *
+ * <p>A listing can be fetched using {@link PosixFiles#listDir(byte[], boolean)}.</p>
+ */
+@ThreadSafe
+public interface RawDirEntry extends FileInfo {
+    /**
+     * Returns the name of the file, as the raw bytes reported by the file system. The returned array is shared and must not be modified.
+     */
+    byte[] getName();
+}
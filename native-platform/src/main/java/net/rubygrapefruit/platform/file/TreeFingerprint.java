@@ -0,0 +1,48 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.file;
+
+import net.rubygrapefruit.platform.ThreadSafe;
+
+import java.util.Map;
+
+/**
+ * A fingerprint of the metadata of a directory tree, created by {@link Files#fingerprint(java.io.File, FingerprintOptions)}.
+ * This is a snapshot and does not change.
+ *
+ * <p>The digests are SHA-256 hashes. The digest of a directory covers the names, types, sizes and, depending on the
+ * options, the last modification times and modes of its entries in the order of their names, followed by the names
+ * and digests of the directories in it. Names are hashed as the bytes used by the file system, or as UTF-8 on Windows.
+ * The contents of files are not read.</p>
+ *
+ * <p>The digests are stable for the same tree and options, regardless of the order in which the tree is walked.</p>
+ */
+@ThreadSafe
+public interface TreeFingerprint {
+    /**
+     * Returns the digest of the whole tree.
+     */
+    byte[] getDigest();
+
+    /**
+     * Returns the digest of each directory in the tree, keyed by the path of the directory relative to the root, with
+     * the root itself as the empty string. Directories are sorted so that the directories below a directory follow it.
+     * Empty unless requested with {@link FingerprintOptions#withDirectoryDigests(boolean)}.
+     */
+    Map<String, byte[]> getDirectoryDigests();
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.file;
+
+/**
+ * Options for walking a directory tree with {@link Files#walk(java.io.File, WalkOptions, FileTreeVisitor)}.
+ */
+public final class WalkOptions {
+    private int maxDepth = -1;
+    private boolean followLinks;
+    private int threads;
+
+    /**
+     * Limits the walk to the given number of levels below the root. 1 only visits the entries of the root directory.
+     * The walk is not limited by default.
+     */
+    public WalkOptions withMaxDepth(int maxDepth) {
+        this.maxDepth = maxDepth;
+        return this;
+    }
+
+    /**
+     * Reports the targets of symlinks instead of the symlinks themselves, and walks the directories symlinks point to.
+     * Symlinks leading back to a parent directory are not followed. Symlinks are not followed by default.
+     *
+     * <p>A directory reachable via several symlinks is walked once for each of them, so that what is reported does not
+     * depend on the order the tree is walked in. A tree where symlinks lead into each other's subtrees can therefore
+     * take time exponential in the number of such symlinks to walk.</p>
+     */
+    public WalkOptions withFollowLinks(boolean followLinks) {
+        this.followLinks = followLinks;
+        return this;
+    }
+
+    /**
+     * Uses the given number of threads to walk the tree. Uses as many threads as there are processors by default.
+     */
+    public WalkOptions withThreads(int threads) {
+        this.threads = threads;
+        return this;
+    }
+
+    /**
+     * Returns the maximum depth of the walk, or -1 for no limit.
+     */
+    public int getMaxDepth() {
+        return maxDepth;
+    }
+
+    public boolean isFollowLinks() {
+        return followLinks;
+    }
+
+    /**
+     * Returns the number of threads to use, or 0 to use as many threads as there are processors.
+     */
+    public int getThreads() {
+        return threads;
+    }
+}
@@ -18,15 +18,42 @@ package net.rubygrapefruit.platform.internal;
 
 import net.rubygrapefruit.platform.*;
 import net.rubygrapefruit.platform.file.DirEntry;
+import net.rubygrapefruit.platform.file.DirStream;
 import net.rubygrapefruit.platform.file.FilePermissionException;
+import net.rubygrapefruit.platform.file.FileTreeVisitor;
+import net.rubygrapefruit.platform.file.FingerprintOptions;
+import net.rubygrapefruit.platform.file.PosixFileDetails;
 import net.rubygrapefruit.platform.file.PosixFileInfo;
 import net.rubygrapefruit.platform.file.PosixFiles;
+import net.rubygrapefruit.platform.file.RawDirEntry;
+import net.rubygrapefruit.platform.file.TreeFingerprint;
+import net.rubygrapefruit.platform.file.WalkOptions;
 import net.rubygrapefruit.platform.internal.jni.PosixFileFunctions;
 
 import java.io.File;
+import java.util.ArrayList;
 import java.util.List;
+import java.util.Set;
 
 public class DefaultPosixFiles extends AbstractFiles implements PosixFiles {
+    // Layout of the results of a batch, see posix.cpp
+    private static final int BATCH_INTS = 6;
+    private static final int BATCH_LONGS = 2;
+
+    private final boolean useIoUring;
+
+    public DefaultPosixFiles() {
+        this(true);
+    }
+
+    /**
+     * @param useIoUring whether large batches of files may be stat'ed with io_uring, when the kernel supports it.
+     * Otherwise they are stat'ed by a few threads.
+     */
+    public DefaultPosixFiles(boolean useIoUring) {
+        this.useIoUring = useIoUring;
+    }
+
     public PosixFileInfo stat(File file) throws NativeException {
         return stat(file, false);
     }
@@ -36,28 +63,139 @@ public class DefaultPosixFiles extends AbstractFiles implements PosixFiles {
         FileStat stat = new FileStat(file.getPath());
         PosixFileFunctions.stat(file.getPath(), linkTarget, stat, result);
         if (result.isFailed()) {
-            if (result.getFailure() == FunctionResult.Failure.Permissions) {
-                throw new FilePermissionException(String.format("Could not get file details of %s: permission denied", file));
+            throw statFailure(file, result);
+        }
+        return stat;
+    }
+
+    public List<PosixFileInfo> stat(List<File> files, boolean linkTarget) throws NativeException {
+        String[] paths = new String[files.size()];
+        int i = 0;
+        for (File file : files) {
+            paths[i++] = file.getPath();
+        }
+        return stat(paths, linkTarget);
+    }
+
+    public List<PosixFileInfo> statPaths(List<String> paths, boolean linkTarget) throws NativeException {
+        return stat(paths.toArray(new String[0]), linkTarget);
+    }
+
+    private List<PosixFileInfo> stat(String[] paths, boolean linkTarget) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        int[] ints = new int[paths.length * BATCH_INTS];
+        long[] longs = new long[paths.length * BATCH_LONGS];
+        PosixFileFunctions.statAll(paths, linkTarget, useIoUring, ints, longs, result);
+        if (result.isFailed()) {
+            for (int i = 0; i < paths.length; i++) {
+                if (ints[i * BATCH_INTS + 5] != 0) {
+                    throw statFailure(new File(paths[i]), result);
+                }
             }
-            throw new NativeException(String.format("Could not get file details of %s: %s", file, result.getMessage()));
+            throw new NativeException(String.format("Could not get file details: %s", result.getMessage()));
+        }
+        List<PosixFileInfo> stats = new ArrayList<PosixFileInfo>(paths.length);
+        for (int i = 0; i < paths.length; i++) {
+            int offset = i * BATCH_INTS;
+            FileStat stat = new FileStat(paths[i]);
+            stat.details(ints[offset], ints[offset + 1], ints[offset + 2], ints[offset + 3], longs[i * BATCH_LONGS], longs[i * BATCH_LONGS + 1], ints[offset + 4]);
+            stats.add(stat);
+        }
+        return stats;
+    }
+
+    public PosixFileDetails stat(File file, boolean linkTarget, Set<PosixFileDetails.Field> fields) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        FileDetails details = new FileDetails(file.getPath());
+        PosixFileFunctions.statx(file.getPath(), linkTarget, FileDetails.toMask(fields), details, result);
+        if (result.isFailed()) {
+            throw statFailure(file, result);
+        }
+        return details;
+    }
+
+    public PosixFileInfo stat(byte[] path, boolean linkTarget) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        FileStat stat = new FileStat(displayPath(path));
+        PosixFileFunctions.statBytes(path, linkTarget, stat, result);
+        if (result.isFailed()) {
+            throw statFailure(new File(displayPath(path)), result);
         }
         return stat;
     }
 
+    private static NativeException statFailure(File file, FunctionResult result) {
+        if (result.getFailure() == FunctionResult.Failure.Permissions) {
+            return new FilePermissionException(String.format("Could not get file details of %s: permission denied", file));
+        }
+        return new NativeException(String.format("Could not get file details of %s: %s", file, result.getMessage()));
+    }
+
     public List<DirEntry> listDir(File dir) throws NativeException {
         return listDir(dir, false);
     }
 
     public List<DirEntry> listDir(File dir, boolean linkTarget) throws NativeException {
+        return listDir(dir, linkTarget, false);
+    }
+
+    public List<DirEntry> listDirTypes(File dir, boolean linkTarget) throws NativeException {
+        return listDir(dir, linkTarget, true);
+    }
+
+    private List<DirEntry> listDir(File dir, boolean linkTarget, boolean typesOnly) throws NativeException {
         FunctionResult result = new FunctionResult();
         DirList dirList = new DirList();
-        PosixFileFunctions.readdir(dir.getPath(), linkTarget, dirList, result);
+        PosixFileFunctions.readdir(dir.getPath(), linkTarget, typesOnly, dirList, result);
         if (result.isFailed()) {
             throw listDirFailure(dir, result);
         }
         return dirList.files;
     }
 
+    public List<RawDirEntry> listDir(byte[] dir, boolean linkTarget) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        RawDirList dirList = new RawDirList();
+        PosixFileFunctions.readdirBytes(dir, linkTarget, dirList, result);
+        if (result.isFailed()) {
+            throw listDirFailure(new File(displayPath(dir)), result);
+        }
+        return dirList.files;
+    }
+
+    public DirStream openDir(File dir, boolean linkTarget) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        long handle = PosixFileFunctions.opendir(dir.getPath(), result);
+        if (result.isFailed()) {
+            throw listDirFailure(dir, result);
+        }
+        return new PosixDirStream(this, dir, linkTarget, handle);
+    }
+
+    public void walk(File root, WalkOptions options, FileTreeVisitor visitor) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        WalkCollector collector = new WalkCollector(visitor);
+        int threads = options.getThreads() > 0 ? options.getThreads() : Runtime.getRuntime().availableProcessors();
+        PosixFileFunctions.walk(root.getPath(), options.getMaxDepth(), options.isFollowLinks(), threads, collector, result);
+        if (result.isFailed()) {
+            String failedPath = collector.getFailedPath();
+            throw listDirFailure(failedPath == null || failedPath.length() == 0 ? root : new File(root, failedPath), result);
+        }
+    }
+
+    public TreeFingerprint fingerprint(File root, FingerprintOptions options) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        FingerprintCollector collector = new FingerprintCollector();
+        int threads = options.getThreads() > 0 ? options.getThreads() : Runtime.getRuntime().availableProcessors();
+        byte[] digest = PosixFileFunctions.fingerprint(root.getPath(), options.getMaxDepth(), options.isFollowLinks(), threads,
+            options.isLastModifiedTimes(), options.isModes(), options.isDirectoryDigests(), collector, result);
+        if (result.isFailed()) {
+            String failedPath = collector.getFailedPath();
+            throw listDirFailure(failedPath == null || failedPath.length() == 0 ? root : new File(root, failedPath), result);
+        }
+        return collector.toFingerprint(digest);
+    }
+
     public void setMode(File file, int perms) {
         FunctionResult result = new FunctionResult();
         PosixFileFunctions.chmod(file.getPath(), perms, result);
@@ -66,6 +204,14 @@ public class DefaultPosixFiles extends AbstractFiles implements PosixFiles {
         }
     }
 
+    public void setMode(byte[] path, int perms) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        PosixFileFunctions.chmodBytes(path, perms, result);
+        if (result.isFailed()) {
+            throw new NativeException(String.format("Could not set UNIX mode on %s: %s", displayPath(path), result.getMessage()));
+        }
+    }
+
     public int getMode(File file) {
         PosixFileInfo stat = stat(file);
         if (stat.getType() == PosixFileInfo.Type.Missing) {
@@ -90,4 +236,26 @@ public class DefaultPosixFiles extends AbstractFiles implements PosixFiles {
             throw new NativeException(String.format("Could not create symlink %s: %s", link, result.getMessage()));
         }
     }
+
+    public byte[] readLink(byte[] link) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        byte[] contents = PosixFileFunctions.readlinkBytes(link, result);
+        if (result.isFailed()) {
+            throw new NativeException(String.format("Could not read symlink %s: %s", displayPath(link), result.getMessage()));
+        }
+        return contents;
+    }
+
+    public void symlink(byte[] link, byte[] contents) throws NativeException {
+        FunctionResult result = new FunctionResult();
+        PosixFileFunctions.symlinkBytes(link, contents, result);
+        if (result.isFailed()) {
+            throw new NativeException(String.format("Could not create symlink %s: %s", displayPath(link), result.getMessage()));
+        }
+    }
+
+    // Only used for error messages and toString(), so does not need to round trip
+    private static String displayPath(byte[] path) {
+        return new String(path);
+    }
 }
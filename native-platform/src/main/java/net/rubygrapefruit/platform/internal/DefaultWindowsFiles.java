@@ -18,12 +18,30 @@ package net.rubygrapefruit.platform.internal;
 
 import net.rubygrapefruit.platform.*;
 import net.rubygrapefruit.platform.file.DirEntry;
+import net.rubygrapefruit.platform.file.DirStream;
+import net.rubygrapefruit.platform.file.FileInfo;
+import net.rubygrapefruit.platform.file.FileTreeVisitor;
+import net.rubygrapefruit.platform.file.FingerprintOptions;
+import net.rubygrapefruit.platform.file.TreeFingerprint;
+import net.rubygrapefruit.platform.file.WalkOptions;
 import net.rubygrapefruit.platform.file.WindowsFileInfo;
 import net.rubygrapefruit.platform.file.WindowsFiles;
 import net.rubygrapefruit.platform.internal.jni.WindowsFileFunctions;
 
 import java.io.File;
+import java.io.IOException;
+import java.io.UnsupportedEncodingException;
+import java.nio.ByteBuffer;
+import java.security.MessageDigest;
+import java.security.NoSuchAlgorithmException;
+import java.util.ArrayList;
+import java.util.Collections;
+import java.util.Comparator;
+import java.util.HashSet;
+import java.util.Iterator;
 import java.util.List;
+import java.util.NoSuchElementException;
+import java.util.Set;
 
 public class DefaultWindowsFiles extends AbstractFiles implements WindowsFiles {
     public WindowsFileInfo stat(File file) throws NativeException {
@@ -50,7 +68,202 @@ public class DefaultWindowsFiles extends AbstractFiles implements WindowsFiles {
         return dirList.files;
     }
 
+    public List<WindowsFileInfo> stat(List<File> files, boolean linkTarget) throws NativeException {
+        List<WindowsFileInfo> stats = new ArrayList<WindowsFileInfo>(files.size());
+        for (File file : files) {
+            stats.add(stat(file, linkTarget));
+        }
+        return stats;
+    }
+
+    public List<WindowsFileInfo> statPaths(List<String> paths, boolean linkTarget) throws NativeException {
+        List<WindowsFileInfo> stats = new ArrayList<WindowsFileInfo>(paths.size());
+        for (String path : paths) {
+            stats.add(stat(new File(path), linkTarget));
+        }
+        return stats;
+    }
+
+    public List<? extends DirEntry> listDirTypes(File dir, boolean linkTarget) throws NativeException {
+        // The size and timestamps come with the name and type of each entry, so there is nothing to save
+        DirList types = new DirList();
+        for (DirEntry entry : listDir(dir, linkTarget)) {
+            types.addFile(entry.getName(), entry.getType().ordinal(), 0, 0);
+        }
+        return types.files;
+    }
+
     public List<? extends DirEntry> listDir(File dir) throws NativeException {
         return listDir(dir, false);
     }
+
+    public DirStream openDir(File dir, boolean linkTarget) throws NativeException {
+        // Lists the whole directory up front, there is no chunked listing on Windows yet
+        final Iterator<? extends DirEntry> entries = listDir(dir, linkTarget).iterator();
+        return new DirStream() {
+            private boolean closed;
+
+            public boolean hasNext() {
+                return !closed && entries.hasNext();
+            }
+
+            public DirEntry next() {
+                if (!hasNext()) {
+                    throw new NoSuchElementException();
+                }
+                return entries.next();
+            }
+
+            public void remove() {
+                throw new UnsupportedOperationException();
+            }
+
+            public void close() {
+                closed = true;
+            }
+        };
+    }
+
+    public void walk(File root, WalkOptions options, FileTreeVisitor visitor) throws NativeException {
+        Set<String> ancestors = new HashSet<String>();
+        if (options.isFollowLinks()) {
+            ancestors.add(canonicalPath(root));
+        }
+        walk(root, "", 1, options, ancestors, visitor);
+    }
+
+    private void walk(File dir, String path, int depth, WalkOptions options, Set<String> ancestors, FileTreeVisitor visitor) {
+        if (options.getMaxDepth() >= 0 && depth > options.getMaxDepth()) {
+            return;
+        }
+        for (DirEntry entry : listDir(dir, options.isFollowLinks())) {
+            String entryPath = path.length() == 0 ? entry.getName() : path + File.separatorChar + entry.getName();
+            visitor.visitEntry(entryPath, entry.getType(), entry.getSize(), entry.getLastModifiedTime());
+            if (entry.getType() != FileInfo.Type.Directory) {
+                continue;
+            }
+            File child = new File(dir, entry.getName());
+            // Symlinks can lead back to a parent directory
+            String canonicalPath = options.isFollowLinks() ? canonicalPath(child) : null;
+            if (canonicalPath != null && !ancestors.add(canonicalPath)) {
+                continue;
+            }
+            walk(child, entryPath, depth + 1, options, ancestors, visitor);
+            if (canonicalPath != null) {
+                ancestors.remove(canonicalPath);
+            }
+        }
+    }
+
+    public TreeFingerprint fingerprint(File root, FingerprintOptions options) throws NativeException {
+        Set<String> ancestors = new HashSet<String>();
+        if (options.isFollowLinks()) {
+            ancestors.add(canonicalPath(root));
+        }
+        FingerprintCollector collector = new FingerprintCollector();
+        byte[] digest = fingerprint(root, "", 0, options, ancestors, collector);
+        return collector.toFingerprint(digest);
+    }
+
+    // Hashes the same details in the same way as posix.cpp, except for the targets of symlinks, which can't be read here
+    private byte[] fingerprint(File dir, String path, int depth, FingerprintOptions options, Set<String> ancestors, FingerprintCollector collector) {
+        if (options.isDirectoryDigests()) {
+            // Keeps the directory ahead of the directories below it
+            collector.directory(path, null);
+        }
+        List<FingerprintEntry> entries = new ArrayList<FingerprintEntry>();
+        if (options.getMaxDepth() != 0) {
+            for (DirEntry entry : listDir(dir, options.isFollowLinks())) {
+                entries.add(new FingerprintEntry(entry));
+            }
+        }
+        Collections.sort(entries, new Comparator<FingerprintEntry>() {
+            public int compare(FingerprintEntry entry1, FingerprintEntry entry2) {
+                byte[] name1 = entry1.name;
+                byte[] name2 = entry2.name;
+                for (int i = 0; i < name1.length && i < name2.length; i++) {
+                    if (name1[i] != name2[i]) {
+                        return (name1[i] & 0xff) - (name2[i] & 0xff);
+                    }
+                }
+                return name1.length - name2.length;
+            }
+        });
+
+        MessageDigest hash = sha256();
+        ByteBuffer values = ByteBuffer.allocate(21);
+        List<FingerprintEntry> children = new ArrayList<FingerprintEntry>();
+        for (FingerprintEntry entry : entries) {
+            FileInfo.Type type = entry.entry.getType();
+            values.clear();
+            values.put((byte) type.ordinal());
+            values.putLong(type == FileInfo.Type.File ? entry.entry.getSize() : 0);
+            if (options.isLastModifiedTimes()) {
+                values.putLong(type == FileInfo.Type.Directory ? 0 : entry.entry.getLastModifiedTime() * 1000000L);
+            }
+            if (options.isModes()) {
+                values.putInt(0);
+            }
+            hash.update(entry.name);
+            hash.update((byte) 0);
+            hash.update(values.array(), 0, values.position());
+            if (type == FileInfo.Type.Directory && (options.getMaxDepth() < 0 || depth + 1 < options.getMaxDepth())) {
+                children.add(entry);
+            }
+        }
+
+        byte[] localDigest = hash.digest();
+        hash.update(localDigest);
+        for (FingerprintEntry child : children) {
+            File childDir = new File(dir, child.entry.getName());
+            String childPath = path.length() == 0 ? child.entry.getName() : path + File.separatorChar + child.entry.getName();
+            // Symlinks can lead back to a parent directory
+            String canonicalPath = options.isFollowLinks() ? canonicalPath(childDir) : null;
+            if (canonicalPath != null && !ancestors.add(canonicalPath)) {
+                continue;
+            }
+            byte[] childDigest = fingerprint(childDir, childPath, depth + 1, options, ancestors, collector);
+            if (canonicalPath != null) {
+                ancestors.remove(canonicalPath);
+            }
+            hash.update(child.name);
+            hash.update((byte) 0);
+            hash.update(childDigest);
+        }
+        byte[] digest = hash.digest();
+        if (options.isDirectoryDigests()) {
+            collector.directory(path, digest);
+        }
+        return digest;
+    }
+
+    private static MessageDigest sha256() {
+        try {
+            return MessageDigest.getInstance("SHA-256");
+        } catch (NoSuchAlgorithmException e) {
+            throw new NativeException("Could not create SHA-256 digest.", e);
+        }
+    }
+
+    private static class FingerprintEntry {
+        final DirEntry entry;
+        final byte[] name;
+
+        FingerprintEntry(DirEntry entry) {
+            this.entry = entry;
+            try {
+                this.name = entry.getName().getBytes("UTF-8");
+            } catch (UnsupportedEncodingException e) {
+                throw new NativeException(String.format("Could not encode file name %s.", entry.getName()), e);
+            }
+        }
+    }
+
+    private static String canonicalPath(File file) {
+        try {
+            return file.getCanonicalPath();
+        } catch (IOException e) {
+            throw new NativeException(String.format("Could not resolve %s.", file), e);
+        }
+    }
 }
@@ -0,0 +1,110 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.internal;
+
+import net.rubygrapefruit.platform.file.PosixFileDetails;
+
+import java.util.Set;
+
+public class FileDetails implements PosixFileDetails {
+    private final String path;
+    private Type type;
+    private int fields;
+    private int mode;
+    private long size;
+    private long modificationTime;
+    private long changeTime;
+    private long creationTime;
+    private long inode;
+    private long device;
+    private long linkCount;
+
+    public FileDetails(String path) {
+        this.path = path;
+    }
+
+    public static int toMask(Set<Field> fields) {
+        int mask = 0;
+        for (Field field : fields) {
+            mask |= 1 << field.ordinal();
+        }
+        return mask;
+    }
+
+    public void details(int type, int fields, int mode, long size, long modificationTime, long changeTime, long creationTime, long inode, long device, long linkCount) {
+        this.type = Type.values()[type];
+        this.fields = fields;
+        this.mode = mode;
+        this.size = size;
+        this.modificationTime = modificationTime;
+        this.changeTime = changeTime;
+        this.creationTime = creationTime;
+        this.inode = inode;
+        this.device = device;
+        this.linkCount = linkCount;
+    }
+
+    @Override
+    public String toString() {
+        return path;
+    }
+
+    public boolean has(Field field) {
+        return (fields & (1 << field.ordinal())) != 0;
+    }
+
+    public Type getType() {
+        return type;
+    }
+
+    public int getMode() {
+        return mode;
+    }
+
+    public long getSize() {
+        return size;
+    }
+
+    public long getLastModifiedTime() {
+        return modificationTime / 1000000;
+    }
+
+    public long getLastModifiedTimeNanos() {
+        return modificationTime;
+    }
+
+    public long getChangeTimeNanos() {
+        return changeTime;
+    }
+
+    public long getCreationTimeNanos() {
+        return creationTime;
+    }
+
+    public long getInode() {
+        return inode;
+    }
+
+    public long getDevice() {
+        return device;
+    }
+
+    public long getLinkCount() {
+        return linkCount;
+    }
+}
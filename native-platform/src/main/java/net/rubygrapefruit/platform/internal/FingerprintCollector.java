@@ -0,0 +1,79 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.internal;
+
+import net.rubygrapefruit.platform.file.TreeFingerprint;
+
+import java.util.Collections;
+import java.util.LinkedHashMap;
+import java.util.Map;
+
+public class FingerprintCollector {
+    private final Map<String, byte[]> directories = new LinkedHashMap<String, byte[]>();
+    private String failedPath;
+
+    /**
+     * Returns the path of the directory that could not be listed, relative to the root.
+     */
+    public String getFailedPath() {
+        return failedPath;
+    }
+
+    public TreeFingerprint toFingerprint(byte[] digest) {
+        return new DefaultTreeFingerprint(digest, Collections.unmodifiableMap(directories));
+    }
+
+    // Called from native code
+    @SuppressWarnings("UnusedDeclaration")
+    void directory(String path, byte[] digest) {
+        directories.put(path, digest);
+    }
+
+    // Called from native code
+    @SuppressWarnings("UnusedDeclaration")
+    void failed(String path) {
+        failedPath = path;
+    }
+
+    private static class DefaultTreeFingerprint implements TreeFingerprint {
+        private final byte[] digest;
+        private final Map<String, byte[]> directoryDigests;
+
+        DefaultTreeFingerprint(byte[] digest, Map<String, byte[]> directoryDigests) {
+            this.digest = digest;
+            this.directoryDigests = directoryDigests;
+        }
+
+        @Override
+        public String toString() {
+            StringBuilder builder = new StringBuilder();
+            for (byte b : digest) {
+                builder.append(String.format("%02x", b & 0xff));
+            }
+            return builder.toString();
+        }
+
+        public byte[] getDigest() {
+            return digest;
+        }
+
+        public Map<String, byte[]> getDirectoryDigests() {
+            return directoryDigests;
+        }
+    }
+}
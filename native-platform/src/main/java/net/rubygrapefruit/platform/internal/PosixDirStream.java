@@ -0,0 +1,157 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.internal;
+
+import net.rubygrapefruit.platform.NativeException;
+import net.rubygrapefruit.platform.file.DirEntry;
+import net.rubygrapefruit.platform.file.DirStream;
+import net.rubygrapefruit.platform.file.FileInfo;
+import net.rubygrapefruit.platform.internal.jni.PosixFileFunctions;
+
+import java.io.File;
+import java.io.UnsupportedEncodingException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.util.NoSuchElementException;
+
+/**
+ * Reads the entries of a directory into a direct buffer, one chunk at a time, so memory use does not depend on
+ * the size of the directory.
+ */
+public class PosixDirStream implements DirStream {
+    private static final int BUFFER_SIZE = 64 * 1024;
+    // Corresponds to DIR_STREAM_RECORD_SIZE in posix.cpp
+    private static final int RECORD_SIZE = 32;
+    private static final String FILE_NAME_ENCODING = fileNameEncoding();
+    private static final FileInfo.Type[] TYPES = FileInfo.Type.values();
+
+    private final DefaultPosixFiles files;
+    private final File dir;
+    private final boolean linkTarget;
+    private final ByteBuffer buffer = ByteBuffer.allocateDirect(BUFFER_SIZE).order(ByteOrder.nativeOrder());
+    private long handle;
+    private int count;
+    private int index;
+
+    PosixDirStream(DefaultPosixFiles files, File dir, boolean linkTarget, long handle) {
+        this.files = files;
+        this.dir = dir;
+        this.linkTarget = linkTarget;
+        this.handle = handle;
+    }
+
+    public boolean hasNext() {
+        if (index < count) {
+            return true;
+        }
+        if (handle == 0) {
+            return false;
+        }
+        FunctionResult result = new FunctionResult();
+        count = PosixFileFunctions.readdirChunk(handle, linkTarget, buffer, result);
+        index = 0;
+        if (result.isFailed()) {
+            close();
+            throw files.listDirFailure(dir, result);
+        }
+        if (count == 0) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    public DirEntry next() {
+        if (!hasNext()) {
+            throw new NoSuchElementException();
+        }
+        int offset = index * RECORD_SIZE;
+        index++;
+        int type = buffer.getInt(offset);
+        int nameOffset = buffer.getInt(offset + 4);
+        byte[] name = new byte[buffer.getInt(offset + 8)];
+        buffer.position(nameOffset);
+        buffer.get(name);
+        return new EncodedDirEntry(name, TYPES[type], buffer.getLong(offset + 16), buffer.getLong(offset + 24));
+    }
+
+    public void remove() {
+        throw new UnsupportedOperationException();
+    }
+
+    public void close() {
+        if (handle != 0) {
+            PosixFileFunctions.closedir(handle);
+            handle = 0;
+            count = 0;
+        }
+    }
+
+    private static String fileNameEncoding() {
+        // The encoding the JVM uses for file names, which is what the native string conversions use as well
+        String encoding = System.getProperty("sun.jnu.encoding");
+        return encoding != null ? encoding : System.getProperty("file.encoding");
+    }
+
+    /**
+     * A directory entry that decodes its name on first access.
+     */
+    private static class EncodedDirEntry implements DirEntry {
+        private final Type type;
+        private final long size;
+        private final long lastModified;
+        private byte[] encodedName;
+        private String name;
+
+        EncodedDirEntry(byte[] encodedName, Type type, long size, long lastModified) {
+            this.encodedName = encodedName;
+            this.type = type;
+            this.size = size;
+            this.lastModified = lastModified;
+        }
+
+        @Override
+        public String toString() {
+            return getName();
+        }
+
+        public synchronized String getName() {
+            if (name == null) {
+                try {
+                    name = new String(encodedName, FILE_NAME_ENCODING);
+                } catch (UnsupportedEncodingException e) {
+                    throw new NativeException(String.format("Could not decode file name using %s.", FILE_NAME_ENCODING), e);
+                }
+                encodedName = null;
+            }
+            return name;
+        }
+
+        public Type getType() {
+            return type;
+        }
+
+        public long getLastModifiedTime() {
+            return lastModified;
+        }
+
+        public long getSize() {
+            return size;
+        }
+    }
+}
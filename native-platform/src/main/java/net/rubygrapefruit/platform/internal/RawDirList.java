@@ -0,0 +1,69 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.internal;
+
+import net.rubygrapefruit.platform.file.FileInfo;
+import net.rubygrapefruit.platform.file.RawDirEntry;
+
+import java.util.ArrayList;
+import java.util.List;
+
+public class RawDirList {
+    public List<RawDirEntry> files = new ArrayList<RawDirEntry>();
+
+    // Called from native code
+    @SuppressWarnings("UnusedDeclaration")
+    public void addFile(byte[] name, int type, long size, long lastModified) {
+        files.add(new DefaultRawDirEntry(name, FileInfo.Type.values()[type], size, lastModified));
+    }
+
+    private static class DefaultRawDirEntry implements RawDirEntry {
+        private final byte[] name;
+        private final Type type;
+        private final long size;
+        private final long lastModified;
+
+        DefaultRawDirEntry(byte[] name, Type type, long size, long lastModified) {
+            this.name = name;
+            this.type = type;
+            this.size = size;
+            this.lastModified = lastModified;
+        }
+
+        @Override
+        public String toString() {
+            return new String(name);
+        }
+
+        public byte[] getName() {
+            return name;
+        }
+
+        public Type getType() {
+            return type;
+        }
+
+        public long getLastModifiedTime() {
+            return lastModified;
+        }
+
+        public long getSize() {
+            return size;
+        }
+    }
+}
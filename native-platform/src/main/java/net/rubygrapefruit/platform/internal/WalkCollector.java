@@ -0,0 +1,61 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+package net.rubygrapefruit.platform.internal;
+
+import net.rubygrapefruit.platform.file.FileInfo;
+import net.rubygrapefruit.platform.file.FileTreeVisitor;
+
+public class WalkCollector {
+    // Corresponds to WALK_BATCH_SIZE in posix.cpp
+    private static final int BATCH_SIZE = 1024;
+    private static final FileInfo.Type[] TYPES = FileInfo.Type.values();
+
+    // Filled by native code
+    final String[] paths = new String[BATCH_SIZE];
+    final int[] types = new int[BATCH_SIZE];
+    final long[] sizes = new long[BATCH_SIZE];
+    final long[] lastModified = new long[BATCH_SIZE];
+
+    private final FileTreeVisitor visitor;
+    private String failedPath;
+
+    public WalkCollector(FileTreeVisitor visitor) {
+        this.visitor = visitor;
+    }
+
+    /**
+     * Returns the path of the directory that could not be listed, relative to the root.
+     */
+    public String getFailedPath() {
+        return failedPath;
+    }
+
+    // Called from native code
+    @SuppressWarnings("UnusedDeclaration")
+    void batch(int count) {
+        for (int i = 0; i < count; i++) {
+            visitor.visitEntry(paths[i], TYPES[types[i]], sizes[i], lastModified[i]);
+        }
+    }
+
+    // Called from native code
+    @SuppressWarnings("UnusedDeclaration")
+    void failed(String path) {
+        failedPath = path;
+    }
+}
@@ -17,17 +17,47 @@
 package net.rubygrapefruit.platform.internal.jni;
 
 import net.rubygrapefruit.platform.internal.DirList;
+import net.rubygrapefruit.platform.internal.FileDetails;
 import net.rubygrapefruit.platform.internal.FileStat;
+import net.rubygrapefruit.platform.internal.FingerprintCollector;
 import net.rubygrapefruit.platform.internal.FunctionResult;
+import net.rubygrapefruit.platform.internal.RawDirList;
+import net.rubygrapefruit.platform.internal.WalkCollector;
+
+import java.nio.ByteBuffer;
 
 public class PosixFileFunctions {
     public static native void chmod(String file, int perms, FunctionResult result);
 
+    public static native void chmodBytes(byte[] file, int perms, FunctionResult result);
+
     public static native void stat(String file, boolean followLink, FileStat stat, FunctionResult result);
 
-    public static native void readdir(String file, boolean followLink, DirList stat, FunctionResult result);
+    public static native void statBytes(byte[] file, boolean followLink, FileStat stat, FunctionResult result);
+
+    public static native void statAll(String[] files, boolean followLink, boolean useIoUring, int[] ints, long[] longs, FunctionResult result);
+
+    public static native void statx(String file, boolean followLink, int fields, FileDetails details, FunctionResult result);
+
+    public static native void readdir(String file, boolean followLink, boolean typesOnly, DirList stat, FunctionResult result);
+
+    public static native void readdirBytes(byte[] file, boolean followLink, RawDirList stat, FunctionResult result);
+
+    public static native long opendir(String file, FunctionResult result);
+
+    public static native int readdirChunk(long handle, boolean followLink, ByteBuffer buffer, FunctionResult result);
+
+    public static native void closedir(long handle);
+
+    public static native void walk(String root, int maxDepth, boolean followLinks, int threads, WalkCollector collector, FunctionResult result);
+
+    public static native byte[] fingerprint(String root, int maxDepth, boolean followLinks, int threads, boolean lastModified, boolean modes, boolean directoryDigests, FingerprintCollector collector, FunctionResult result);
 
     public static native void symlink(String file, String content, FunctionResult result);
 
+    public static native void symlinkBytes(byte[] file, byte[] content, FunctionResult result);
+
     public static native String readlink(String file, FunctionResult result);
+
+    public static native byte[] readlinkBytes(byte[] file, FunctionResult result);
 }
@@ -63,4 +63,32 @@ jstring utf_char_to_java(JNIEnv* env, const char* chars, jobject result) {
     return env->NewStringUTF(chars);
 }
 
+char* java_bytes_to_char(JNIEnv* env, jbyteArray bytes, jobject result) {
+    jsize length = env->GetArrayLength(bytes);
+    char* chars = (char*) malloc(length + 1);
+    if (chars == NULL) {
+        mark_failed_with_message(env, "could not allocate memory", result);
+        return NULL;
+    }
+    env->GetByteArrayRegion(bytes, 0, length, (jbyte*) chars);
+    if (memchr(chars, 0, length) != NULL) {
+        mark_failed_with_message(env, "path contains a NULL character", result);
+        free(chars);
+        return NULL;
+    }
+    chars[length] = 0;
+    return chars;
+}
+
+jbyteArray char_to_java_bytes(JNIEnv* env, const char* chars, jobject result) {
+    jsize length = (jsize) strlen(chars);
+    jbyteArray bytes = env->NewByteArray(length);
+    if (bytes == NULL) {
+        // An OutOfMemoryError is pending
+        return NULL;
+    }
+    env->SetByteArrayRegion(bytes, 0, length, (const jbyte*) chars);
+    return bytes;
+}
+
 #endif
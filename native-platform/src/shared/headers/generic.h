@@ -37,6 +37,16 @@ extern "C" {
 #define FILE_TYPE_OTHER 3
 #define FILE_TYPE_MISSING 4
 
+// Corresponds to bits for the values of PosixFileDetails.Field
+#define FILE_FIELD_MODE (1 << 0)
+#define FILE_FIELD_SIZE (1 << 1)
+#define FILE_FIELD_MODIFIED (1 << 2)
+#define FILE_FIELD_CHANGED (1 << 3)
+#define FILE_FIELD_CREATED (1 << 4)
+#define FILE_FIELD_INODE (1 << 5)
+#define FILE_FIELD_DEVICE (1 << 6)
+#define FILE_FIELD_LINK_COUNT (1 << 7)
+
 // Corresponds to values of FunctionResult.Failure
 #define FAILURE_GENERIC 0
 #define FAILURE_NO_SUCH_FILE 1
@@ -106,12 +116,38 @@ extern char* java_to_utf_char(JNIEnv* env, jstring string, jobject result);
  */
 extern jstring utf_char_to_java(JNIEnv* env, const char* chars, jobject result);
 
+/*
+ * Copies the given byte array to a NULL terminated char string, without any conversion. Should call free() when finished.
+ *
+ * Returns NULL on failure, or when the bytes contain a NULL character.
+ */
+extern char* java_bytes_to_char(JNIEnv* env, jbyteArray bytes, jobject result);
+
+/*
+ * Copies the given NULL terminated char string to a Java byte array, without any conversion.
+ *
+ * Returns NULL on failure.
+ */
+extern jbyteArray char_to_java_bytes(JNIEnv* env, const char* chars, jobject result);
+
 typedef struct file_stat {
     jint fileType;
     jlong lastModified;
     jlong size;
 } file_stat_t;
 
+#ifdef __linux__
+struct statx;
+
+/*
+ * Stats the given files with io_uring, keeping many requests in flight at the same time. Sets the errno of each file,
+ * 0 on success, or -1 when the file has not been stat'ed and needs to be stat'ed some other way.
+ *
+ * Returns false when io_uring cannot stat files on this machine.
+ */
+extern bool uring_statx(char** paths, int count, int flags, unsigned int mask, struct statx* results, int* errors);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
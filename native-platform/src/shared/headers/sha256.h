@@ -0,0 +1,46 @@
+/*
+ * Copyright 2012 Adam Murdoch
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+
+/*
+ * SHA-256 message digest, as specified by FIPS 180-4.
+ */
+#ifndef __INCLUDE_SHA256_H__
+#define __INCLUDE_SHA256_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_LENGTH 32
+
+typedef struct sha256 {
+    uint32_t state[8];
+    // Number of bytes hashed so far
+    uint64_t length;
+    unsigned char buffer[64];
+    size_t bufferLength;
+} sha256_t;
+
+extern void sha256_init(sha256_t* context);
+
+extern void sha256_update(sha256_t* context, const void* data, size_t length);
+
+/*
+ * Writes SHA256_DIGEST_LENGTH bytes to digest. The context cannot be used afterwards without calling sha256_init() again.
+ */
+extern void sha256_final(sha256_t* context, unsigned char* digest);
+
+#endif
@@ -413,6 +413,33 @@ abstract class FilesTest extends AbstractFilesTest {
         stat.type == FileInfo.Type.Directory
     }
 
+    def "can stat many files at once"() {
+        def testDir = tmpDir.newFolder()
+        // Enough files to be split between threads
+        def testFiles = (0..<2000).collect { new File(testDir, "file-${it}.txt") }
+        testFiles.each { it.text = it.name }
+        def subDir = new File(testDir, "sub")
+        subDir.mkdirs()
+        def missing = new File(testDir, "missing")
+
+        when:
+        def stats = files.stat(testFiles + [subDir, missing], false)
+
+        then:
+        stats.size() == testFiles.size() + 2
+        testFiles.indices.every { stats[it].type == FileInfo.Type.File && stats[it].size == testFiles[it].name.length() }
+        assertIsFile(stats[0], testFiles[0])
+        assertIsDirectory(stats[testFiles.size()], subDir)
+        assertIsMissing(stats[testFiles.size() + 1])
+
+        when:
+        stats = files.statPaths([testFiles[1].path, subDir.path, missing.path], false)
+
+        then:
+        stats*.type == [FileInfo.Type.File, FileInfo.Type.Directory, FileInfo.Type.Missing]
+        assertIsFile(stats[0], testFiles[1])
+    }
+
     @Unroll
     def "can list contents of an empty directory"() {
         def dir = tmpDir.newFolder()
@@ -458,6 +485,21 @@ abstract class FilesTest extends AbstractFilesTest {
         fileName << names
     }
 
+    def "can list contents of a directory with many entries"() {
+        def testDir = tmpDir.newFolder()
+        // Enough entries to need more than one read of the directory
+        def names = (0..<3000).collect { "file-with-a-rather-long-name-${it}.txt".toString() }
+        names.each { new File(testDir, it).text = it }
+
+        when:
+        def files = files.listDir(testDir)
+
+        then:
+        files.size() == names.size()
+        files*.name as Set == names as Set
+        files.every { it.type == FileInfo.Type.File && it.size == it.name.length() }
+    }
+
     @IgnoreIf({ !FilesTest.supportsSymbolicLinks() })
     @Unroll
     def "can list contents of a directory with symbolic links"() {
@@ -574,6 +616,247 @@ abstract class FilesTest extends AbstractFilesTest {
         followLinks << [true, false]
     }
 
+    @IgnoreIf({ !FilesTest.supportsSymbolicLinks() })
+    def "can list names and types of the contents of a directory"() {
+        def testFile = tmpDir.newFolder("test.dir")
+        def childDir = new File(testFile, "dir.a")
+        childDir.mkdirs()
+        def childFile = new File(testFile, "file.b")
+        childFile.text = 'contents'
+        def childLink = new File(testFile, "link.c")
+        createFileSymbolicLink(childLink, childFile.name)
+        def childMissingLink = new File(testFile, "missing.d")
+        createFileSymbolicLink(childMissingLink, "missing")
+
+        when:
+        def files = files.listDirTypes(testFile, followLinks)
+
+        then:
+        files.size() == 4
+        files.sort { it.name }
+        files*.name == ["dir.a", "file.b", "link.c", "missing.d"]
+        files*.type == types
+        files.every { it.size == 0 && it.lastModifiedTime == 0 }
+
+        where:
+        followLinks | types
+        false       | [FileInfo.Type.Directory, FileInfo.Type.File, FileInfo.Type.Symlink, FileInfo.Type.Symlink]
+        true        | [FileInfo.Type.Directory, FileInfo.Type.File, FileInfo.Type.File, FileInfo.Type.Missing]
+    }
+
+    def "can stream contents of a directory"() {
+        def testDir = tmpDir.newFolder()
+        // Enough entries to need more than one chunk
+        def names = (0..<5000).collect { "file-with-a-rather-long-name-${it}.txt".toString() }
+        names.each { new File(testDir, it).text = it }
+        new File(testDir, "dir").mkdirs()
+
+        when:
+        def stream = files.openDir(testDir, false)
+        def entries = []
+        while (stream.hasNext()) {
+            entries << stream.next()
+        }
+
+        then:
+        entries.size() == names.size() + 1
+        entries*.name as Set == (names + ["dir"]) as Set
+        entries.every { it.name == "dir" ? it.type == FileInfo.Type.Directory : (it.type == FileInfo.Type.File && it.size == it.name.length()) }
+        !stream.hasNext()
+
+        cleanup:
+        stream?.close()
+    }
+
+    def "can close a stream over the contents of a directory before reading all entries"() {
+        def testDir = tmpDir.newFolder()
+        (0..<10).each { new File(testDir, "file-${it}.txt").text = "content" }
+
+        when:
+        def stream = files.openDir(testDir, false)
+        stream.next()
+        stream.close()
+        stream.close()
+
+        then:
+        !stream.hasNext()
+    }
+
+    def "cannot stream contents of missing directory"() {
+        def testFile = new File(tmpDir.root, "missing")
+
+        when:
+        files.openDir(testFile, false)
+
+        then:
+        def e = thrown(NoSuchFileException)
+        e.message == "Could not list directory $testFile as this directory does not exist."
+    }
+
+    def "can walk a directory tree"() {
+        def testDir = tmpDir.newFolder()
+        def expected = [:]
+        (0..<20).each { d ->
+            def dir = new File(testDir, "dir-${d}")
+            expected[testDir.toPath().relativize(dir.toPath()).toString()] = FileInfo.Type.Directory
+            (0..<5).each { s ->
+                def subDir = new File(dir, "sub-${s}")
+                subDir.mkdirs()
+                expected[testDir.toPath().relativize(subDir.toPath()).toString()] = FileInfo.Type.Directory
+                (0..<20).each { f ->
+                    def file = new File(subDir, "file-${f}.txt")
+                    file.text = file.name
+                    expected[testDir.toPath().relativize(file.toPath()).toString()] = FileInfo.Type.File
+                }
+            }
+        }
+
+        when:
+        def visited = [:]
+        def sizes = [:]
+        files.walk(testDir, new WalkOptions(), { path, type, size, lastModified ->
+            assert !visited.containsKey(path)
+            visited[path] = type
+            sizes[path] = size
+        } as FileTreeVisitor)
+
+        then:
+        visited == expected
+        sizes.every { path, size -> size == (visited[path] == FileInfo.Type.File ? new File(path).name.length() : 0) }
+    }
+
+    def "can walk a directory tree up to a maximum depth"() {
+        def testDir = tmpDir.newFolder()
+        new File(testDir, "a/b/c").mkdirs()
+        new File(testDir, "a/b/c/file.txt").text = "content"
+        new File(testDir, "file.txt").text = "content"
+
+        when:
+        def visited = []
+        files.walk(testDir, new WalkOptions().withMaxDepth(maxDepth), { path, type, size, lastModified -> visited << path } as FileTreeVisitor)
+
+        then:
+        visited.sort() == expected.collect { it.replace('/', File.separator) }
+
+        where:
+        maxDepth | expected
+        0        | []
+        1        | ["a", "file.txt"]
+        2        | ["a", "a/b", "file.txt"]
+        -1       | ["a", "a/b", "a/b/c", "a/b/c/file.txt", "file.txt"]
+    }
+
+    def "walking a directory tree stops when the visitor fails"() {
+        def testDir = tmpDir.newFolder()
+        (0..<3000).each { new File(testDir, "file-${it}.txt").text = "content" }
+        def failure = new RuntimeException("broken")
+
+        when:
+        def visited = 0
+        files.walk(testDir, new WalkOptions(), { path, type, size, lastModified ->
+            if (++visited == 10) {
+                throw failure
+            }
+        } as FileTreeVisitor)
+
+        then:
+        def e = thrown(RuntimeException)
+        e.is(failure)
+        visited == 10
+    }
+
+    @IgnoreIf({ !FilesTest.supportsSymbolicLinks() })
+    def "walks directories reachable via several symlinks once for each of them, but does not follow cycles"() {
+        def testDir = tmpDir.newFolder()
+        def dir = new File(testDir, "dir")
+        dir.mkdirs()
+        new File(dir, "file.txt").text = "content"
+        createDirectorySymbolicLink(new File(dir, "parent"), "..")
+        createDirectorySymbolicLink(new File(testDir, "link"), "dir")
+
+        when:
+        def visited = [:]
+        files.walk(testDir, new WalkOptions().withFollowLinks(true), { path, type, size, lastModified -> visited[path] = type } as FileTreeVisitor)
+
+        then:
+        // The symlinks back to the root are reported, but not walked
+        visited == [
+            "dir": FileInfo.Type.Directory,
+            ("dir" + File.separator + "file.txt"): FileInfo.Type.File,
+            ("dir" + File.separator + "parent"): FileInfo.Type.Directory,
+            "link": FileInfo.Type.Directory,
+            ("link" + File.separator + "file.txt"): FileInfo.Type.File,
+            ("link" + File.separator + "parent"): FileInfo.Type.Directory
+        ]
+    }
+
+    def "cannot walk a missing directory"() {
+        def testFile = new File(tmpDir.root, "missing")
+
+        when:
+        files.walk(testFile, new WalkOptions(), {} as FileTreeVisitor)
+
+        then:
+        def e = thrown(NoSuchFileException)
+        e.message == "Could not list directory $testFile as this directory does not exist."
+    }
+
+    def "can fingerprint a directory tree"() {
+        def testDir = tmpDir.newFolder()
+        new File(testDir, "a/b").mkdirs()
+        new File(testDir, "a-b").mkdirs()
+        new File(testDir, "a/b/file.txt").text = "content"
+        def changed = new File(testDir, "a-b/file.txt")
+        changed.text = "content"
+        def options = new FingerprintOptions().withDirectoryDigests(true)
+
+        when:
+        def fingerprint = files.fingerprint(testDir, options)
+        def sameTree = files.fingerprint(testDir, options.withThreads(1))
+
+        then:
+        fingerprint.digest.length == 32
+        fingerprint.digest == sameTree.digest
+        fingerprint.directoryDigests.keySet() as List == ["", "a", "a${File.separator}b".toString(), "a-b"]
+        fingerprint.directoryDigests[""] == fingerprint.digest
+
+        when:
+        changed.text = "changed content"
+        def changedTree = files.fingerprint(testDir, options)
+
+        then:
+        changedTree.digest != fingerprint.digest
+        changedTree.directoryDigests["a-b"] != fingerprint.directoryDigests["a-b"]
+        changedTree.directoryDigests["a"] == fingerprint.directoryDigests["a"]
+    }
+
+    def "can fingerprint a directory tree without last modified times"() {
+        def testDir = tmpDir.newFolder()
+        def file = new File(testDir, "file.txt")
+        file.text = "content"
+        def options = new FingerprintOptions().withLastModifiedTimes(false)
+        def withoutTimes = files.fingerprint(testDir, options)
+        def withTimes = files.fingerprint(testDir, new FingerprintOptions())
+
+        when:
+        file.setLastModified(file.lastModified() - 10000)
+
+        then:
+        files.fingerprint(testDir, options).digest == withoutTimes.digest
+        files.fingerprint(testDir, new FingerprintOptions()).digest != withTimes.digest
+    }
+
+    def "cannot fingerprint a missing directory"() {
+        def testFile = new File(tmpDir.root, "missing")
+
+        when:
+        files.fingerprint(testFile, new FingerprintOptions())
+
+        then:
+        def e = thrown(NoSuchFileException)
+        e.message == "Could not list directory $testFile as this directory does not exist."
+    }
+
     def "cannot list contents of file"() {
         def testFile = tmpDir.newFile()
 
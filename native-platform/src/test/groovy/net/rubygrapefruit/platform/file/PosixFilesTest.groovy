@@ -2,6 +2,7 @@ package net.rubygrapefruit.platform.file
 
 import net.rubygrapefruit.platform.Native
 import net.rubygrapefruit.platform.NativeException
+import net.rubygrapefruit.platform.internal.DefaultPosixFiles
 import net.rubygrapefruit.platform.internal.Platform
 import spock.lang.IgnoreIf
 import spock.lang.Unroll
@@ -10,6 +11,7 @@ import java.nio.file.LinkOption
 import java.nio.file.attribute.PosixFileAttributeView
 import java.nio.file.attribute.PosixFileAttributes
 import java.nio.file.attribute.PosixFilePermission
+import java.util.concurrent.TimeUnit
 
 import static java.nio.file.attribute.PosixFilePermission.*
 
@@ -98,6 +100,97 @@ class PosixFilesTest extends FilesTest {
         [OWNER_READ]  | _
     }
 
+    def "cannot stat many files when one of them has no execute permission on parent"() {
+        def testFile = tmpDir.newFile("test.file")
+        def testDir = tmpDir.newFolder("test-dir")
+        def deniedFile = new File(testDir, "test.file")
+        chmod(testDir, [OWNER_READ])
+
+        when:
+        files.stat([testFile, deniedFile], false)
+
+        then:
+        def e = thrown(FilePermissionException)
+        e.message == "Could not get file details of $deniedFile: permission denied"
+
+        cleanup:
+        chmod(testDir, [OWNER_READ, OWNER_WRITE, OWNER_EXECUTE])
+    }
+
+    def "stats many files at once the same way with and without io_uring"() {
+        def testDir = tmpDir.newFolder()
+        // Enough files for io_uring to be used where it is available
+        def testFiles = (0..<500).collect { new File(testDir, "file-${it}.txt") }
+        testFiles.each { it.text = it.name }
+        def subDir = new File(testDir, "sub")
+        subDir.mkdirs()
+        def missing = new File(testDir, "missing")
+        def threadedFiles = new DefaultPosixFiles(false)
+
+        when:
+        def stats = files.stat(testFiles + [subDir, missing], false)
+        def threadedStats = threadedFiles.stat(testFiles + [subDir, missing], false)
+
+        then:
+        threadedStats*.type == stats*.type
+        threadedStats*.size == stats*.size
+        threadedStats*.lastModifiedTime == stats*.lastModifiedTime
+        threadedStats*.mode == stats*.mode
+        assertIsFile(threadedStats[0], testFiles[0])
+        assertIsDirectory(threadedStats[testFiles.size()], subDir)
+        assertIsMissing(threadedStats[testFiles.size() + 1])
+    }
+
+    def "reports symlinks leading back to themselves as missing when walking and following symlinks"() {
+        def testDir = tmpDir.newFolder()
+        new File(testDir, "file.txt").text = "content"
+        files.symlink(new File(testDir, "loop"), "loop")
+
+        when:
+        def visited = [:]
+        files.walk(testDir, new WalkOptions().withFollowLinks(true), { path, type, size, lastModified -> visited[path] = type } as FileTreeVisitor)
+
+        then:
+        visited == ["file.txt": FileInfo.Type.File, "loop": FileInfo.Type.Missing]
+    }
+
+    def "fingerprint includes the targets of symlinks"() {
+        def testDir = tmpDir.newFolder()
+        def linkFile = new File(testDir, "link")
+        files.symlink(linkFile, "target")
+        def options = new FingerprintOptions().withLastModifiedTimes(false)
+        def fingerprint = files.fingerprint(testDir, options)
+
+        when:
+        linkFile.delete()
+        files.symlink(linkFile, "other")
+
+        then:
+        files.fingerprint(testDir, options).digest != fingerprint.digest
+
+        when:
+        linkFile.delete()
+        files.symlink(linkFile, "target")
+
+        then:
+        files.fingerprint(testDir, options).digest == fingerprint.digest
+    }
+
+    def "fingerprint includes symlinks leading back to themselves as missing when following symlinks"() {
+        def testDir = tmpDir.newFolder()
+        def linkFile = new File(testDir, "link")
+        files.symlink(linkFile, "missing")
+        def options = new FingerprintOptions().withFollowLinks(true)
+        def fingerprint = files.fingerprint(testDir, options)
+
+        when:
+        linkFile.delete()
+        files.symlink(linkFile, "link")
+
+        then:
+        files.fingerprint(testDir, options).digest == fingerprint.digest
+    }
+
     def "can stat a symlink with no read permissions on symlink"() {
         def testDir = tmpDir.newFolder("test-dir")
         new File(testDir, "test.file").createNewFile()
@@ -144,6 +237,63 @@ class PosixFilesTest extends FilesTest {
         chmod(testDir, [OWNER_READ, OWNER_WRITE])
     }
 
+    def "can stat selected details of a file"() {
+        def testFile = tmpDir.newFile("test.file")
+        testFile.text = "content"
+        def attributes = attributes(testFile)
+
+        when:
+        def stat = files.stat(testFile, false, EnumSet.of(PosixFileDetails.Field.Size, PosixFileDetails.Field.LastModifiedTime, PosixFileDetails.Field.Inode))
+
+        then:
+        stat.type == FileInfo.Type.File
+        stat.has(PosixFileDetails.Field.Size)
+        stat.size == 7
+        stat.has(PosixFileDetails.Field.LastModifiedTime)
+        stat.lastModifiedTime == TimeUnit.NANOSECONDS.toMillis(stat.lastModifiedTimeNanos)
+        assertTimestampMatches(stat.lastModifiedTime, attributes.lastModifiedTime().toMillis())
+        stat.has(PosixFileDetails.Field.Inode)
+        stat.inode == java.nio.file.Files.getAttribute(testFile.toPath(), "unix:ino")
+        !stat.has(PosixFileDetails.Field.Mode)
+        stat.mode == 0
+        !stat.has(PosixFileDetails.Field.LinkCount)
+        stat.linkCount == 0
+    }
+
+    def "can stat selected details of a symlink and its target"() {
+        def testFile = tmpDir.newFile("test.file")
+        def linkFile = new File(tmpDir.newFolder(), "link")
+        files.symlink(linkFile, testFile.absolutePath)
+        def fields = EnumSet.of(PosixFileDetails.Field.Mode, PosixFileDetails.Field.LinkCount)
+
+        when:
+        def stat = files.stat(linkFile, false, fields)
+
+        then:
+        stat.type == FileInfo.Type.Symlink
+
+        when:
+        stat = files.stat(linkFile, true, fields)
+
+        then:
+        stat.type == FileInfo.Type.File
+        stat.mode == mode(attributes(testFile))
+        stat.linkCount == 1
+    }
+
+    def "can stat selected details of a missing file"() {
+        def testFile = new File(tmpDir.root, "missing")
+
+        when:
+        def stat = files.stat(testFile, false, EnumSet.allOf(PosixFileDetails.Field))
+
+        then:
+        stat.type == FileInfo.Type.Missing
+        PosixFileDetails.Field.values().every { !stat.has(it) }
+        stat.size == 0
+        stat.lastModifiedTimeNanos == 0
+    }
+
     @Unroll
     def "stat follows symlinks to parent directory"() {
         def parentDir = tmpDir.newFolder()
@@ -317,6 +467,57 @@ class PosixFilesTest extends FilesTest {
         e.message == "Could not read symlink $symlinkFile: could not readlink (errno 22: Invalid argument)"
     }
 
+    @IgnoreIf({ !Platform.current().linux })
+    def "can use paths that are not valid in the locale as raw bytes"() {
+        def dir = tmpDir.newFolder()
+        def dirPath = dir.path.getBytes()
+        def name = [0x61, 0xff, 0xfe, 0x62] as byte[]
+        def path = raw(dirPath, name)
+        def target = [0x74, 0xff] as byte[]
+
+        when:
+        files.symlink(path, target)
+
+        then:
+        files.readLink(path) == target
+        files.stat(path, false).type == FileInfo.Type.Symlink
+        files.stat(path, true).type == FileInfo.Type.Missing
+
+        when:
+        def entries = files.listDir(dirPath, false)
+
+        then:
+        entries.size() == 1
+        entries[0].name == name
+        entries[0].type == FileInfo.Type.Symlink
+
+        when:
+        def otherPath = raw(dirPath, [0x66, 0xff] as byte[])
+        files.symlink(otherPath, "does-not-matter".getBytes())
+        files.setMode(dirPath, 0750)
+
+        then:
+        files.stat(dirPath, false).mode == 0750
+        files.listDir(dirPath, false).size() == 2
+    }
+
+    def "cannot use raw path that contains a NULL character"() {
+        when:
+        files.stat([0x61, 0x00, 0x62] as byte[], false)
+
+        then:
+        NativeException e = thrown()
+        e.message.endsWith(": path contains a NULL character")
+    }
+
+    byte[] raw(byte[] dir, byte[] name) {
+        def path = new ByteArrayOutputStream()
+        path.write(dir)
+        path.write((int) File.separatorChar)
+        path.write(name)
+        return path.toByteArray()
+    }
+
     @Override
     PosixFileAttributes attributes(File file) {
         return java.nio.file.Files.getFileAttributeView(file.toPath(), PosixFileAttributeView, LinkOption.NOFOLLOW_LINKS).readAttributes()
@@ -376,6 +376,50 @@ public class Main {
         System.out.println();
     }
 
+    private static class PrintingHandler implements FileWatchEvent.SettledHandler, FileWatchEvent.MoveHandler {
+        private final AtomicBoolean terminated;
+
+        PrintingHandler(AtomicBoolean terminated) {
+            this.terminated = terminated;
+        }
+
+        @Override
+        public void handleChangeEvent(FileWatchEvent.ChangeType type, String absolutePath) {
+            System.out.printf("Change detected: %s / '%s'%n", type, absolutePath);
+        }
+
+        @Override
+        public void handleUnknownEvent(String absolutePath) {
+            System.out.printf("Unknown event happened at %s%n", absolutePath);
+        }
+
+        @Override
+        public void handleOverflow(FileWatchEvent.OverflowType type, String absolutePath) {
+            System.out.printf("Overflow happened (path = %s, type = %s)%n", absolutePath, type);
+        }
+
+        @Override
+        public void handleFailure(Throwable failure) {
+            failure.printStackTrace();
+        }
+
+        @Override
+        public void handleSettled(String absolutePath) {
+            System.out.printf("Settled: '%s'%n", absolutePath);
+        }
+
+        @Override
+        public void handleMoved(String fromAbsolutePath, String toAbsolutePath) {
+            System.out.printf("Moved: '%s' -> '%s'%n", fromAbsolutePath, toAbsolutePath);
+        }
+
+        @Override
+        public void handleTerminated() {
+            System.out.printf("Terminated%n");
+            terminated.set(true);
+        }
+    }
+
     private static void watch(String path) throws InterruptedException {
         final BlockingQueue<FileWatchEvent> eventQueue = new ArrayBlockingQueue<FileWatchEvent>(16);
         Thread processorThread = new Thread(new Runnable() {
@@ -389,33 +433,7 @@ public class Main {
                     } catch (InterruptedException e) {
                         break;
                     }
-                    event.handleEvent(new FileWatchEvent.Handler() {
-                        @Override
-                        public void handleChangeEvent(FileWatchEvent.ChangeType type, String absolutePath) {
-                            System.out.printf("Change detected: %s / '%s'%n", type, absolutePath);
-                        }
-
-                        @Override
-                        public void handleUnknownEvent(String absolutePath) {
-                            System.out.printf("Unknown event happened at %s%n", absolutePath);
-                        }
-
-                        @Override
-                        public void handleOverflow(FileWatchEvent.OverflowType type, String absolutePath) {
-                            System.out.printf("Overflow happened (path = %s, type = %s)%n", absolutePath, type);
-                        }
-
-                        @Override
-                        public void handleFailure(Throwable failure) {
-                            failure.printStackTrace();
-                        }
-
-                        @Override
-                        public void handleTerminated() {
-                            System.out.printf("Terminated%n");
-                            terminated.set(true);
-                        }
-                    });
+                    event.handleEvent(new PrintingHandler(terminated));
                 }
             }
         }, "File watcher event handler");
@@ -448,6 +466,7 @@ public class Main {
         } else if (Platform.current().isLinux()) {
             watcher = FileEvents.get(LinuxFileEventFunctions.class)
                 .newWatcher(eventQueue)
+                .withMoveEvents()
                 .start();
         } else if (Platform.current().isWindows()) {
             watcher = FileEvents.get(WindowsFileEventFunctions.class)